@@ -10,80 +10,441 @@
 #include <assert.h>
 #include "apint.h"
 #include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define APINT_X86_64 1
+#endif
 
-ApInt *apint_create_from_u64(uint64_t val) { //ms1
-    ApInt *ap = (ApInt*) malloc(sizeof(ApInt));
-    ap->len = 1;
-    ap->flags = 0; // a uint64_t will always be non-negative
-    ap->data = (uint64_t*)malloc(ap->len*sizeof(uint64_t));
-    ap->data[0] = val;
-	return ap;
+/*
+ * Statistics
+ *
+ * With APINT_STATS defined each thread counts into a StatsBlock of its
+ * own, linked into stats_threads the first time it counts anything, so
+ * the counting never shares a cache line or takes a lock.  Only the
+ * owner writes a block (relaxed atomics keep the readers well defined);
+ * apint_stats_get sums them under stats_lock.  A thread's block is
+ * folded into stats_retired when it exits, and apint_stats_reset moves
+ * the baseline that snapshots are taken against instead of writing
+ * other threads' blocks.  Without APINT_STATS the STAT_ macros are empty.
+ */
+#ifdef APINT_STATS
+typedef struct StatsBlock {
+    ApIntStats s;
+    struct StatsBlock *prev, *next;
+} StatsBlock;
+
+#define STATS_WORDS (sizeof(ApIntStats) / sizeof(uint64_t))
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static StatsBlock *stats_threads;
+static ApIntStats stats_retired, stats_base;
+static _Thread_local StatsBlock *stats_mine;
+
+// acc += the counters in s, as the owner may be writing them
+static void stats_accumulate(uint64_t *acc, const ApIntStats *s) {
+    const uint64_t *w = (const uint64_t*)s;
+    for (size_t i = 0; i < STATS_WORDS; i++) {
+        acc[i] += __atomic_load_n(&w[i], __ATOMIC_RELAXED);
+    }
 }
 
-int find_max(int a, int b){ // helper function to find max of two numbers
-    if(a > b){
-        return a;
-    } else{
-        return b;
+// thread exit: keep the counts, drop the block
+static void stats_retire(void *arg) {
+    StatsBlock *b = (StatsBlock*)arg;
+    pthread_mutex_lock(&stats_lock);
+    if (b->prev != NULL) {
+        b->prev->next = b->next;
+    } else {
+        stats_threads = b->next;
     }
+    if (b->next != NULL) {
+        b->next->prev = b->prev;
+    }
+    stats_accumulate((uint64_t*)&stats_retired, &b->s);
+    pthread_mutex_unlock(&stats_lock);
+    free(b);
 }
 
-uint64_t convert_hex_to_dec(char *hex){ // hex refers to an (at max) 16 character/64 bit representation
-    uint64_t dec = strtoul(hex, NULL, 16);
-    return dec;
+static void stats_key_init(void) {
+    pthread_key_create(&stats_key, stats_retire);
 }
 
-ApInt *apint_create_from_hex(const char *hex) {
-    //assumes len(hex) > 0 --> need test
-    ApInt *ap = (ApInt*) malloc(sizeof(ApInt));
-    int i = 0; // value used to keep track of start of array
-    // identify sign of hex
-    ap->flags = 0;
-    if(hex[i] == '-'){
-        ap->flags = 1;
-        i++;
+// the calling thread's block; from malloc, since the hooks are what it counts
+static StatsBlock *stats_block(void) {
+    StatsBlock *b = stats_mine;
+    if (__builtin_expect(b == NULL, 0)) {
+        b = (StatsBlock*)calloc(1, sizeof(StatsBlock));
+        pthread_once(&stats_once, stats_key_init);
+        pthread_setspecific(stats_key, b);
+        pthread_mutex_lock(&stats_lock);
+        b->next = stats_threads;
+        if (stats_threads != NULL) {
+            stats_threads->prev = b;
+        }
+        stats_threads = b;
+        pthread_mutex_unlock(&stats_lock);
+        stats_mine = b;
     }
-    // ignores leading 0s
-    int hexlen = strlen(hex);
-    while(i < hexlen && hex[i] == '0'){
-        i++;
+    return b;
+}
+
+static inline void stats_add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static void stats_call(ApIntStatOp op, size_t n) {
+    StatsBlock *b = stats_block();
+    unsigned k = n <= 1 ? 0 : 64 - __builtin_clzll(n - 1);
+    stats_add(&b->s.calls[op], 1);
+    stats_add(&b->s.sizes[op][k < APINT_STATS_SIZE_BUCKETS ? k : APINT_STATS_SIZE_BUCKETS - 1], 1);
+}
+
+static void stats_mem(uint64_t *count, uint64_t *bytes, size_t n) {
+    stats_add(count, 1);
+    stats_add(bytes, n);
+}
+
+#define STAT_CALL(op, n) stats_call(op, n)
+#define STAT_ALGO(which) stats_add(&stats_block()->s.algo[which], 1)
+#define STAT_ALLOC(size) stats_mem(&stats_block()->s.allocs, &stats_block()->s.alloc_bytes, size)
+#define STAT_FREE(size) stats_mem(&stats_block()->s.frees, &stats_block()->s.free_bytes, size)
+#define STAT_REALLOC(old_size, new_size) \
+    (new_size >= old_size ? stats_mem(&stats_block()->s.reallocs, &stats_block()->s.alloc_bytes, new_size - old_size) \
+                          : stats_mem(&stats_block()->s.reallocs, &stats_block()->s.free_bytes, old_size - new_size))
+#else
+#define STAT_CALL(op, n) ((void)0)
+#define STAT_ALGO(which) ((void)0)
+#define STAT_ALLOC(size) ((void)0)
+#define STAT_FREE(size) ((void)0)
+#define STAT_REALLOC(old_size, new_size) ((void)0)
+#endif
+
+int apint_stats_get(ApIntStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+#ifdef APINT_STATS
+    uint64_t *acc = (uint64_t*)stats;
+    const uint64_t *base = (const uint64_t*)&stats_base;
+    pthread_mutex_lock(&stats_lock);
+    stats_accumulate(acc, &stats_retired);
+    for (StatsBlock *b = stats_threads; b != NULL; b = b->next) {
+        stats_accumulate(acc, &b->s);
+    }
+    for (size_t i = 0; i < STATS_WORDS; i++) {
+        acc[i] -= base[i];
     }
-    // checks if hex = 0
-    if(i == hexlen){
-        ap->len = 1; // 0 is length 1
-        ap->data = (uint64_t*)malloc(ap->len*sizeof(uint64_t));
-        ap->data[0] = 0UL;
-    } else { // hex > 0
-        int blocks = (hexlen - i) / 16; // length of data/number of uint64_t blocks based on number of 64 bit blocks
-        if((hexlen-i)%16 > 0) { // adjusts block count based on remainder
-            blocks++;
-        }
-        ap->len = blocks;
-        ap->data = (uint64_t*)malloc(ap->len*sizeof(uint64_t)); // allocate enough memory for the blocks
-        int end = hexlen-1; // keeps track of the last index
-        for(int j = 0; j < blocks; j++){ // fills data array block by block
-            int start = end - 16 + 1; // keeps track of the start of a 16 character representation
-            start = find_max(start, i);
-            int numchars = end - start + 1; // number of characters in a block - most often will be 16, unless block < 64 bit
-            char *hex16 = (char*)malloc(numchars*sizeof(char)+1); // allocate memory to store chars of one block
-            for(int k = 0; k < numchars; k++){ // fill hex16 with 64 bits of hex
-               hex16[k] = hex[start]; 
-               start++;
+    pthread_mutex_unlock(&stats_lock);
+    return APINT_OK;
+#else
+    return APINT_ERR_INVALID;
+#endif
+}
+
+void apint_stats_reset(void) {
+#ifdef APINT_STATS
+    ApIntStats now;
+    apint_stats_get(&now);
+    pthread_mutex_lock(&stats_lock);
+    uint64_t *base = (uint64_t*)&stats_base;
+    const uint64_t *w = (const uint64_t*)&now;
+    for (size_t i = 0; i < STATS_WORDS; i++) {
+        base[i] += w[i];
+    }
+    pthread_mutex_unlock(&stats_lock);
+#endif
+}
+
+static const char *const stats_op_names[APINT_STAT_OP_COUNT] = {
+    "create", "destroy", "add", "sub", "mul", "divmod", "compare", "shift",
+    "bitwise", "parse_hex", "format_hex", "parse_dec", "format_dec", "powmod",
+    "gcd", "root",
+};
+
+static const char *const stats_algo_names[APINT_ALGO_COUNT] = {
+    "mul_basecase", "mul_karatsuba", "mul_toom3", "mul_ntt", "mul_sliced",
+    "div_1", "div_knuth", "div_newton", "dec_chunked", "dec_dc",
+    "powmod_mont", "powmod_div", "gcd_binary", "gcd_lehmer", "gcd_hgcd",
+    "parallel",
+};
+
+// calls.OP, size.OP.LIMBS (the bucket's upper bound), algo.NAME and mem.*
+void apint_stats_dump(FILE *out) {
+    ApIntStats s;
+    apint_stats_get(&s);
+    for (int op = 0; op < APINT_STAT_OP_COUNT; op++) {
+        if (s.calls[op] == 0) {
+            continue;
+        }
+        fprintf(out, "calls.%s %llu\n", stats_op_names[op], (unsigned long long)s.calls[op]);
+        for (int k = 0; k < APINT_STATS_SIZE_BUCKETS; k++) {
+            if (s.sizes[op][k] != 0) {
+                fprintf(out, "size.%s.%lu %llu\n", stats_op_names[op], 1UL << k, (unsigned long long)s.sizes[op][k]);
             }
-            hex16[numchars] = '\0';
-            ap->data[j] = convert_hex_to_dec(hex16);
-            free(hex16);
-            end = end - numchars;
         }
-    } 
+    }
+    for (int a = 0; a < APINT_ALGO_COUNT; a++) {
+        if (s.algo[a] != 0) {
+            fprintf(out, "algo.%s %llu\n", stats_algo_names[a], (unsigned long long)s.algo[a]);
+        }
+    }
+    static const char *const mem_names[] = { "allocs", "reallocs", "frees", "alloc_bytes", "free_bytes" };
+    const uint64_t mem[] = { s.allocs, s.reallocs, s.frees, s.alloc_bytes, s.free_bytes };
+    for (int i = 0; i < 5; i++) {
+        if (mem[i] != 0) {
+            fprintf(out, "mem.%s %llu\n", mem_names[i], (unsigned long long)mem[i]);
+        }
+    }
+}
+
+/*
+ * Memory
+ *
+ * Every allocation goes through the hooks below, which apint_set_allocator
+ * can replace.  As in GMP, realloc and free are passed the block's size so
+ * a pool allocator needs no headers of its own.  Values created in an
+ * ApIntArena take their struct and limbs from the arena instead and are
+ * released all at once with it.
+ */
+
+static void *default_alloc(size_t size) {
+    return malloc(size);
+}
+
+static void *default_realloc(void *ptr, size_t old_size, size_t new_size) {
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void default_free(void *ptr, size_t size) {
+    (void)size;
+    free(ptr);
+}
+
+static ApIntAllocFunc alloc_hook = default_alloc;
+static ApIntReallocFunc realloc_hook = default_realloc;
+static ApIntFreeFunc free_hook = default_free;
+
+// the hooks as the rest of the file calls them, counted for apint_stats
+static void *mem_alloc(size_t size) {
+    STAT_ALLOC(size);
+    return alloc_hook(size);
+}
+
+static void *mem_realloc(void *ptr, size_t old_size, size_t new_size) {
+    STAT_REALLOC(old_size, new_size);
+    return realloc_hook(ptr, old_size, new_size);
+}
+
+static void mem_free(void *ptr, size_t size) {
+    STAT_FREE(size);
+    free_hook(ptr, size);
+}
+
+void apint_set_allocator(ApIntAllocFunc alloc, ApIntReallocFunc realloc_fn, ApIntFreeFunc free_fn) {
+    alloc_hook = alloc != NULL ? alloc : default_alloc;
+    realloc_hook = realloc_fn != NULL ? realloc_fn : default_realloc;
+    free_hook = free_fn != NULL ? free_fn : default_free;
+}
+
+void apint_get_allocator(ApIntAllocFunc *alloc, ApIntReallocFunc *realloc_fn, ApIntFreeFunc *free_fn) {
+    if (alloc != NULL) {
+        *alloc = alloc_hook;
+    }
+    if (realloc_fn != NULL) {
+        *realloc_fn = realloc_hook;
+    }
+    if (free_fn != NULL) {
+        *free_fn = free_hook;
+    }
+}
+
+// scratch limbs for the mpn layer
+static uint64_t *limbs_alloc(size_t n) {
+    return (uint64_t*)mem_alloc(n * sizeof(uint64_t));
+}
+
+static void limbs_free(uint64_t *p, size_t n) {
+    mem_free(p, n * sizeof(uint64_t));
+}
+
+void apint_free_str(char *s) {
+    mem_free(s, strlen(s) + 1);
+}
+
+/*
+ * Arenas are a list of blocks carved front to back.  Only the head block
+ * is ever carved; a request bigger than the block size gets a block of
+ * its own, linked in behind the head so the head's free space is kept.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size; // usable bytes after the header
+    size_t used;
+} ArenaBlock;
+
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_HEADER ARENA_ROUND(sizeof(ArenaBlock))
+#define ARENA_MEM(b) ((unsigned char*)(b) + ARENA_HEADER)
+#define ARENA_DEFAULT_BLOCK 65536
+
+struct ApIntArena {
+    ArenaBlock *head;
+    size_t block_size;
+};
+
+ApIntArena *apint_arena_create(size_t block_bytes) {
+    ApIntArena *arena = (ApIntArena*)mem_alloc(sizeof(ApIntArena));
+    arena->head = NULL;
+    arena->block_size = ARENA_ROUND(block_bytes > 0 ? block_bytes : ARENA_DEFAULT_BLOCK);
+    return arena;
+}
+
+// keeps the head block for reuse; everything else goes back to the hooks
+void apint_arena_reset(ApIntArena *arena) {
+    ArenaBlock *b = arena->head;
+    if (b == NULL) {
+        return;
+    }
+    ArenaBlock *next = b->next;
+    b->next = NULL;
+    b->used = 0;
+    while (next != NULL) {
+        b = next;
+        next = b->next;
+        mem_free(b, ARENA_HEADER + b->size);
+    }
+}
+
+void apint_arena_destroy(ApIntArena *arena) {
+    apint_arena_reset(arena);
+    if (arena->head != NULL) {
+        mem_free(arena->head, ARENA_HEADER + arena->head->size);
+    }
+    mem_free(arena, sizeof(ApIntArena));
+}
+
+static void *arena_alloc(ApIntArena *arena, size_t size) {
+    size = ARENA_ROUND(size);
+    ArenaBlock *head = arena->head;
+    if (head != NULL && head->size - head->used >= size) {
+        void *p = ARENA_MEM(head) + head->used;
+        head->used += size;
+        return p;
+    }
+    size_t bsize = size > arena->block_size ? size : arena->block_size;
+    ArenaBlock *b = (ArenaBlock*)mem_alloc(ARENA_HEADER + bsize);
+    b->size = bsize;
+    b->used = size;
+    if (head != NULL && size > arena->block_size) { // oversize: keep carving the head
+        b->next = head->next;
+        head->next = b;
+    } else {
+        b->next = head;
+        arena->head = b;
+    }
+    return ARENA_MEM(b);
+}
+
+// grows in place when ptr is the most recent allocation in the head block
+static void *arena_realloc(ApIntArena *arena, void *ptr, size_t old_size, size_t new_size) {
+    old_size = ARENA_ROUND(old_size);
+    new_size = ARENA_ROUND(new_size);
+    ArenaBlock *head = arena->head;
+    if ((unsigned char*)ptr + old_size == ARENA_MEM(head) + head->used
+            && head->size - head->used >= new_size - old_size) {
+        head->used += new_size - old_size;
+        return ptr;
+    }
+    void *p = arena_alloc(arena, new_size);
+    memcpy(p, ptr, old_size);
+    return p;
+}
+
+static uint64_t *apint_alloc_data(ApIntArena *arena, size_t limbs) {
+    if (arena != NULL) {
+        return (uint64_t*)arena_alloc(arena, limbs * sizeof(uint64_t));
+    }
+    return limbs_alloc(limbs);
+}
+
+// releases ap's limbs, unless they are inline or the arena owns them
+static void apint_free_data(ApInt *ap) {
+    if (ap->arena == NULL && ap->data != ap->small) {
+        limbs_free(ap->data, ap->cap);
+    }
+}
+
+// zero value with room for cap limbs, inline when they fit
+static ApInt *apint_new_in(ApIntArena *arena, uint32_t cap) {
+    ApInt *ap;
+    STAT_CALL(APINT_STAT_CREATE, cap);
+    if (arena != NULL) {
+        ap = (ApInt*)arena_alloc(arena, sizeof(ApInt));
+    } else {
+        ap = (ApInt*)mem_alloc(sizeof(ApInt));
+    }
+    ap->len = 1;
+    ap->cap = cap;
+    ap->flags = 0;
+    ap->arena = arena;
+    if (cap <= APINT_INLINE_LIMBS) {
+        ap->cap = APINT_INLINE_LIMBS;
+        ap->data = ap->small;
+    } else {
+        ap->data = apint_alloc_data(arena, cap);
+    }
+    ap->data[0] = 0;
+    return ap;
+}
+
+static ApInt *apint_new(uint32_t cap) {
+    return apint_new_in(NULL, cap);
+}
+
+ApInt *apint_create_from_u64(uint64_t val) { //ms1
+    ApInt *ap = apint_new(1);
+    ap->data[0] = val; // a uint64_t will always be non-negative
 	return ap;
 }
 
+ApInt *apint_arena_create_from_u64(ApIntArena *arena, uint64_t val) {
+    ApInt *ap = apint_new_in(arena, 1);
+    ap->data[0] = val;
+    return ap;
+}
+
+// NULL when hex is not a valid hex string
+ApInt *apint_create_from_hex(const char *hex) {
+    ApInt *ap = apint_new(1);
+    if (apint_set_hex(ap, hex) != APINT_OK) {
+        apint_destroy(ap);
+        return NULL;
+    }
+	return ap;
+}
+
+ApInt *apint_arena_create_from_hex(ApIntArena *arena, const char *hex) {
+    ApInt *ap = apint_new_in(arena, 1);
+    return apint_set_hex(ap, hex) == APINT_OK ? ap : NULL;
+}
+
+// values from an arena are released with the arena
 void apint_destroy(ApInt *ap) {
-	free(ap->data);
+    STAT_CALL(APINT_STAT_DESTROY, ap->len);
+    if (ap->arena != NULL) {
+        return;
+    }
+    apint_free_data(ap);
     ap->data = NULL;
-    free(ap);
-    ap = NULL;
+    mem_free(ap, sizeof(ApInt));
 }
 
 int apint_is_zero(const ApInt *ap) { //ms1
@@ -115,53 +476,21 @@ int apint_highest_bit_set(const ApInt *ap) {
     } else{
         uint64_t x = ap->data[ap->len-1];
         int soln = 64*(ap->len-1); // keeps track of preceding uint64_t's in data
-        int i = -1;
-        while (x != 0){ // shift bits left until 0
-            x = x >> 1;
-            i++;
-        }
-        soln += i;
+        soln += 63 - __builtin_clzll(x); // position of the top 1 bit in the top block
         return soln;
     }
 }
 
+// the string comes from the allocator hooks; release it with apint_free_str
 char *apint_format_as_hex(const ApInt *ap) {
-    char* s = malloc(sizeof(char) * (ap->len*16)+1);
-    s[0] = '\0';
-    for (int i = ap->len-1; i > -1; i--) {
-        char temp[17];
-        sprintf(temp, "%lx", ap->data[i]);
-        int templen = strlen(temp);
-        int aplenind = ap->len-1;
-        if(templen < 16 && ap->len > 1 && i < aplenind){ // checks if leading zeros need to be added to the hex representatiion of a uint64 within data
-            int zero_pad = 16-templen;
-            char* newtemp = malloc(sizeof(char)*17);
-            for(int j = 0; j < zero_pad; j++){ // pads hex with zeros
-                newtemp[j] = '0';
-            }
-            newtemp[zero_pad] = '\0';
-            strcat(newtemp,temp);
-            strcat(s, newtemp);
-            free(newtemp);
-        } else{
-            strcat(s, temp);
-        }
-    } 
-    if (ap->flags == 1) { // adjusts hex for negative cases
-        char* s2 = malloc(sizeof(char) * (ap->len*16+2));
-        s2[0] = '-';
-        s2[1] = '\0';
-        strcat(s2, s);
-        free(s);
-        return s2;
-    } else {
-        return s;
-    }
-    
+    size_t size = apint_hex_size(ap);
+    char *s = (char*)mem_alloc(size); // exact size, for free_hook
+    apint_format_as_hex_into(s, size, ap);
+    return s;
 }
 
 ApInt *apint_negate(const ApInt *ap) { 
-	ApInt *ap_neg = (ApInt*)malloc(sizeof(ApInt));
+	ApInt *ap_neg = apint_new(ap->len);
     
     // This checks if ap is negative or zero
     if(ap->flags == 1 || (ap->len == 1 && ap->data[0] == 0)){
@@ -170,7 +499,6 @@ ApInt *apint_negate(const ApInt *ap) {
         ap_neg->flags = 1;
     }
     ap_neg->len = ap->len;
-    ap_neg->data = (uint64_t*)malloc((ap_neg->len)*sizeof(uint64_t));
     for(uint32_t i=0; i < ap_neg->len; i++){
         ap_neg->data[i] = ap->data[i];
     }
@@ -178,148 +506,59 @@ ApInt *apint_negate(const ApInt *ap) {
 	return ap_neg;
 }
 
-// helper to add magnitudes to two apint instances
-// |a| > |b|
+static uint64_t mpn_add(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn);
+static uint64_t mpn_sub(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn);
+static size_t mpn_normalized_size(const uint64_t *p, size_t n);
+static void apint_finish(ApInt *ap, size_t n, uint32_t flags);
+
+// helper to add magnitudes to two apint instances: sum = |a| + |b|
+// |a| >= |b|; sum may be a or b
 ApInt *addition(const ApInt *a, const ApInt *b, ApInt *sum){
-    uint64_t *data = (uint64_t*)malloc((a->len)*sizeof(uint64_t));
-    uint64_t carry = 0;
-    sum->len = a->len;
-    for (uint i = 0; i < a->len; i++) { // calculates sum block by block
-        uint64_t tempsum = a->data[i] + apint_get_bits(b, i) + carry;
-        if (tempsum < a->data[i] || tempsum < apint_get_bits(b, i)) { // detects overflow
-            carry = 1;
-        } else { // no overflow
-            carry = 0;
-        }
-        data[i] = tempsum;
+    size_t an = mpn_normalized_size(a->data, a->len);
+    size_t bn = mpn_normalized_size(b->data, b->len);
+    if (an == 0) {
+        apint_set_u64(sum, 0UL);
+        return sum;
     }
-    
-    if (carry > 0) { // incorporates remaining carryover into sum
-        data = (uint64_t*) realloc(data, (sum->len+1)*sizeof(uint64_t));
-        sum->len++;
-        data[sum->len-1] = carry;
-    }
-    sum->data = data;
-    /*
-    if (carry > 0) {
-        uint64_t *data2 = (uint64_t*)malloc((sum->len+1)*sizeof(uint64_t));
-        for(uint i = 0; i < sum->len; i++){
-            data2[i] = data[i];
-        }
-        data[sum->len] = carry;
-        sum->len++;
-        free(data);
-        sum->data = data2;
-    } else{
-        sum->data = data;
-    }*/
-    
-    
+    apint_reserve(sum, an);
+    uint64_t carry = mpn_add(sum->data, a->data, an, b->data, bn);
+    if (carry) {
+        apint_reserve(sum, an + 1);
+        sum->data[an] = carry;
+    }
+    apint_finish(sum, an + carry, 0);
     return sum;
 }
 
-// helper to subtract magnitudes to two apint instances
-// |a| > |b|
+// helper to subtract magnitudes to two apint instances: diff = |a| - |b|
+// |a| >= |b|; diff may be a or b
 ApInt *subtraction(const ApInt *a, const ApInt *b, ApInt *diff){
-    uint64_t *data = (uint64_t*)malloc((a->len)*sizeof(uint64_t));
-    
-    // set to zero
-    for(uint i = 0; i < a->len; i++){
-        data[i] = 0UL;
-    }
-    
-    uint64_t borrow = 0;
-
-    for (uint i = 0; i < a->len; i++) { // calculate different block by block
-        uint64_t tempdiff = a->data[i] - apint_get_bits(b,i) - borrow;
-        if (apint_get_bits(b,i) > a->data[i]) { // detect overflow
-            borrow = 1; 
-        }
-        else if (borrow == 1 && a->data[i] == 0) { // detect overflow
-            borrow = 1;
-        }
-        else { // no overflow
-            borrow = 0;
-        }
-        data[i] = tempdiff;
-        
-    }
-    diff->data = data;
-    
-    // readjust length to remove blank blocks in data
-    diff->len = a->len;
-    for(int i = a->len-1; i > -1; i--){
-        if(data[i] == 0){
-            diff->len --;
-        }
-    }
-    if(diff->len == 0){ //adjust length in special case of diff = 0
-        diff->len = 1;
+    size_t an = mpn_normalized_size(a->data, a->len);
+    size_t bn = mpn_normalized_size(b->data, b->len);
+    if (an == 0) {
+        apint_set_u64(diff, 0UL);
+        return diff;
     }
+    apint_reserve(diff, an);
+    mpn_sub(diff->data, a->data, an, b->data, bn);
+    apint_finish(diff, an, 0); // drops the leading zero limbs
     return diff;
 }
 
 ApInt *apint_add(const ApInt *a, const ApInt *b) { //ms1
-    ApInt *sum = (ApInt*)malloc(sizeof(ApInt));
-    if (a->flags == b->flags) { // same signs
-        sum->flags = a->flags;
-        if(a->flags == 1){ // both apints are negative
-            ApInt *aneg = apint_negate(a);
-            ApInt *bneg = apint_negate(b);
-            if(apint_compare(aneg, bneg) == 1){ // |a| > |b|
-                sum = addition(a,b,sum);
-            } else{ // |a| <= |b|
-                sum = addition(b,a,sum);
-            }
-            apint_destroy(aneg);
-            apint_destroy(bneg);
-        } else{
-            if(apint_compare(a,b) == 1){ // |a| > |b|
-                sum = addition(a,b,sum);
-            } else{ // |a| <= |b|
-                sum = addition(b,a,sum);
-            }
-        }
-    } else{ //diff signs
-        if(a->flags == 1){ //a is negative
-            ApInt *aneg = apint_negate(a);
-            if(apint_compare(aneg, b) == 1){ // |a| > |b|
-                sum->flags = a->flags;
-                sum = subtraction(a, b, sum);
-            } else{ // |a| <= |b|
-                sum->flags = b->flags;
-                sum = subtraction(b, a, sum);
-                if(apint_is_zero(sum)){
-                    sum->flags = 0;
-                }
-            }
-            apint_destroy(aneg);
-        } else{ // b is negative
-            ApInt *bneg = apint_negate(b);
-            if(apint_compare(a, bneg) == 1){ // |a| > |b|
-                sum->flags = a->flags;
-                sum = subtraction(a, b, sum);
-            } else{ // |a| <= |b|
-                sum->flags = b->flags;
-                sum = subtraction(b, a, sum);
-                if(apint_is_zero(sum)){
-                    sum->flags = 0;
-                }
-            }
-            apint_destroy(bneg);
-        }
-    }
+    ApInt *sum = apint_new(a->len > b->len ? a->len : b->len);
+    apint_add_into(sum, a, b);
 	return sum;
 }
 
 ApInt *apint_sub(const ApInt *a, const ApInt *b) {
-    ApInt *negative_b = apint_negate(b);
-    ApInt *sum = apint_add(a, negative_b);
-    apint_destroy(negative_b);
-    return sum;
+    ApInt *diff = apint_new(a->len > b->len ? a->len : b->len);
+    apint_sub_into(diff, a, b);
+    return diff;
 }
 
 int apint_compare(const ApInt *left, const ApInt *right) {
+    STAT_CALL(APINT_STAT_COMPARE, left->len > right->len ? left->len : right->len);
     uint32_t flagl = left->flags;
     uint32_t flagr = right->flags;
     if(flagl == flagr){
@@ -365,28 +604,4430 @@ int apint_compare(const ApInt *left, const ApInt *right) {
 ApInt *apint_lshift(ApInt *ap){
     return apint_lshift_n(ap, 1);
 }
+// keeps ap's width: bits shifted past its top limb are dropped
 ApInt *apint_lshift_n(ApInt *ap, unsigned n){
-    ApInt *apshift = (ApInt*) malloc(sizeof(ApInt));
-    apshift->len = ap->len;
-    apshift->flags = ap->flags; // shift won't affect flags
-    apshift->data = (uint64_t*)malloc(apshift->len*sizeof(uint64_t));
-    uint64_t cur = ap->data[ap->len - 1];
-    cur = cur << n; // shift most significant bits left
-    
-    int i = apshift->len - 1; // keep track of current uint64 block
-    while(i > 0){ // loop through each block
-        uint64_t prev = ap->data[i-1]; // keep track of previous uint64 block
-        int shiftforprev = 64 - n; // calculate right shift for prev
-        uint64_t firstn = prev >> shiftforprev; // shift prev right 64-n times to 
-        apshift->data[i] = cur + firstn;
-        cur = prev;
-        cur = cur << n;
-        i--;
-    }
-    apshift->data[i] = cur;
-    /* implementation of shifting each data[i] left 
-    for(uint32_t i = 0; i < apshift->len; i++){
-        apshift->data[i] = ap->data[i] << n;
-    }*/
-	return apshift;
+    size_t q = n / 64, len = ap->len;
+    ApInt *apshift = apint_new(len + 1);
+    if (q >= len) { // everything is shifted out
+        return apshift;
+    }
+    ApInt low = *ap; // a view of the limbs that survive
+    low.len = len - q;
+    apint_lshift_bits_into(apshift, &low, n); // at most len + 1 limbs, the top one dropped below
+    apint_finish(apshift, apshift->len < len ? apshift->len : len, ap->flags);
+    return apshift;
+}
+
+ApInt *apint_lshift_bits(const ApInt *ap, size_t bits) {
+    if (bits / 64 >= UINT32_MAX - ap->len) {
+        return NULL;
+    }
+    ApInt *r = apint_new(ap->len + bits / 64 + 1);
+    if (apint_lshift_bits_into(r, ap, bits) != APINT_OK) {
+        apint_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+ApInt *apint_rshift_bits(const ApInt *ap, size_t bits) {
+    size_t q = bits / 64;
+    ApInt *r = apint_new(q < ap->len ? ap->len - q + 1 : 1);
+    apint_rshift_bits_into(r, ap, bits);
+    return r;
+}
+
+/*
+ * Threads
+ *
+ * apint_set_threads starts a pool of worker threads that the largest
+ * operations hand independent pieces of work to: the products at the
+ * top of Karatsuba and Toom-3, the three NTT primes, the halves of
+ * decimal conversion, the chunks of a long addition.  pool_run runs
+ * task(arg, i) for every i < count and returns when all are done; the
+ * caller works on its own job too, so a task may start a job of its
+ * own (an inner recursion level) without tying up a thread waiting.
+ * Items are coarse, so one mutex guarding the job list costs nothing
+ * measurable.
+ */
+
+typedef void (*PoolTask)(void *arg, size_t i);
+
+typedef struct PoolJob {
+    PoolTask task;
+    void *arg;
+    size_t count, next, done; // items, next item to start, items finished
+    struct PoolJob *link;
+} PoolJob;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    // for workers: a job has items to start, or stop is set
+    pthread_cond_t done;    // for callers: an item finished
+    PoolJob *jobs;          // jobs with items not yet started
+    pthread_t *threads;
+    unsigned nthreads;      // workers, not counting the threads that call in
+    int stop;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0 };
+
+// runs the next item of job, with the lock held on entry and exit
+static void pool_run_item(PoolJob *job) {
+    size_t i = job->next++;
+    if (job->next == job->count) { // fully started: unlink it
+        PoolJob **p = &pool.jobs;
+        while (*p != job) {
+            p = &(*p)->link;
+        }
+        *p = job->link;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    job->task(job->arg, i);
+    pthread_mutex_lock(&pool.lock);
+    if (++job->done == job->count) {
+        pthread_cond_broadcast(&pool.done);
+    }
+}
+
+static void *pool_worker(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (!pool.stop && pool.jobs == NULL) {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+        if (pool.stop) {
+            break;
+        }
+        pool_run_item(pool.jobs);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+static int pool_active(void) {
+    return __atomic_load_n(&pool.nthreads, __ATOMIC_RELAXED) > 0;
+}
+
+// with parallel 0, or no workers, this is just a loop
+static void pool_run(PoolTask task, void *arg, size_t count, int parallel) {
+    if (!parallel || count < 2 || !pool_active()) {
+        for (size_t i = 0; i < count; i++) {
+            task(arg, i);
+        }
+        return;
+    }
+    STAT_ALGO(APINT_ALGO_PARALLEL);
+    PoolJob job = { task, arg, count, 0, 0, NULL };
+    pthread_mutex_lock(&pool.lock);
+    job.link = pool.jobs;
+    pool.jobs = &job;
+    pthread_cond_broadcast(&pool.wake);
+    while (job.next < job.count) {
+        pool_run_item(&job);
+    }
+    while (job.done < job.count) { // items other threads started are still running
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+unsigned apint_set_threads(unsigned threads) {
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned i = 0; i < pool.nthreads; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    free(pool.threads);
+    pool.threads = NULL;
+    pool.stop = 0;
+    unsigned started = 0;
+    if (threads > 1) { // the calling thread is the first
+        pool.threads = (pthread_t*)malloc((threads - 1) * sizeof(pthread_t));
+        while (pool.threads != NULL && started < threads - 1
+                && pthread_create(&pool.threads[started], NULL, pool_worker, NULL) == 0) {
+            started++;
+        }
+    }
+    __atomic_store_n(&pool.nthreads, started, __ATOMIC_RELAXED);
+    return started + 1;
+}
+
+unsigned apint_get_threads(void) {
+    return __atomic_load_n(&pool.nthreads, __ATOMIC_RELAXED) + 1;
+}
+
+/*
+ * Multiplication
+ *
+ * The mpn_* helpers work on raw little-endian limb vectors (the same
+ * layout as ApInt::data) and know nothing about signs; apint_mul only
+ * handles the sign and the ApInt bookkeeping around them.
+ */
+
+__extension__ typedef unsigned __int128 u128;
+__extension__ typedef __int128 i128;
+
+// defaults measured with "apintBench tune" (see apintBench.c)
+static size_t tune_params[APINT_TUNE_COUNT] = {
+    [APINT_TUNE_MUL_KARATSUBA] = 52,
+    [APINT_TUNE_MUL_TOOM3] = 160,
+    [APINT_TUNE_MUL_NTT] = 5200,
+    [APINT_TUNE_SQR_KARATSUBA] = 88,
+    [APINT_TUNE_DIV_NEWTON] = 160,
+    [APINT_TUNE_DEC_DC] = 20,
+    [APINT_TUNE_GCD_HGCD] = 600,
+    // "apintBench tune" measures these two with every online CPU, so run it
+    // on the target machine.  The host the defaults were tuned on has one
+    // CPU, where the pool never wins, so these come from its costs instead:
+    // handing a product's pieces to the pool took 5.6 us, 2% of a serial
+    // 1000-limb product (270 us), and additions, being memory bound, split
+    // only once the operands (512 KiB at 65536 limbs) outgrow a core's L2.
+    [APINT_TUNE_PARALLEL] = 1000,
+    [APINT_TUNE_PARALLEL_ADD] = 65536,
+};
+
+// whether an operation on n limbs is worth splitting across the pool
+static int use_parallel(size_t n) {
+    return n >= tune_params[APINT_TUNE_PARALLEL];
+}
+
+size_t apint_tune_get(ApIntTuneParam param) {
+    return tune_params[param];
+}
+
+void apint_tune_set(ApIntTuneParam param, size_t limbs) {
+    tune_params[param] = limbs;
+}
+
+/*
+ * Kernel dispatch
+ *
+ * The limb loops everything else is built on go through this table.  It
+ * starts out with the portable kernels and is switched once, before
+ * main, to the best ones the host CPU supports (see mpn_kernels_init),
+ * unless APINT_FORCE_GENERIC is set in the environment.
+ */
+typedef struct {
+    const char *name;
+    uint64_t (*add_n)(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+    uint64_t (*sub_n)(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+    uint64_t (*mul_1)(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b);
+    uint64_t (*addmul_1)(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b);
+    uint64_t (*submul_1)(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b);
+    uint64_t (*lshift)(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt);
+    uint64_t (*rshift)(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt);
+    int (*hex_decode)(uint64_t *rp, const char *s, size_t n);
+    void (*hex_encode)(char *s, const uint64_t *ap, size_t n);
+    void (*and_n)(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+    void (*ior_n)(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+    void (*xor_n)(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+    void (*com)(uint64_t *rp, const uint64_t *ap, size_t n);
+    size_t (*popcount)(const uint64_t *ap, size_t n);
+} MpnKernels;
+
+static uint64_t mpn_add_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+static uint64_t mpn_sub_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+static uint64_t mpn_mul_1_generic(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b);
+static uint64_t mpn_addmul_1_generic(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b);
+static uint64_t mpn_submul_1_generic(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b);
+static uint64_t mpn_lshift_generic(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt);
+static uint64_t mpn_rshift_generic(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt);
+static int mpn_hex_decode_generic(uint64_t *rp, const char *s, size_t n);
+static void mpn_hex_encode_generic(char *s, const uint64_t *ap, size_t n);
+static void mpn_and_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+static void mpn_ior_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+static void mpn_xor_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+static void mpn_com_generic(uint64_t *rp, const uint64_t *ap, size_t n);
+static size_t mpn_popcount_generic(const uint64_t *ap, size_t n);
+
+static const MpnKernels generic_kernels = {
+    "generic",
+    mpn_add_n_generic,
+    mpn_sub_n_generic,
+    mpn_mul_1_generic,
+    mpn_addmul_1_generic,
+    mpn_submul_1_generic,
+    mpn_lshift_generic,
+    mpn_rshift_generic,
+    mpn_hex_decode_generic,
+    mpn_hex_encode_generic,
+    mpn_and_n_generic,
+    mpn_ior_n_generic,
+    mpn_xor_n_generic,
+    mpn_com_generic,
+    mpn_popcount_generic,
+};
+
+static MpnKernels kernels = generic_kernels;
+
+// r = a + b, returns the carry out
+static inline uint64_t mpn_add_n(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    return kernels.add_n(rp, ap, bp, n);
+}
+
+// r = a - b, returns the borrow out
+static inline uint64_t mpn_sub_n(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    return kernels.sub_n(rp, ap, bp, n);
+}
+
+// r = a * b, returns the high limb
+static inline uint64_t mpn_mul_1(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    return kernels.mul_1(rp, ap, n, b);
+}
+
+// r += a * b, returns the high limb
+static inline uint64_t mpn_addmul_1(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    return kernels.addmul_1(rp, ap, n, b);
+}
+
+// r -= a * b, returns the borrow limb
+static inline uint64_t mpn_submul_1(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    return kernels.submul_1(rp, ap, n, b);
+}
+
+// r = a << cnt for 0 < cnt < 64, returns the bits shifted out; r may equal a or lie above it
+static inline uint64_t mpn_lshift(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt) {
+    return kernels.lshift(rp, ap, n, cnt);
+}
+
+// r = a >> cnt for 0 < cnt < 64, returns the bits shifted out (at the top of the limb); r may equal a or lie below it
+static inline uint64_t mpn_rshift(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt) {
+    return kernels.rshift(rp, ap, n, cnt);
+}
+
+#ifdef APINT_X86_64
+/*
+ * x86-64 carry chains.  The main loops are four limbs per iteration in
+ * inline assembly, since the carry must stay in CF between limbs: gcc
+ * turns _addcarry_u64 loops into setc/add round trips that are slower
+ * than the portable code on long operands.  lea and dec leave CF alone.
+ * The n % 4 limbs left over go through _addcarry_u64/_subborrow_u64.
+ */
+
+static uint64_t mpn_add_n_x86(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    unsigned char carry = 0;
+    size_t blocks = n / 4;
+    if (blocks > 0) {
+        uint64_t t0, t1;
+        __asm__ volatile(
+            "xor %k[t0], %k[t0]\n\t" // clears CF
+            "1:\n\t"
+            "mov (%[a]), %[t0]\n\t"
+            "mov 8(%[a]), %[t1]\n\t"
+            "adc (%[b]), %[t0]\n\t"
+            "adc 8(%[b]), %[t1]\n\t"
+            "mov %[t0], (%[r])\n\t"
+            "mov %[t1], 8(%[r])\n\t"
+            "mov 16(%[a]), %[t0]\n\t"
+            "mov 24(%[a]), %[t1]\n\t"
+            "adc 16(%[b]), %[t0]\n\t"
+            "adc 24(%[b]), %[t1]\n\t"
+            "mov %[t0], 16(%[r])\n\t"
+            "mov %[t1], 24(%[r])\n\t"
+            "lea 32(%[a]), %[a]\n\t"
+            "lea 32(%[b]), %[b]\n\t"
+            "lea 32(%[r]), %[r]\n\t"
+            "dec %[k]\n\t"
+            "jnz 1b\n\t"
+            "setc %[c]\n\t"
+            : [a] "+r" (ap), [b] "+r" (bp), [r] "+r" (rp), [k] "+r" (blocks), [c] "=r" (carry),
+              [t0] "=&r" (t0), [t1] "=&r" (t1)
+            :
+            : "cc", "memory");
+    }
+    for (size_t i = 0; i < n % 4; i++) {
+        unsigned long long s;
+        carry = _addcarry_u64(carry, ap[i], bp[i], &s);
+        rp[i] = s;
+    }
+    return carry;
+}
+
+static uint64_t mpn_sub_n_x86(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    unsigned char borrow = 0;
+    size_t blocks = n / 4;
+    if (blocks > 0) {
+        uint64_t t0, t1;
+        __asm__ volatile(
+            "xor %k[t0], %k[t0]\n\t"
+            "1:\n\t"
+            "mov (%[a]), %[t0]\n\t"
+            "mov 8(%[a]), %[t1]\n\t"
+            "sbb (%[b]), %[t0]\n\t"
+            "sbb 8(%[b]), %[t1]\n\t"
+            "mov %[t0], (%[r])\n\t"
+            "mov %[t1], 8(%[r])\n\t"
+            "mov 16(%[a]), %[t0]\n\t"
+            "mov 24(%[a]), %[t1]\n\t"
+            "sbb 16(%[b]), %[t0]\n\t"
+            "sbb 24(%[b]), %[t1]\n\t"
+            "mov %[t0], 16(%[r])\n\t"
+            "mov %[t1], 24(%[r])\n\t"
+            "lea 32(%[a]), %[a]\n\t"
+            "lea 32(%[b]), %[b]\n\t"
+            "lea 32(%[r]), %[r]\n\t"
+            "dec %[k]\n\t"
+            "jnz 1b\n\t"
+            "setc %[c]\n\t"
+            : [a] "+r" (ap), [b] "+r" (bp), [r] "+r" (rp), [k] "+r" (blocks), [c] "=r" (borrow),
+              [t0] "=&r" (t0), [t1] "=&r" (t1)
+            :
+            : "cc", "memory");
+    }
+    for (size_t i = 0; i < n % 4; i++) {
+        unsigned long long d;
+        borrow = _subborrow_u64(borrow, ap[i], bp[i], &d);
+        rp[i] = d;
+    }
+    return borrow;
+}
+#endif
+
+static uint64_t mpn_add_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t s = ap[i] + carry;
+        uint64_t b = bp[i];
+        carry = s < carry;
+        s += b;
+        carry += s < b;
+        rp[i] = s;
+    }
+    return carry;
+}
+
+static uint64_t mpn_sub_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t a = ap[i];
+        uint64_t b = bp[i] + borrow;
+        borrow = b < borrow;
+        borrow += a < b;
+        rp[i] = a - b;
+    }
+    return borrow;
+}
+
+// r = a + b where b is a single limb: the carry loop stops at the first limb that absorbs it
+static uint64_t mpn_add_1(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    size_t i = 0;
+    for (; i < n && b != 0; i++) {
+        uint64_t s = ap[i] + b;
+        b = s < b;
+        rp[i] = s;
+    }
+    if (rp != ap && i < n) { // in place, the untouched tail is already right
+        memmove(rp + i, ap + i, (n - i) * sizeof(uint64_t));
+    }
+    return b;
+}
+
+// r = a - b where b is a single limb
+static uint64_t mpn_sub_1(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    size_t i = 0;
+    for (; i < n && b != 0; i++) {
+        uint64_t a = ap[i];
+        rp[i] = a - b;
+        b = a < b;
+    }
+    if (rp != ap && i < n) {
+        memmove(rp + i, ap + i, (n - i) * sizeof(uint64_t));
+    }
+    return b;
+}
+
+/*
+ * Long additions and subtractions in parallel: every chunk is added on
+ * its own with no carry in, then a pass over the chunk carries gives
+ * each chunk its carry in, which is added in a second parallel pass.
+ * That can only carry out of a chunk that came to all ones, which is
+ * rare; those carries are passed along afterwards, in order.
+ */
+
+#define ADD_CHUNKS_MAX 64
+
+typedef struct {
+    uint64_t *rp;
+    const uint64_t *ap, *bp;
+    size_t n, chunks;
+    int sub;
+    uint64_t carry[ADD_CHUNKS_MAX];
+} AddJob;
+
+static void add_chunk_range(const AddJob *job, size_t i, size_t *off, size_t *len) {
+    *off = job->n * i / job->chunks;
+    *len = job->n * (i + 1) / job->chunks - *off;
+}
+
+static void add_chunk_task(void *arg, size_t i) {
+    AddJob *job = (AddJob*)arg;
+    size_t off, len;
+    add_chunk_range(job, i, &off, &len);
+    if (job->sub) {
+        job->carry[i] = mpn_sub_n(job->rp + off, job->ap + off, job->bp + off, len);
+    } else {
+        job->carry[i] = mpn_add_n(job->rp + off, job->ap + off, job->bp + off, len);
+    }
+}
+
+static void add_carry_in_task(void *arg, size_t i) { // carry[i] is chunk i's carry in, and becomes its extra carry out
+    AddJob *job = (AddJob*)arg;
+    size_t off, len;
+    add_chunk_range(job, i, &off, &len);
+    if (job->sub) {
+        job->carry[i] = mpn_sub_1(job->rp + off, job->rp + off, len, job->carry[i]);
+    } else {
+        job->carry[i] = mpn_add_1(job->rp + off, job->rp + off, len, job->carry[i]);
+    }
+}
+
+// mpn_add_n or mpn_sub_n (sub set) split across the pool
+static uint64_t mpn_addsub_n_par(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n, int sub) {
+    AddJob job = { rp, ap, bp, n, apint_get_threads(), sub, { 0 } };
+    if (job.chunks > ADD_CHUNKS_MAX) {
+        job.chunks = ADD_CHUNKS_MAX;
+    }
+    pool_run(add_chunk_task, &job, job.chunks, 1);
+    uint64_t out = job.carry[job.chunks - 1];
+    for (size_t i = job.chunks - 1; i > 0; i--) {
+        job.carry[i] = job.carry[i - 1];
+    }
+    job.carry[0] = 0;
+    pool_run(add_carry_in_task, &job, job.chunks, 1);
+    for (size_t i = 0; i + 1 < job.chunks; i++) { // carry[i] is now what chunk i still owes the next
+        if (job.carry[i] != 0) {
+            size_t off, len;
+            add_chunk_range(&job, i + 1, &off, &len);
+            job.carry[i + 1] += sub ? mpn_sub_1(rp + off, rp + off, len, 1) : mpn_add_1(rp + off, rp + off, len, 1);
+        }
+    }
+    return out + job.carry[job.chunks - 1];
+}
+
+static int use_parallel_add(size_t n) {
+    return n >= tune_params[APINT_TUNE_PARALLEL_ADD] && pool_active(); // checked first, the serial path is the common one
+}
+
+// r = a + b, an >= bn, r has an limbs
+static uint64_t mpn_add(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    uint64_t carry = use_parallel_add(bn) ? mpn_addsub_n_par(rp, ap, bp, bn, 0) : mpn_add_n(rp, ap, bp, bn);
+    return mpn_add_1(rp + bn, ap + bn, an - bn, carry);
+}
+
+// r = a - b, an >= bn, r has an limbs
+static uint64_t mpn_sub(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    uint64_t borrow = use_parallel_add(bn) ? mpn_addsub_n_par(rp, ap, bp, bn, 1) : mpn_sub_n(rp, ap, bp, bn);
+    return mpn_sub_1(rp + bn, ap + bn, an - bn, borrow);
+}
+
+static int mpn_cmp(const uint64_t *ap, const uint64_t *bp, size_t n) {
+    while (n-- > 0) {
+        if (ap[n] != bp[n]) {
+            return ap[n] > bp[n] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+// number of limbs once leading zero limbs are dropped (0 for a zero value)
+static size_t mpn_normalized_size(const uint64_t *p, size_t n) {
+    while (n > 0 && p[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+static void mpn_zero(uint64_t *rp, size_t n) {
+    memset(rp, 0, n * sizeof(uint64_t));
+}
+
+static void mpn_copy(uint64_t *rp, const uint64_t *ap, size_t n) {
+    memmove(rp, ap, n * sizeof(uint64_t));
+}
+
+// r = |a - b| with max(an, bn) limbs, an >= bn; returns 1 if a < b
+static int mpn_absdiff(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    int a_less = 0;
+    if (mpn_normalized_size(ap + bn, an - bn) == 0) {
+        a_less = mpn_cmp(ap, bp, bn) < 0;
+    }
+    if (a_less) {
+        mpn_sub_n(rp, bp, ap, bn);
+        mpn_zero(rp + bn, an - bn);
+    } else {
+        mpn_sub(rp, ap, an, bp, bn);
+    }
+    return a_less;
+}
+
+static uint64_t mpn_lshift_generic(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt) {
+    uint64_t high = ap[n - 1];
+    uint64_t out = high >> (64 - cnt);
+    for (size_t i = n - 1; i > 0; i--) {
+        uint64_t low = ap[i - 1];
+        rp[i] = (high << cnt) | (low >> (64 - cnt));
+        high = low;
+    }
+    rp[0] = high << cnt;
+    return out;
+}
+
+static uint64_t mpn_mul_1_generic(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        u128 t = (u128)ap[i] * b + carry;
+        rp[i] = (uint64_t)t;
+        carry = (uint64_t)(t >> 64);
+    }
+    return carry;
+}
+
+// r += a * b + carry, returns the high limb
+static uint64_t mpn_addmul_1_c(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b, uint64_t carry) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) { // unrolled, this loop is where schoolbook spends its time
+        u128 t0 = (u128)ap[i] * b + rp[i] + carry;
+        rp[i] = (uint64_t)t0;
+        u128 t1 = (u128)ap[i + 1] * b + rp[i + 1] + (uint64_t)(t0 >> 64);
+        rp[i + 1] = (uint64_t)t1;
+        u128 t2 = (u128)ap[i + 2] * b + rp[i + 2] + (uint64_t)(t1 >> 64);
+        rp[i + 2] = (uint64_t)t2;
+        u128 t3 = (u128)ap[i + 3] * b + rp[i + 3] + (uint64_t)(t2 >> 64);
+        rp[i + 3] = (uint64_t)t3;
+        carry = (uint64_t)(t3 >> 64);
+    }
+    for (; i < n; i++) {
+        u128 t = (u128)ap[i] * b + rp[i] + carry;
+        rp[i] = (uint64_t)t;
+        carry = (uint64_t)(t >> 64);
+    }
+    return carry;
+}
+
+#ifdef APINT_X86_64
+/*
+ * BMI2/ADX version: mulx leaves the flags alone, so adding the previous
+ * high limb (adox, carry in OF) and the old r limb (adcx, carry in CF)
+ * run as two independent carry chains.  The loop counts a negative index
+ * up to zero with lea and jrcxz, neither of which touches the flags.
+ */
+__attribute__((target("bmi2,adx")))
+static uint64_t mpn_addmul_1_adx(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    uint64_t carry = 0;
+    size_t blocks = n / 4;
+    if (blocks > 0) {
+        const uint64_t *ae = ap + 4 * blocks;
+        uint64_t *re = rp + 4 * blocks;
+        intptr_t idx = -(intptr_t)(4 * blocks);
+        uint64_t lo0, hi0, lo1, hi1, zero;
+        __asm__ volatile(
+            "xor %k[z], %k[z]\n\t" // clears CF and OF
+            "1:\n\t"
+            "mulx (%[ae],%[i],8), %[lo0], %[hi0]\n\t"
+            "adox %[cy], %[lo0]\n\t"
+            "adcx (%[re],%[i],8), %[lo0]\n\t"
+            "mov %[lo0], (%[re],%[i],8)\n\t"
+            "mulx 8(%[ae],%[i],8), %[lo1], %[hi1]\n\t"
+            "adox %[hi0], %[lo1]\n\t"
+            "adcx 8(%[re],%[i],8), %[lo1]\n\t"
+            "mov %[lo1], 8(%[re],%[i],8)\n\t"
+            "mulx 16(%[ae],%[i],8), %[lo0], %[hi0]\n\t"
+            "adox %[hi1], %[lo0]\n\t"
+            "adcx 16(%[re],%[i],8), %[lo0]\n\t"
+            "mov %[lo0], 16(%[re],%[i],8)\n\t"
+            "mulx 24(%[ae],%[i],8), %[lo1], %[cy]\n\t"
+            "adox %[hi0], %[lo1]\n\t"
+            "adcx 24(%[re],%[i],8), %[lo1]\n\t"
+            "mov %[lo1], 24(%[re],%[i],8)\n\t"
+            "lea 4(%[i]), %[i]\n\t"
+            "jrcxz 2f\n\t"
+            "jmp 1b\n\t"
+            "2:\n\t"
+            "adox %[z], %[cy]\n\t" // the high limb cannot overflow from the two carries
+            "adcx %[z], %[cy]\n\t"
+            : [cy] "+&r" (carry), [i] "+&c" (idx), [lo0] "=&r" (lo0), [hi0] "=&r" (hi0),
+              [lo1] "=&r" (lo1), [hi1] "=&r" (hi1), [z] "=&r" (zero)
+            : [ae] "r" (ae), [re] "r" (re), "d" (b)
+            : "cc", "memory");
+        ap = ae;
+        rp = re;
+    }
+    return mpn_addmul_1_c(rp, ap, n % 4, b, carry);
+}
+#endif
+
+static uint64_t mpn_addmul_1_generic(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    return mpn_addmul_1_c(rp, ap, n, b, 0);
+}
+
+// schoolbook r = a * b, r has an + bn limbs and must not overlap a or b
+static void mpn_mul_basecase(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    rp[an] = mpn_mul_1(rp, ap, an, bp[0]);
+    for (size_t j = 1; j < bn; j++) {
+        rp[an + j] = mpn_addmul_1(rp + j, ap, an, bp[j]);
+    }
+}
+
+/*
+ * Schoolbook squaring: each cross product a_i a_j (i < j) is formed once
+ * into the triangle above the diagonal, then one pass doubles the
+ * triangle and adds the squares a_i^2 on the diagonal: about half the
+ * single-limb products of mpn_mul_basecase.  r has 2n limbs and must not
+ * overlap a.
+ */
+static void mpn_sqr_basecase(uint64_t *rp, const uint64_t *ap, size_t n) {
+    if (n == 1) {
+        u128 t = (u128)ap[0] * ap[0];
+        rp[0] = (uint64_t)t;
+        rp[1] = (uint64_t)(t >> 64);
+        return;
+    }
+    if (n < 10) { // rows this short cost more in kernel calls than the halved products save
+        mpn_mul_basecase(rp, ap, n, ap, n);
+        return;
+    }
+    rp[0] = 0;
+    rp[n] = mpn_mul_1(rp + 1, ap + 1, n - 1, ap[0]);
+    for (size_t i = 1; i + 1 < n; i++) { // row i starts at limb 2i + 1 and carries out at n + i
+        rp[n + i] = mpn_addmul_1(rp + 2 * i + 1, ap + i + 1, n - i - 1, ap[i]);
+    }
+    rp[2 * n - 1] = 0;
+    uint64_t carry = 0, out = 0; // out is the bit the doubling shifts into the next limb
+    for (size_t i = 0; i < n; i++) {
+        uint64_t lo = rp[2 * i], hi = rp[2 * i + 1];
+        u128 sq = (u128)ap[i] * ap[i];
+        u128 s = (u128)(lo << 1 | out) + (uint64_t)sq + carry;
+        rp[2 * i] = (uint64_t)s;
+        s = (u128)(hi << 1 | lo >> 63) + (uint64_t)(sq >> 64) + (uint64_t)(s >> 64);
+        rp[2 * i + 1] = (uint64_t)s;
+        carry = (uint64_t)(s >> 64);
+        out = hi >> 63;
+    }
+}
+
+static void mpn_mul_n_tp(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n, uint64_t *tp);
+static void mpn_toom3_mul_n(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+static void mpn_mul_n(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n);
+static void mpn_mul_ntt(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn);
+
+// one balanced product, for running several in parallel
+typedef struct {
+    uint64_t *rp;
+    const uint64_t *ap, *bp;
+    size_t n;
+} MulTask;
+
+static void mul_task(void *arg, size_t i) {
+    const MulTask *t = (const MulTask*)arg + i;
+    mpn_mul_n(t->rp, t->ap, t->bp, t->n);
+}
+
+static int use_karatsuba(size_t n) {
+    return n >= tune_params[APINT_TUNE_MUL_KARATSUBA] && n >= 4;
+}
+
+static int use_sqr_karatsuba(size_t n) {
+    return n >= tune_params[APINT_TUNE_SQR_KARATSUBA] && n >= 4;
+}
+
+static int use_toom3(size_t n) {
+    return n >= tune_params[APINT_TUNE_MUL_TOOM3] && n >= 16; // smaller sizes leave an empty top piece
+}
+
+static int use_ntt(size_t n) {
+    return n >= tune_params[APINT_TUNE_MUL_NTT];
+}
+
+// scratch limbs needed by mpn_kara_mul_n for size n
+static size_t kara_scratch_size(size_t n) {
+    size_t size = 0;
+    while (n >= 4) {
+        size_t h = n - n / 2;
+        size += 6 * h + 1;
+        n = h;
+    }
+    return size;
+}
+
+/*
+ * Karatsuba, subtractive variant: with a = a1*B^l + a0 and b likewise,
+ * a*b = z2*B^2l + (z0 + z2 - (a1 - a0)(b1 - b0))*B^l + z0.
+ */
+static void mpn_kara_mul_n(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n, uint64_t *tp) {
+    size_t l = n / 2, h = n - l;
+    uint64_t *da = tp, *db = tp + h, *zm = tp + 2 * h, *t = tp + 4 * h, *child = tp + 6 * h + 1;
+
+    int sign = mpn_absdiff(da, ap + l, h, ap, l);
+    sign ^= mpn_absdiff(db, bp + l, h, bp, l);
+
+    if (use_parallel(n)) { // mpn_mul_n brings its own scratch for each
+        MulTask products[3] = { { rp, ap, bp, l }, { rp + 2 * l, ap + l, bp + l, h }, { zm, da, db, h } };
+        pool_run(mul_task, products, 3, 1);
+    } else {
+        mpn_mul_n_tp(rp, ap, bp, l, child);                 // z0
+        mpn_mul_n_tp(rp + 2 * l, ap + l, bp + l, h, child); // z2
+        mpn_mul_n_tp(zm, da, db, h, child);
+    }
+
+    t[2 * h] = mpn_add(t, rp + 2 * l, 2 * h, rp, 2 * l);
+    if (sign == 0) { // (a1 - a0)(b1 - b0) >= 0
+        t[2 * h] -= mpn_sub_n(t, t, zm, 2 * h);
+    } else {
+        t[2 * h] += mpn_add_n(t, t, zm, 2 * h);
+    }
+    mpn_add(rp + l, rp + l, 2 * n - l, t, 2 * h + 1);
+}
+
+/*
+ * Karatsuba squaring: a^2 = z2*B^2l + (z0 + z2 - (a1 - a0)^2)*B^l + z0,
+ * three half-size squares and a middle term that is never negative.
+ * Takes the same scratch as mpn_kara_mul_n.
+ */
+static void mpn_kara_sqr_n(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t *tp) {
+    size_t l = n / 2, h = n - l;
+    uint64_t *da = tp, *zm = tp + 2 * h, *t = tp + 4 * h, *child = tp + 6 * h + 1;
+
+    mpn_absdiff(da, ap + l, h, ap, l);
+
+    if (use_parallel(n)) { // equal operands make mpn_mul_n square
+        MulTask products[3] = { { rp, ap, ap, l }, { rp + 2 * l, ap + l, ap + l, h }, { zm, da, da, h } };
+        pool_run(mul_task, products, 3, 1);
+    } else {
+        mpn_mul_n_tp(rp, ap, ap, l, child);                 // z0
+        mpn_mul_n_tp(rp + 2 * l, ap + l, ap + l, h, child); // z2
+        mpn_mul_n_tp(zm, da, da, h, child);
+    }
+
+    t[2 * h] = mpn_add(t, rp + 2 * l, 2 * h, rp, 2 * l);
+    t[2 * h] -= mpn_sub_n(t, t, zm, 2 * h);
+    mpn_add(rp + l, rp + l, 2 * n - l, t, 2 * h + 1);
+}
+
+// exact division by 3 modulo B^n (works on two's complement values too)
+static void mpn_divexact_by3(uint64_t *rp, const uint64_t *ap, size_t n) {
+    const uint64_t inv3 = 0xAAAAAAAAAAAAAAABUL; // 3 * inv3 == 1 mod 2^64
+    uint64_t c = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t a = ap[i];
+        uint64_t s = a - c;
+        uint64_t borrow = a < c;
+        uint64_t q = s * inv3;
+        rp[i] = q;
+        c = (uint64_t)(((u128)q * 3) >> 64) + borrow;
+    }
+}
+
+// arithmetic (sign-preserving) shift right by one of an n-limb two's complement value
+static void mpn_rshift1_signed(uint64_t *rp, const uint64_t *ap, size_t n) {
+    for (size_t i = 0; i + 1 < n; i++) {
+        rp[i] = (ap[i] >> 1) | (ap[i + 1] << 63);
+    }
+    rp[n - 1] = (uint64_t)((int64_t)ap[n - 1] >> 1);
+}
+
+static void mpn_neg(uint64_t *rp, const uint64_t *ap, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        rp[i] = ~ap[i];
+    }
+    mpn_add_1(rp, rp, n, 1);
+}
+
+// rp[0..rn) += ap[0..an), dropping whatever would carry past rn limbs
+static void mpn_accumulate(uint64_t *rp, size_t rn, const uint64_t *ap, size_t an) {
+    if (an > rn) {
+        an = rn;
+    }
+    mpn_add(rp, rp, rn, ap, an);
+}
+
+/*
+ * Toom-3: split both operands in three pieces of k limbs, evaluate at
+ * 0, 1, -1, 2 and infinity, multiply pointwise and interpolate (the
+ * sequence is Bodrato's).  Intermediate values can go negative, so the
+ * interpolation runs on L-limb two's complement numbers; every final
+ * coefficient is a sum of products of non-negative pieces and fits.
+ * When a and b are the same limbs only a is evaluated, and the five
+ * products are squares.
+ */
+static void mpn_toom3_mul_n(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    size_t k = (n + 2) / 3, s = n - 2 * k, L = 2 * k + 2;
+    const uint64_t *a0 = ap, *a1 = ap + k, *a2 = ap + 2 * k;
+    const uint64_t *b0 = bp, *b1 = bp + k, *b2 = bp + 2 * k;
+
+    size_t bufn = 6 * (k + 1) + 3 * L;
+    uint64_t *buf = limbs_alloc(bufn);
+    uint64_t *e1a = buf, *e1b = e1a + k + 1, *em1a = e1b + k + 1, *em1b = em1a + k + 1;
+    uint64_t *e2a = em1b + k + 1, *e2b = e2a + k + 1;
+    uint64_t *v1 = e2b + k + 1, *vm1 = v1 + L, *v2 = vm1 + L;
+
+    // evaluate a(1), |a(-1)| and a(2) = a0 + 2(a1 + 2 a2), then the same for b
+    e1a[k] = mpn_add(e1a, a0, k, a2, s);
+    int neg = mpn_absdiff(em1a, e1a, k + 1, a1, k);
+    e1a[k] += mpn_add_n(e1a, e1a, a1, k);
+    mpn_copy(e2a, a2, s);
+    mpn_zero(e2a + s, k + 1 - s);
+    mpn_lshift(e2a, e2a, k + 1, 1);
+    mpn_add(e2a, e2a, k + 1, a1, k);
+    mpn_lshift(e2a, e2a, k + 1, 1);
+    mpn_add(e2a, e2a, k + 1, a0, k);
+
+    if (ap == bp) { // a(-1)^2 is never negative
+        e1b = e1a;
+        em1b = em1a;
+        e2b = e2a;
+        neg = 0;
+    } else {
+        e1b[k] = mpn_add(e1b, b0, k, b2, s);
+        neg ^= mpn_absdiff(em1b, e1b, k + 1, b1, k);
+        e1b[k] += mpn_add_n(e1b, e1b, b1, k);
+        mpn_copy(e2b, b2, s);
+        mpn_zero(e2b + s, k + 1 - s);
+        mpn_lshift(e2b, e2b, k + 1, 1);
+        mpn_add(e2b, e2b, k + 1, b1, k);
+        mpn_lshift(e2b, e2b, k + 1, 1);
+        mpn_add(e2b, e2b, k + 1, b0, k);
+    }
+
+    // pointwise products; v0 and vinf land straight in their final place
+    MulTask products[5] = {
+        { rp, a0, b0, k }, { rp + 4 * k, a2, b2, s },
+        { v1, e1a, e1b, k + 1 }, { vm1, em1a, em1b, k + 1 }, { v2, e2a, e2b, k + 1 },
+    };
+    mpn_zero(rp + 2 * k, 2 * k);
+    pool_run(mul_task, products, 5, use_parallel(n));
+    if (neg) {
+        mpn_neg(vm1, vm1, L);
+    }
+
+    const uint64_t *v0 = rp, *vinf = rp + 4 * k;
+    uint64_t *r1 = v1, *r2 = em1a, *r3 = v2; // em1a.. is free again and has room for L limbs
+    mpn_sub_n(r3, v2, vm1, L);              // r3 = (v2 - vm1) / 3
+    mpn_divexact_by3(r3, r3, L);
+    mpn_sub_n(r1, v1, vm1, L);              // r1 = (v1 - vm1) / 2
+    mpn_rshift1_signed(r1, r1, L);
+    mpn_sub(r2, vm1, L, v0, 2 * k);         // r2 = vm1 - v0
+    mpn_sub_n(r3, r3, r2, L);               // r3 = (r3 - r2) / 2 - 2 vinf
+    mpn_rshift1_signed(r3, r3, L);
+    mpn_sub(r3, r3, L, vinf, 2 * s);
+    mpn_sub(r3, r3, L, vinf, 2 * s);
+    mpn_add_n(r2, r2, r1, L);               // r2 = r2 + r1 - vinf
+    mpn_sub(r2, r2, L, vinf, 2 * s);
+    mpn_sub_n(r3, r3, r1, L);               // r3 = r3 - r1
+    mpn_sub_n(r1, r1, r3, L);               // r1 = r1 - r3
+
+    mpn_accumulate(rp + k, 2 * n - k, r1, L);
+    mpn_accumulate(rp + 2 * k, 2 * n - 2 * k, r2, L);
+    mpn_accumulate(rp + 3 * k, 2 * n - 3 * k, r3, L);
+    limbs_free(buf, bufn);
+}
+
+/*
+ * NTT multiplication
+ *
+ * The limbs are used directly as convolution coefficients.  A coefficient
+ * of the product is below n * 2^128, so it is computed modulo three primes
+ * p = c * 2^40 + 1 < 2^62 (product about 2^186) and rebuilt with Garner's
+ * CRT.  Residues are kept in Montgomery form (R = 2^64) throughout.
+ */
+
+typedef struct {
+    uint64_t p;    // the prime
+    uint64_t g;    // a primitive root mod p
+    uint64_t pinv; // -p^-1 mod 2^64
+    uint64_t r2;   // R^2 mod p
+} NttPrime;
+
+static const uint64_t ntt_primes[3][2] = {
+    { 0x3fffc00000000001UL, 11 },
+    { 0x3fffbe0000000001UL, 3 },
+    { 0x3fff840000000001UL, 19 },
+};
+
+static inline uint64_t ntt_redc(const NttPrime *m, u128 t) {
+    uint64_t q = (uint64_t)t * m->pinv;
+    uint64_t r = (uint64_t)((t + (u128)q * m->p) >> 64);
+    return r >= m->p ? r - m->p : r;
+}
+
+// a * b * R^-1 mod p, for a < 2^64 and b < p
+static inline uint64_t ntt_mul(const NttPrime *m, uint64_t a, uint64_t b) {
+    return ntt_redc(m, (u128)a * b);
+}
+
+static inline uint64_t ntt_add(const NttPrime *m, uint64_t a, uint64_t b) {
+    uint64_t r = a + b;
+    return r >= m->p ? r - m->p : r;
+}
+
+static inline uint64_t ntt_sub(const NttPrime *m, uint64_t a, uint64_t b) {
+    return a >= b ? a - b : a + m->p - b;
+}
+
+static uint64_t ntt_pow(const NttPrime *m, uint64_t base, uint64_t e) { // Montgomery in and out
+    uint64_t r = ntt_mul(m, 1, m->r2);
+    while (e > 0) {
+        if (e & 1) {
+            r = ntt_mul(m, r, base);
+        }
+        base = ntt_mul(m, base, base);
+        e >>= 1;
+    }
+    return r;
+}
+
+static void ntt_prime_init(NttPrime *m, int i) {
+    m->p = ntt_primes[i][0];
+    m->g = ntt_primes[i][1];
+    uint64_t inv = m->p; // Newton's iteration for p^-1 mod 2^64, 3 -> 6 -> ... -> 96 bits
+    for (int k = 0; k < 5; k++) {
+        inv *= 2 - m->p * inv;
+    }
+    m->pinv = -inv;
+    uint64_t r = (uint64_t)(((u128)1 << 64) % m->p);
+    m->r2 = (uint64_t)((u128)r * r % m->p);
+}
+
+/*
+ * Twiddle tables in level order: tbl[len + j] = w_{2 len}^j for every
+ * power of two len < N, so each butterfly level reads a contiguous run.
+ */
+static void ntt_roots(const NttPrime *m, uint64_t *tbl, size_t N, int inverse) {
+    uint64_t w = ntt_pow(m, ntt_mul(m, m->g, m->r2), (m->p - 1) / N);
+    if (inverse) {
+        w = ntt_pow(m, w, m->p - 2);
+    }
+    size_t half = N / 2;
+    uint64_t x = ntt_mul(m, 1, m->r2);
+    for (size_t j = 0; j < half; j++) {
+        tbl[half + j] = x;
+        x = ntt_mul(m, x, w);
+    }
+    for (size_t len = half / 2; len >= 1; len /= 2) {
+        for (size_t j = 0; j < len; j++) {
+            tbl[len + j] = tbl[2 * len + 2 * j];
+        }
+    }
+}
+
+/*
+ * The butterflies reduce lazily (Harvey): values stay in [0, 2p), which
+ * p < 2^62 allows, and every conditional subtraction is a select rather
+ * than a branch on data.
+ */
+static inline uint64_t ntt_redc_lazy(u128 t, uint64_t p, uint64_t pinv) { // t < p * 2^64, result < 2p
+    uint64_t q = (uint64_t)t * pinv;
+    return (uint64_t)((t + (u128)q * p) >> 64);
+}
+
+// decimation in frequency: natural order in, bit-reversed order out
+static void ntt_forward(const NttPrime *m, uint64_t *a, size_t N, const uint64_t *tbl) {
+    const uint64_t p = m->p, p2 = 2 * m->p, pinv = m->pinv;
+    for (size_t len = N / 2; len >= 1; len /= 2) {
+        for (size_t i = 0; i < N; i += 2 * len) {
+            uint64_t *x = a + i, *y = a + i + len;
+            const uint64_t *w = tbl + len;
+            for (size_t j = 0; j < len; j++) {
+                uint64_t u = x[j], v = y[j];
+                uint64_t s = u + v;
+                x[j] = s >= p2 ? s - p2 : s;
+                y[j] = ntt_redc_lazy((u128)(u - v + p2) * w[j], p, pinv);
+            }
+        }
+    }
+}
+
+// decimation in time with inverse roots: bit-reversed order in, natural order out (unscaled)
+static void ntt_inverse(const NttPrime *m, uint64_t *a, size_t N, const uint64_t *tbl) {
+    const uint64_t p = m->p, p2 = 2 * m->p, pinv = m->pinv;
+    for (size_t len = 1; len < N; len *= 2) {
+        for (size_t i = 0; i < N; i += 2 * len) {
+            uint64_t *x = a + i, *y = a + i + len;
+            const uint64_t *w = tbl + len;
+            for (size_t j = 0; j < len; j++) {
+                uint64_t u = x[j], v = ntt_redc_lazy((u128)y[j] * w[j], p, pinv);
+                uint64_t s = u + v, d = u - v + p2;
+                x[j] = s >= p2 ? s - p2 : s;
+                y[j] = d >= p2 ? d - p2 : d;
+            }
+        }
+    }
+}
+
+/*
+ * res[k] = (a conv b)[k] mod p in normal form, using fa and tbl as
+ * scratch (N limbs each).  A square (b the same limbs as a) takes one
+ * forward transform rather than two.
+ */
+static void ntt_convolve(const NttPrime *m, uint64_t *res, uint64_t *fa, uint64_t *tbl, size_t N,
+        const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    int sqr = ap == bp && an == bn;
+    for (size_t i = 0; i < an; i++) {
+        fa[i] = ntt_mul(m, ap[i], m->r2);
+    }
+    mpn_zero(fa + an, N - an);
+    if (!sqr) {
+        for (size_t i = 0; i < bn; i++) {
+            res[i] = ntt_mul(m, bp[i], m->r2);
+        }
+        mpn_zero(res + bn, N - bn);
+    }
+
+    ntt_roots(m, tbl, N, 0);
+    ntt_forward(m, fa, N, tbl);
+    if (sqr) {
+        for (size_t i = 0; i < N; i++) {
+            res[i] = ntt_mul(m, fa[i], fa[i]);
+        }
+    } else {
+        ntt_forward(m, res, N, tbl);
+        for (size_t i = 0; i < N; i++) {
+            res[i] = ntt_mul(m, res[i], fa[i]);
+        }
+    }
+    ntt_roots(m, tbl, N, 1);
+    ntt_inverse(m, res, N, tbl);
+
+    // scaling by N^-1 (normal form) also takes the values out of Montgomery form
+    uint64_t n_inv = ntt_redc(m, ntt_pow(m, ntt_mul(m, N % m->p, m->r2), m->p - 2));
+    for (size_t i = 0; i < N; i++) {
+        res[i] = ntt_mul(m, res[i], n_inv);
+    }
+}
+
+// one prime's convolution, for running the three in parallel
+typedef struct {
+    NttPrime m;
+    uint64_t *res, *fa, *tbl;
+    size_t N, an, bn;
+    const uint64_t *ap, *bp;
+} NttTask;
+
+static void ntt_task(void *arg, size_t i) {
+    NttTask *t = (NttTask*)arg + i;
+    ntt_convolve(&t->m, t->res, t->fa, t->tbl, t->N, t->ap, t->an, t->bp, t->bn);
+}
+
+/*
+ * The cyclic convolution of a and b of length N (a power of two, at
+ * least an and bn), carried into rn limbs of r; the two limbs of carry
+ * left over go to carry.  With N >= an + bn - 1 and rn = an + bn that is
+ * the product, and with rn = N it is the product mod B^N - 1 once the
+ * carry wraps around.
+ */
+static void mpn_mul_ntt_cyclic(uint64_t *rp, size_t rn, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn,
+        size_t N, uint64_t *carry) {
+    int parallel = use_parallel(bn);
+    size_t bufn = parallel ? 9 * N : 5 * N; // in parallel every prime needs its own scratch
+    uint64_t *buf = limbs_alloc(bufn);
+    NttTask tasks[3];
+    for (int i = 0; i < 3; i++) {
+        ntt_prime_init(&tasks[i].m, i);
+        tasks[i].res = buf + i * N;
+        tasks[i].fa = buf + (parallel ? 3 + 2 * i : 3) * N;
+        tasks[i].tbl = tasks[i].fa + N;
+        tasks[i].N = N;
+        tasks[i].ap = ap;
+        tasks[i].an = an;
+        tasks[i].bp = bp;
+        tasks[i].bn = bn;
+    }
+    pool_run(ntt_task, tasks, 3, parallel);
+    const NttPrime m[3] = { tasks[0].m, tasks[1].m, tasks[2].m };
+    const uint64_t *res[3] = { tasks[0].res, tasks[1].res, tasks[2].res };
+
+    // Garner: x = x1 + x2 p1 + x3 p1 p2 with x2 < p2, x3 < p3
+    uint64_t p1 = m[0].p, p2 = m[1].p, p3 = m[2].p;
+    u128 p12 = (u128)p1 * p2;
+    uint64_t p12_lo = (uint64_t)p12, p12_hi = (uint64_t)(p12 >> 64);
+    // constants c are stored as c * R so that ntt_mul(x, c) yields x * c in normal form
+    uint64_t c12 = ntt_pow(&m[1], ntt_mul(&m[1], p1 % p2, m[1].r2), p2 - 2);
+    uint64_t p12_mod3 = (uint64_t)(p12 % p3);
+    uint64_t c123 = ntt_pow(&m[2], ntt_mul(&m[2], p12_mod3, m[2].r2), p3 - 2);
+    uint64_t p1r3 = ntt_mul(&m[2], p1 % p3, m[2].r2);
+
+    uint64_t c0 = 0, c1 = 0, c2 = 0; // running carry, three limbs
+    for (size_t k = 0; k < rn; k++) {
+        if (k < N) {
+            uint64_t x1 = res[0][k];
+            uint64_t x2 = ntt_mul(&m[1], ntt_sub(&m[1], res[1][k], x1 % p2), c12);
+            uint64_t t = ntt_sub(&m[2], res[2][k], x1 % p3);
+            t = ntt_sub(&m[2], t, ntt_mul(&m[2], x2, p1r3));
+            uint64_t x3 = ntt_mul(&m[2], t, c123);
+
+            u128 lo = (u128)x2 * p1 + x1;        // below 2^124
+            u128 mid = (u128)x3 * p12_lo;
+            u128 hi = (u128)x3 * p12_hi;         // below 2^124 as well
+            u128 s = (u128)c0 + (uint64_t)lo + (uint64_t)mid;
+            c0 = (uint64_t)s;
+            s = (s >> 64) + c1 + (uint64_t)(lo >> 64) + (uint64_t)(mid >> 64) + (uint64_t)hi;
+            c1 = (uint64_t)s;
+            c2 += (uint64_t)(s >> 64) + (uint64_t)(hi >> 64);
+        }
+        rp[k] = c0;
+        c0 = c1;
+        c1 = c2;
+        c2 = 0;
+    }
+    carry[0] = c0;
+    carry[1] = c1;
+    limbs_free(buf, bufn);
+}
+
+/*
+ * Values mod B^n - 1 (wraparound products) come back whole when the
+ * value's low BNM1_LOW limbs are known as well, which lets a product
+ * that runs a few limbs past a power of two use the transform below it.
+ */
+#define BNM1_LOW 4
+
+// r = a mod (B^n - 1), n limbs, for any an; B^n - 1 may stand for zero
+static void mpn_bnm1_fold(uint64_t *rp, size_t n, const uint64_t *ap, size_t an) {
+    size_t m = an < n ? an : n;
+    mpn_copy(rp, ap, m);
+    mpn_zero(rp + m, n - m);
+    uint64_t c = 0;
+    for (size_t i = n; i < an; i += n) {
+        c += mpn_add(rp, rp, n, ap + i, an - i < n ? an - i : n);
+    }
+    while (c != 0) { // B^n = 1 mod B^n - 1
+        c = mpn_add_1(rp, rp, n, c);
+    }
+}
+
+// r = a * b mod B^c, c limbs, schoolbook
+static void mpn_mullo_basecase(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn, size_t c) {
+    mpn_zero(rp, c);
+    for (size_t i = 0; i < bn && i < c; i++) {
+        size_t m = an < c - i ? an : c - i;
+        uint64_t carry = mpn_addmul_1(rp + i, ap, m, bp[i]);
+        if (i + m < c) {
+            mpn_add_1(rp + i + m, rp + i + m, c - i - m, carry);
+        }
+    }
+}
+
+/*
+ * v from t = v mod (B^n - 1), n >= c limbs, and v0 = v mod B^c, for v in
+ * [0, B^c (B^n - 1)): v = t + j (B^n - 1) with j = t - v0 mod B^c.
+ * Writes n + c limbs to v, which may be t.
+ */
+static void mpn_bnm1_recover(uint64_t *vp, const uint64_t *tp, size_t n, const uint64_t *v0, size_t c) {
+    size_t i = 0;
+    while (i < n && tp[i] == ~(uint64_t)0) {
+        i++;
+    }
+    if (i == n) { // B^n - 1 is zero
+        mpn_zero(vp, n);
+    } else if (vp != tp) {
+        mpn_copy(vp, tp, n);
+    }
+    uint64_t j[BNM1_LOW];
+    mpn_sub_n(j, vp, v0, c);
+    mpn_sub_1(vp + n, j, c, mpn_sub(vp, vp, n, j, c));
+}
+
+// r = a * b with an + bn limbs, an >= bn
+static void mpn_mul_ntt(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    size_t N = 1;
+    while (N < an + bn - 1) {
+        N *= 2;
+    }
+    if (N < 2) {
+        N = 2;
+    }
+    uint64_t carry[2];
+    if (N < 2 * BNM1_LOW || an + bn >= N / 2 + BNM1_LOW) {
+        mpn_mul_ntt_cyclic(rp, an + bn, ap, an, bp, bn, N, carry); // the carry is zero, as the product fits
+        return;
+    }
+
+    // just past N/2 limbs: the product mod B^(N/2) - 1 and its low limbs
+    size_t n = N / 2, fn = an > n ? n : 0;
+    uint64_t *buf = limbs_alloc(n + BNM1_LOW + fn);
+    uint64_t *t = buf, *fa = t + n + BNM1_LOW;
+    if (fn > 0) {
+        mpn_bnm1_fold(fa, n, ap, an);
+    }
+    mpn_mul_ntt_cyclic(t, n, fn > 0 ? fa : ap, fn > 0 ? n : an, bp, bn, n, carry);
+    uint64_t c = mpn_add(t, t, n, carry, 2);
+    while (c != 0) {
+        c = mpn_add_1(t, t, n, c);
+    }
+    uint64_t lo[BNM1_LOW];
+    mpn_mullo_basecase(lo, ap, an, bp, bn, BNM1_LOW);
+    mpn_bnm1_recover(t, t, n, lo, BNM1_LOW);
+    mpn_copy(rp, t, an + bn);
+    limbs_free(buf, n + BNM1_LOW + fn);
+}
+
+/*
+ * r = a^2, picking the algorithm as mpn_mul_n_tp does, but with the
+ * squaring kernels and their own schoolbook/Karatsuba cut-over; Toom-3
+ * and the NTT see the shared operand and skip its second evaluation.
+ */
+static void mpn_sqr_n_tp(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t *tp) {
+    if (!use_sqr_karatsuba(n)) {
+        STAT_ALGO(APINT_ALGO_MUL_BASECASE);
+        mpn_sqr_basecase(rp, ap, n);
+    } else if (!use_toom3(n)) {
+        STAT_ALGO(APINT_ALGO_MUL_KARATSUBA);
+        mpn_kara_sqr_n(rp, ap, n, tp);
+    } else if (!use_ntt(n)) {
+        STAT_ALGO(APINT_ALGO_MUL_TOOM3);
+        mpn_toom3_mul_n(rp, ap, ap, n);
+    } else {
+        STAT_ALGO(APINT_ALGO_MUL_NTT);
+        mpn_mul_ntt(rp, ap, n, ap, n);
+    }
+}
+
+/*
+ * balanced r = a * b with scratch for Karatsuba already provided; a and b
+ * being the same limbs makes it a square
+ */
+static void mpn_mul_n_tp(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n, uint64_t *tp) {
+    if (ap == bp) {
+        mpn_sqr_n_tp(rp, ap, n, tp);
+    } else if (!use_karatsuba(n)) {
+        STAT_ALGO(APINT_ALGO_MUL_BASECASE);
+        mpn_mul_basecase(rp, ap, n, bp, n);
+    } else if (!use_toom3(n)) {
+        STAT_ALGO(APINT_ALGO_MUL_KARATSUBA);
+        mpn_kara_mul_n(rp, ap, bp, n, tp);
+    } else if (!use_ntt(n)) {
+        STAT_ALGO(APINT_ALGO_MUL_TOOM3);
+        mpn_toom3_mul_n(rp, ap, bp, n);
+    } else {
+        STAT_ALGO(APINT_ALGO_MUL_NTT);
+        mpn_mul_ntt(rp, ap, n, bp, n);
+    }
+}
+
+// balanced r = a * b, r has 2n limbs and must not overlap a or b
+static void mpn_mul_n(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    if ((ap == bp ? use_sqr_karatsuba(n) : use_karatsuba(n)) && !use_toom3(n)) {
+        uint64_t *tp = limbs_alloc(kara_scratch_size(n));
+        mpn_mul_n_tp(rp, ap, bp, n, tp);
+        limbs_free(tp, kara_scratch_size(n));
+    } else {
+        mpn_mul_n_tp(rp, ap, bp, n, NULL);
+    }
+}
+
+// r = a * b for an >= bn >= 1, r has an + bn limbs and must not overlap a or b
+static void mpn_mul(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    if (an == bn) {
+        mpn_mul_n(rp, ap, bp, an);
+    } else if (use_ntt(bn)) { // the transform handles unbalanced sizes directly
+        STAT_ALGO(APINT_ALGO_MUL_NTT);
+        mpn_mul_ntt(rp, ap, an, bp, bn);
+    } else if (!use_karatsuba(bn)) {
+        STAT_ALGO(APINT_ALGO_MUL_BASECASE);
+        mpn_mul_basecase(rp, ap, an, bp, bn);
+    } else { // unbalanced: multiply bn-sized slices of a and add them up
+        STAT_ALGO(APINT_ALGO_MUL_SLICED);
+        uint64_t *t = limbs_alloc(2 * bn);
+        mpn_zero(rp, an + bn);
+        for (size_t off = 0; off < an; off += bn) {
+            size_t chunk = an - off < bn ? an - off : bn;
+            if (chunk == bn) {
+                mpn_mul_n(t, ap + off, bp, bn);
+            } else {
+                mpn_mul(t, bp, bn, ap + off, chunk);
+            }
+            mpn_add(rp + off, rp + off, an + bn - off, t, bn + chunk);
+        }
+        limbs_free(t, 2 * bn);
+    }
+}
+
+ApInt *apint_mul(const ApInt *a, const ApInt *b) {
+    ApInt *prod = apint_new(a->len + b->len);
+    apint_mul_into(prod, a, b);
+    return prod;
+}
+
+ApInt *apint_sqr(const ApInt *a) {
+    return apint_mul(a, a);
+}
+
+void apint_sqr_into(ApInt *dst, const ApInt *a) {
+    apint_mul_into(dst, a, a);
+}
+
+/*
+ * Division
+ *
+ * Single-limb divisors and the quotient digit estimates of Knuth's
+ * Algorithm D use the Moller-Granlund 2/1 division by a precomputed
+ * reciprocal.  Large balanced divisions instead multiply by a Newton
+ * reciprocal, built and applied with products no wider than the
+ * precision in hand, and wraparound products where only the low half is
+ * wanted, so they cost a small multiple of mpn_mul ("apintBench scaling"
+ * checks about 3x).
+ */
+
+static uint64_t mpn_submul_1_generic(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t b) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        u128 t = (u128)ap[i] * b + carry;
+        uint64_t lo = (uint64_t)t, r = rp[i];
+        carry = (uint64_t)(t >> 64) + (r < lo);
+        rp[i] = r - lo;
+    }
+    return carry;
+}
+
+static uint64_t mpn_rshift_generic(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt) {
+    uint64_t low = ap[0];
+    uint64_t out = low << (64 - cnt);
+    for (size_t i = 0; i + 1 < n; i++) {
+        uint64_t high = ap[i + 1];
+        rp[i] = (low >> cnt) | (high << (64 - cnt));
+        low = high;
+    }
+    rp[n - 1] = low >> cnt;
+    return out;
+}
+
+#ifdef APINT_X86_64
+/*
+ * AVX2 shifts, four limbs per step: each output limb combines an
+ * unaligned load of the limbs with one of their neighbours.  lshift
+ * walks down and rshift walks up so they work in place like the
+ * portable loops.
+ */
+__attribute__((target("avx2")))
+static uint64_t mpn_lshift_avx2(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt) {
+    uint64_t out = ap[n - 1] >> (64 - cnt);
+    __m128i left = _mm_cvtsi32_si128(cnt), right = _mm_cvtsi32_si128(64 - cnt);
+    size_t i = n - 1;
+    for (; i >= 4; i -= 4) { // r[i-3..i] from a[i-4..i]
+        __m256i high = _mm256_loadu_si256((const __m256i*)(ap + i - 3));
+        __m256i low = _mm256_loadu_si256((const __m256i*)(ap + i - 4));
+        _mm256_storeu_si256((__m256i*)(rp + i - 3),
+            _mm256_or_si256(_mm256_sll_epi64(high, left), _mm256_srl_epi64(low, right)));
+    }
+    for (; i > 0; i--) {
+        rp[i] = (ap[i] << cnt) | (ap[i - 1] >> (64 - cnt));
+    }
+    rp[0] = ap[0] << cnt;
+    return out;
+}
+
+__attribute__((target("avx2")))
+static uint64_t mpn_rshift_avx2(uint64_t *rp, const uint64_t *ap, size_t n, unsigned cnt) {
+    uint64_t out = ap[0] << (64 - cnt);
+    __m128i right = _mm_cvtsi32_si128(cnt), left = _mm_cvtsi32_si128(64 - cnt);
+    size_t i = 0;
+    for (; i + 4 < n; i += 4) { // r[i..i+3] from a[i..i+4]
+        __m256i low = _mm256_loadu_si256((const __m256i*)(ap + i));
+        __m256i high = _mm256_loadu_si256((const __m256i*)(ap + i + 1));
+        _mm256_storeu_si256((__m256i*)(rp + i),
+            _mm256_or_si256(_mm256_srl_epi64(low, right), _mm256_sll_epi64(high, left)));
+    }
+    for (; i + 1 < n; i++) {
+        rp[i] = (ap[i] >> cnt) | (ap[i + 1] << (64 - cnt));
+    }
+    rp[n - 1] = ap[n - 1] >> cnt;
+    return out;
+}
+#endif
+
+/*
+ * Hex conversion
+ *
+ * Every limb but the top one is exactly 16 digits, so the kernels work
+ * on whole 16-digit blocks, most significant first, and only the top
+ * limb goes digit by digit.
+ */
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// digit value + 1 for each hex character, 0 for anything else
+static const unsigned char hex_values[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+// value of the n <= 16 digits at s, -1 if one is not a hex digit
+static int hex_decode_digits(uint64_t *rp, const char *s, size_t n) {
+    uint64_t v = 0;
+    int bad = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned d = hex_values[(unsigned char)s[i]];
+        bad |= d == 0;
+        v = (v << 4) | ((d - 1) & 15);
+    }
+    *rp = v;
+    return bad ? -1 : 0;
+}
+
+// r[n-1] ... r[0] from the 16n digits at s
+static int mpn_hex_decode_generic(uint64_t *rp, const char *s, size_t n) {
+    int bad = 0;
+    for (size_t i = 0; i < n; i++) {
+        bad |= hex_decode_digits(rp + n - 1 - i, s + 16 * i, 16);
+    }
+    return bad;
+}
+
+// 16n digits for a[n-1] ... a[0]
+static void mpn_hex_encode_generic(char *s, const uint64_t *ap, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v = ap[n - 1 - i];
+        for (int k = 15; k >= 0; k--) {
+            s[16 * i + k] = hex_digits[v & 15];
+            v >>= 4;
+        }
+    }
+}
+
+#ifdef APINT_X86_64
+/*
+ * SSSE3 kernels, one limb per 16-byte vector.  Decoding classifies the
+ * characters with byte compares (bytes >= 0x80 compare negative and so
+ * fall outside both ranges), maps them to nibbles, merges nibble pairs
+ * with pmaddubsw and byte-swaps the packed result.  Encoding spreads the
+ * nibbles out with punpcklbw and looks the digits up with pshufb.
+ */
+__attribute__((target("ssse3")))
+static int mpn_hex_decode_ssse3(uint64_t *rp, const char *s, size_t n) {
+    const __m128i below_0 = _mm_set1_epi8('0' - 1), above_9 = _mm_set1_epi8('9' + 1);
+    const __m128i below_a = _mm_set1_epi8('a' - 1), above_f = _mm_set1_epi8('f' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i pair_weights = _mm_set1_epi16(0x0110); // 16 for the first digit of a pair, 1 for the second
+    int bad = 0;
+    for (size_t i = 0; i < n; i++) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 16 * i));
+        __m128i lower = _mm_or_si128(c, case_bit);
+        __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, below_0), _mm_cmplt_epi8(c, above_9));
+        __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(lower, below_a), _mm_cmplt_epi8(lower, above_f));
+        bad |= _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) ^ 0xffff;
+        __m128i nibbles = _mm_or_si128(
+            _mm_and_si128(is_digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+            _mm_andnot_si128(is_digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+        __m128i bytes = _mm_maddubs_epi16(nibbles, pair_weights);
+        bytes = _mm_packus_epi16(bytes, bytes);
+        rp[n - 1 - i] = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(bytes));
+    }
+    return bad ? -1 : 0;
+}
+
+__attribute__((target("ssse3")))
+static void mpn_hex_encode_ssse3(char *s, const uint64_t *ap, size_t n) {
+    const __m128i digits = _mm_loadu_si128((const __m128i*)hex_digits);
+    const __m128i low4 = _mm_set1_epi8(0x0f);
+    for (size_t i = 0; i < n; i++) {
+        __m128i x = _mm_cvtsi64_si128((long long)__builtin_bswap64(ap[n - 1 - i]));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(x, 4), low4);
+        __m128i low = _mm_and_si128(x, low4);
+        _mm_storeu_si128((__m128i*)(s + 16 * i), _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(high, low)));
+    }
+}
+#endif
+
+static void apint_finish(ApInt *ap, size_t n, uint32_t flags);
+
+int apint_set_hex(ApInt *dst, const char *hex) {
+    size_t i = 0, len = strlen(hex);
+    uint32_t flags = 0;
+    if (hex[0] == '-') {
+        flags = 1;
+        i++;
+    }
+    if (i == len) { // nothing but the sign
+        apint_set_u64(dst, 0UL);
+        return APINT_ERR_INVALID;
+    }
+    while (i < len - 1 && hex[i] == '0') { // leading zeros, keeping one digit
+        i++;
+    }
+    size_t blocks = (len - i + 15) / 16;
+    size_t top = len - i - 16 * (blocks - 1); // digits in the top limb
+    STAT_CALL(APINT_STAT_PARSE_HEX, blocks);
+    if (blocks > UINT32_MAX) {
+        apint_set_u64(dst, 0UL);
+        return APINT_ERR_INVALID;
+    }
+    apint_reserve(dst, blocks);
+    int bad = hex_decode_digits(dst->data + blocks - 1, hex + i, top);
+    bad |= kernels.hex_decode(dst->data, hex + i + top, blocks - 1);
+    if (bad) {
+        apint_set_u64(dst, 0UL);
+        return APINT_ERR_INVALID;
+    }
+    apint_finish(dst, blocks, flags);
+    return APINT_OK;
+}
+
+size_t apint_hex_size(const ApInt *ap) {
+    uint64_t top = ap->data[ap->len - 1];
+    size_t top_digits = top == 0 ? 1 : (67 - __builtin_clzll(top)) / 4;
+    return (ap->flags == 1) + top_digits + (size_t)(ap->len - 1) * 16 + 1;
+}
+
+int apint_format_as_hex_into(char *buf, size_t cap, const ApInt *ap) {
+    STAT_CALL(APINT_STAT_FORMAT_HEX, ap->len);
+    size_t size = apint_hex_size(ap);
+    if (size > cap) {
+        return APINT_ERR_RANGE;
+    }
+    char *p = buf;
+    if (ap->flags == 1) {
+        *p++ = '-';
+    }
+    uint64_t top = ap->data[ap->len - 1];
+    size_t top_digits = size - 1 - (p - buf) - (size_t)(ap->len - 1) * 16;
+    for (size_t k = top_digits; k-- > 0; ) { // no leading zeros on the top limb
+        p[k] = hex_digits[top & 15];
+        top >>= 4;
+    }
+    p += top_digits;
+    kernels.hex_encode(p, ap->data, ap->len - 1);
+    p[(size_t)(ap->len - 1) * 16] = '\0';
+    return APINT_OK;
+}
+
+/*
+ * Bitwise kernels.  These are memory bound, so the AVX2 versions just
+ * move 256 bits per instruction.  Population count is the exception:
+ * the vector versions count nibbles with a pshufb table lookup (Mula's
+ * method), summing the byte counts with psadbw every 31 steps before
+ * they can overflow.
+ */
+
+static void mpn_and_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        rp[i] = ap[i] & bp[i];
+    }
+}
+
+static void mpn_ior_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        rp[i] = ap[i] | bp[i];
+    }
+}
+
+static void mpn_xor_n_generic(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        rp[i] = ap[i] ^ bp[i];
+    }
+}
+
+static void mpn_com_generic(uint64_t *rp, const uint64_t *ap, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        rp[i] = ~ap[i];
+    }
+}
+
+static size_t mpn_popcount_generic(const uint64_t *ap, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += __builtin_popcountll(ap[i]);
+    }
+    return count;
+}
+
+#ifdef APINT_X86_64
+__attribute__((target("avx2")))
+static void mpn_and_n_avx2(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(ap + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(bp + i));
+        _mm256_storeu_si256((__m256i*)(rp + i), _mm256_and_si256(a, b));
+    }
+    mpn_and_n_generic(rp + i, ap + i, bp + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void mpn_ior_n_avx2(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(ap + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(bp + i));
+        _mm256_storeu_si256((__m256i*)(rp + i), _mm256_or_si256(a, b));
+    }
+    mpn_ior_n_generic(rp + i, ap + i, bp + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void mpn_xor_n_avx2(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(ap + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(bp + i));
+        _mm256_storeu_si256((__m256i*)(rp + i), _mm256_xor_si256(a, b));
+    }
+    mpn_xor_n_generic(rp + i, ap + i, bp + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void mpn_com_avx2(uint64_t *rp, const uint64_t *ap, size_t n) {
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(ap + i));
+        _mm256_storeu_si256((__m256i*)(rp + i), _mm256_xor_si256(a, ones));
+    }
+    mpn_com_generic(rp + i, ap + i, n - i);
+}
+
+__attribute__((target("popcnt")))
+static size_t mpn_popcount_popcnt(const uint64_t *ap, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += __builtin_popcountll(ap[i]);
+    }
+    return count;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t mpn_popcount_avx2(const uint64_t *ap, size_t n) {
+    const __m256i nibble_counts = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                   0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low4 = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    while (i + 4 <= n) {
+        size_t end = n - i > 4 * 31 ? i + 4 * 31 : n;
+        __m256i bytes = _mm256_setzero_si256(); // at most 8 per step in each byte
+        for (; i + 4 <= end; i += 4) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(ap + i));
+            __m256i low = _mm256_shuffle_epi8(nibble_counts, _mm256_and_si256(v, low4));
+            __m256i high = _mm256_shuffle_epi8(nibble_counts, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4));
+            bytes = _mm256_add_epi8(bytes, _mm256_add_epi8(low, high));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+    }
+    size_t count = _mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1)
+        + _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3);
+    return count + mpn_popcount_popcnt(ap + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static size_t mpn_popcount_avx512(const uint64_t *ap, size_t n) {
+    const __m512i nibble_counts = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i low4 = _mm512_set1_epi8(0x0f);
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    while (i + 8 <= n) {
+        size_t end = n - i > 8 * 31 ? i + 8 * 31 : n;
+        __m512i bytes = _mm512_setzero_si512();
+        for (; i + 8 <= end; i += 8) {
+            __m512i v = _mm512_loadu_si512((const void*)(ap + i));
+            __m512i low = _mm512_shuffle_epi8(nibble_counts, _mm512_and_si512(v, low4));
+            __m512i high = _mm512_shuffle_epi8(nibble_counts, _mm512_and_si512(_mm512_srli_epi16(v, 4), low4));
+            bytes = _mm512_add_epi8(bytes, _mm512_add_epi8(low, high));
+        }
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(bytes, _mm512_setzero_si512()));
+    }
+    return _mm512_reduce_add_epi64(total) + mpn_popcount_popcnt(ap + i, n - i);
+}
+#endif
+
+/*
+ * Picks the kernels for the host.  Running as a constructor means the
+ * table is written once, before main and any threads, and never again
+ * (apint_use_generic_kernels aside), so readers need no synchronization.
+ */
+__attribute__((constructor))
+static void mpn_kernels_init(void) {
+    const char *force = getenv("APINT_FORCE_GENERIC");
+    if (force != NULL && force[0] != '\0' && strcmp(force, "0") != 0) {
+        return;
+    }
+#ifdef APINT_X86_64
+    unsigned eax, ebx, ecx, edx;
+    __builtin_cpu_init(); // constructors may run before libgcc's own
+    int leaf7 = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    int has_avx2 = leaf7 && (ebx & bit_AVX2) && __builtin_cpu_supports("avx2"); // the latter also checks OS support
+    int has_adx = leaf7 && (ebx & bit_BMI2) && (ebx & bit_ADX);
+    kernels.name = "x86-64";
+    kernels.add_n = mpn_add_n_x86;
+    kernels.sub_n = mpn_sub_n_x86;
+    if (has_adx) {
+        kernels.name = has_avx2 ? "x86-64 adx avx2" : "x86-64 adx";
+        kernels.addmul_1 = mpn_addmul_1_adx;
+    } else if (has_avx2) {
+        kernels.name = "x86-64 avx2";
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        kernels.popcount = mpn_popcount_popcnt;
+    }
+    if (has_avx2) {
+        kernels.lshift = mpn_lshift_avx2;
+        kernels.rshift = mpn_rshift_avx2;
+        kernels.and_n = mpn_and_n_avx2;
+        kernels.ior_n = mpn_ior_n_avx2;
+        kernels.xor_n = mpn_xor_n_avx2;
+        kernels.com = mpn_com_avx2;
+        if (__builtin_cpu_supports("popcnt")) {
+            kernels.popcount = mpn_popcount_avx2;
+        }
+    }
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("popcnt")) {
+        kernels.name = has_adx ? "x86-64 adx avx512" : "x86-64 avx512";
+        kernels.popcount = mpn_popcount_avx512;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        kernels.hex_decode = mpn_hex_decode_ssse3;
+        kernels.hex_encode = mpn_hex_encode_ssse3;
+    }
+#endif
+}
+
+const char *apint_kernels(void) {
+    return kernels.name;
+}
+
+void apint_use_generic_kernels(int generic) {
+    kernels = generic_kernels;
+    if (!generic) {
+        mpn_kernels_init();
+    }
+}
+
+// r = a * b for any sizes >= 1, r must not overlap a or b
+static void mpn_mul_any(uint64_t *rp, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    if (an >= bn) {
+        mpn_mul(rp, ap, an, bp, bn);
+    } else {
+        mpn_mul(rp, bp, bn, ap, an);
+    }
+}
+
+// a mod d, as mpn_divrem_1 without the quotient
+static uint64_t mpn_mod_1(const uint64_t *ap, size_t n, uint64_t d);
+
+// floor((B^2 - 1) / d) - B for a normalized d (top bit set)
+static uint64_t invert_limb(uint64_t d) {
+    return (uint64_t)((((u128)~d) << 64 | ~(uint64_t)0) / d);
+}
+
+// (nh:nl) / d for normalized d and nh < d, v = invert_limb(d)
+static inline uint64_t div_2by1(uint64_t *rem, uint64_t nh, uint64_t nl, uint64_t d, uint64_t v) {
+    u128 q = (u128)v * nh + (((u128)(nh + 1) << 64) | nl); // wraps mod B^2 by design
+    uint64_t qh = (uint64_t)(q >> 64), ql = (uint64_t)q;
+    uint64_t r = nl - qh * d;
+    if (r > ql) {
+        qh--;
+        r += d;
+    }
+    if (r >= d) {
+        qh++;
+        r -= d;
+    }
+    *rem = r;
+    return qh;
+}
+
+// q = a / d for a single limb d != 0, returns the remainder
+static uint64_t mpn_divrem_1(uint64_t *qp, const uint64_t *ap, size_t n, uint64_t d) {
+    unsigned s = __builtin_clzll(d);
+    uint64_t r = 0;
+    d <<= s;
+    uint64_t v = invert_limb(d);
+    if (s == 0) {
+        for (size_t i = n; i-- > 0;) {
+            qp[i] = div_2by1(&r, r, ap[i], d, v);
+        }
+        return r;
+    }
+    r = ap[n - 1] >> (64 - s);
+    for (size_t i = n; i-- > 0;) {
+        uint64_t nl = (ap[i] << s) | (i > 0 ? ap[i - 1] >> (64 - s) : 0);
+        qp[i] = div_2by1(&r, r, nl, d, v);
+    }
+    return r >> s;
+}
+
+static uint64_t mpn_mod_1(const uint64_t *ap, size_t n, uint64_t d) {
+    unsigned s = __builtin_clzll(d);
+    d <<= s;
+    uint64_t v = invert_limb(d);
+    uint64_t r = s > 0 ? ap[n - 1] >> (64 - s) : 0;
+    for (size_t i = n; i-- > 0;) {
+        uint64_t nl = s > 0 ? (ap[i] << s) | (i > 0 ? ap[i - 1] >> (64 - s) : 0) : ap[i];
+        div_2by1(&r, r, nl, d, v);
+    }
+    return r >> s;
+}
+
+/*
+ * Knuth's Algorithm D.  u has un + 1 limbs with u[un] < d[dn-1], d is
+ * normalized and dn >= 2.  Writes un - dn + 1 quotient limbs to q and
+ * leaves the remainder in u[0..dn).
+ */
+static void mpn_div_qr_knuth(uint64_t *qp, uint64_t *up, size_t un, const uint64_t *dp, size_t dn) {
+    uint64_t d1 = dp[dn - 1], d0 = dp[dn - 2];
+    uint64_t v = invert_limb(d1);
+    for (size_t j = un - dn + 1; j-- > 0;) {
+        uint64_t top = up[j + dn], next = up[j + dn - 1], third = up[j + dn - 2];
+        uint64_t qhat, rhat;
+        int rhat_overflow = 0;
+        if (top == d1) { // the 2/1 estimate would not fit, use B - 1
+            qhat = ~(uint64_t)0;
+            rhat = next + d1;
+            rhat_overflow = rhat < d1;
+        } else {
+            qhat = div_2by1(&rhat, top, next, d1, v);
+        }
+        // at most two corrections make qhat exact or one too large
+        while (!rhat_overflow && (u128)qhat * d0 > (((u128)rhat << 64) | third)) {
+            qhat--;
+            rhat += d1;
+            rhat_overflow = rhat < d1;
+        }
+        uint64_t borrow = mpn_submul_1(up + j, dp, dn, qhat);
+        if (top < borrow) { // qhat was one too large: add d back
+            qhat--;
+            up[j + dn] = top - borrow + mpn_add_n(up + j, up + j, dp, dn);
+        } else {
+            up[j + dn] = top - borrow;
+        }
+        qp[j] = qhat;
+    }
+}
+
+static int use_div_newton(size_t dn, size_t qn) {
+    return dn >= tune_params[APINT_TUNE_DIV_NEWTON] && qn >= tune_params[APINT_TUNE_DIV_NEWTON]
+        && dn >= 2;
+}
+
+// N for mpn_mulmod_bnm1 to recover values of n limbs, given a bn-limb operand
+static size_t mulmod_bnm1_size(size_t n, size_t bn) {
+    if (n < BNM1_LOW) {
+        return BNM1_LOW;
+    }
+    if (!use_ntt(bn)) {
+        return n;
+    }
+    size_t N = BNM1_LOW; // a power of two
+    while (N + BNM1_LOW - 1 < n) {
+        N *= 2;
+    }
+    return N;
+}
+
+/*
+ * r = a * b mod (B^n - 1), n limbs, where B^n - 1 may stand for zero.  A
+ * cyclic NTT of length n when n came from mulmod_bnm1_size, about half
+ * the full product's transform, otherwise the full product folded.
+ */
+static void mpn_mulmod_bnm1(uint64_t *rp, size_t n, const uint64_t *ap, size_t an, const uint64_t *bp, size_t bn) {
+    if (an < bn) {
+        const uint64_t *tp = ap;
+        ap = bp;
+        bp = tp;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if ((n & (n - 1)) != 0 || !use_ntt(bn)) {
+        uint64_t *p = limbs_alloc(an + bn);
+        mpn_mul(p, ap, an, bp, bn);
+        mpn_bnm1_fold(rp, n, p, an + bn);
+        limbs_free(p, an + bn);
+        return;
+    }
+    size_t fn = (an > n ? n : 0) + (bn > n ? n : 0);
+    uint64_t *fp = fn > 0 ? limbs_alloc(fn) : NULL, *f = fp;
+    if (an > n) {
+        mpn_bnm1_fold(f, n, ap, an);
+        ap = f;
+        an = n;
+        f += n;
+    }
+    if (bn > n) {
+        mpn_bnm1_fold(f, n, bp, bn);
+        bp = f;
+        bn = n;
+    }
+    uint64_t carry[2];
+    mpn_mul_ntt_cyclic(rp, n, ap, an, bp, bn, n, carry);
+    uint64_t c = mpn_add(rp, rp, n, carry, 2); // B^n = 1 mod B^n - 1
+    while (c != 0) {
+        c = mpn_add_1(rp, rp, n, c);
+    }
+    if (fp != NULL) {
+        limbs_free(fp, fn);
+    }
+}
+
+/*
+ * x = floor(B^2n / d) - e with 0 <= e <= 4, for normalized d, n + 1
+ * limbs.  Newton's iteration with doubling precision: start from the
+ * reciprocal of the top h = n/2 + 1 limbs, lowered so the start is below
+ * B^2n / d, and take one Newton step, which stays below it.  With h past
+ * half of n the step's quadratic error is below one unit, so no exact
+ * correction is needed, and the step takes two products at its own
+ * precision: d times the start, of which only the n + 1 limbs that do
+ * not cancel are wanted (a wraparound product), and the tops of the
+ * start and of what is left, for the top of their product.
+ */
+static void mpn_invert(uint64_t *xp, const uint64_t *dp, size_t n) {
+    if (n < 3 || !use_div_newton(n, n)) { // exact
+        uint64_t *u = limbs_alloc(2 * n + 4);
+        mpn_zero(u, 2 * n + 4);
+        u[2 * n] = 1;
+        if (n == 1) {
+            mpn_divrem_1(u + 3, u, 3, dp[0]); // B^2 / d fits in two limbs
+            mpn_copy(xp, u + 3, 2);
+        } else {
+            mpn_div_qr_knuth(xp, u, 2 * n, dp, n);
+        }
+        limbs_free(u, 2 * n + 4);
+        return;
+    }
+
+    size_t h = n / 2 + 1, an = n + 2 - h, en = n + 1 - h; // the tops of xm and e' that are used
+    size_t N = mulmod_bnm1_size(n + 1, h + 1);
+    size_t bufn = (h + 1) + (N + BNM1_LOW) + N + (an + en);
+    uint64_t *buf = limbs_alloc(bufn);
+    uint64_t *xm = buf, *e = xm + h + 1, *p = e + N + BNM1_LOW, *t = p + N;
+
+    mpn_invert(xm, dp + n - h, h);
+    mpn_sub_1(xm, xm, h + 1, 4); // x0 = (xm - 4) B^(n-h) <= B^2n / d
+
+    // e = B^2n - d x0 = e' B^(n-h) with e' = B^(n+h) - d xm in [0, 9 B^n)
+    mpn_mulmod_bnm1(p, N, dp, n, xm, h + 1);
+    mpn_zero(e, N);
+    e[(n + h) % N] = 1;
+    if (mpn_sub_n(e, e, p, N)) {
+        mpn_sub_1(e, e, N, 1);
+    }
+    uint64_t lo[BNM1_LOW];
+    mpn_mullo_basecase(lo, dp, n, xm, h + 1, BNM1_LOW);
+    mpn_neg(lo, lo, BNM1_LOW);
+    mpn_bnm1_recover(e, e, N, lo, BNM1_LOW);
+
+    // x1 = x0 + floor(x0 e / B^2n) = x0 + floor(xm e' / B^2h): the tops lose at most 2 units
+    mpn_zero(xp, n + 1);
+    mpn_copy(xp + n - h, xm, h + 1);
+    size_t tn = mpn_normalized_size(e + h, en);
+    if (tn > 0) {
+        mpn_mul_any(t, xm + h + 1 - an, an, e + h, tn);
+        if (an + tn > n + 1 - h) {
+            mpn_add(xp, xp, n + 1, t + n + 1 - h, an + tn - (n + 1 - h));
+        }
+    }
+    limbs_free(buf, bufn);
+}
+
+/*
+ * Same contract as mpn_div_qr_knuth.  The quotient goes in blocks of in
+ * <= dn limbs, with x from mpn_invert of the divisor's top in limbs.  A
+ * block's quotient is the top of (top limbs of the partial remainder) *
+ * x lowered by 2, so never too large and at most 10 too small; the new
+ * remainder, below 11 d, then follows from its residue mod B^N - 1 (a
+ * wraparound product, N about dn) and its low limbs, and a few
+ * subtractions of d finish the block.
+ */
+static void mpn_div_qr_newton(uint64_t *qp, uint64_t *up, size_t un, const uint64_t *dp, size_t dn) {
+    size_t qn = un - dn + 1;
+    size_t blocks = (qn + dn - 1) / dn, in = (qn + blocks - 1) / blocks;
+    size_t N = mulmod_bnm1_size(dn + 1, in);
+    size_t bufn = (in + 1) + (2 * in + 1) + N + (N + BNM1_LOW);
+    uint64_t *buf = limbs_alloc(bufn);
+    uint64_t *x = buf, *hp = x + in + 1, *p = hp + 2 * in + 1, *r = p + N;
+
+    mpn_invert(x, dp + dn - in, in);
+    size_t off = qn, k = qn - (blocks - 1) * in; // the top block may be short
+    do {
+        off -= k;
+        uint64_t *t = up + off, *qb = qp + off; // t = R B^k + the next k limbs, R < d
+
+        mpn_mul_any(hp, t + dn, k, x, in + 1);
+        if (mpn_sub_1(hp + in, hp + in, k + 1, 2)) {
+            mpn_zero(hp + in, k + 1);
+        }
+        mpn_copy(qb, hp + in, k); // hp[in + k] is zero now, as q < B^k
+
+        // R = t - q d, from t - q d mod B^N - 1 and mod B^BNM1_LOW
+        mpn_mulmod_bnm1(p, N, dp, dn, qb, k);
+        mpn_bnm1_fold(r, N, t, dn + k);
+        if (mpn_sub_n(r, r, p, N)) {
+            mpn_sub_1(r, r, N, 1);
+        }
+        uint64_t lo[BNM1_LOW], tl[BNM1_LOW] = { 0 };
+        mpn_mullo_basecase(lo, dp, dn, qb, k, BNM1_LOW);
+        mpn_copy(tl, t, dn + k < BNM1_LOW ? dn + k : BNM1_LOW);
+        mpn_sub_n(lo, tl, lo, BNM1_LOW);
+        mpn_bnm1_recover(r, r, N, lo, BNM1_LOW);
+
+        mpn_copy(t, r, dn + 1); // the rest of r is zero
+        mpn_zero(t + dn + 1, k - 1);
+        while (t[dn] != 0 || mpn_cmp(t, dp, dn) >= 0) {
+            mpn_add_1(qb, qb, k, 1);
+            t[dn] -= mpn_sub_n(t, t, dp, dn);
+        }
+        k = in;
+    } while (off > 0);
+    limbs_free(buf, bufn);
+}
+
+// q = n / d, r = n % d for nn >= dn >= 1 and d[dn-1] != 0; q has nn - dn + 1 limbs, r has dn
+static void mpn_tdiv_qr(uint64_t *qp, uint64_t *rp, const uint64_t *np, size_t nn, const uint64_t *dp, size_t dn) {
+    if (dn == 1) {
+        STAT_ALGO(APINT_ALGO_DIV_1);
+        rp[0] = mpn_divrem_1(qp, np, nn, dp[0]);
+        return;
+    }
+    unsigned s = __builtin_clzll(dp[dn - 1]);
+    uint64_t *d = limbs_alloc(dn + nn + 1);
+    uint64_t *u = d + dn;
+    if (s > 0) { // normalize so the divisor's top bit is set
+        mpn_lshift(d, dp, dn, s);
+        u[nn] = mpn_lshift(u, np, nn, s);
+    } else {
+        mpn_copy(d, dp, dn);
+        mpn_copy(u, np, nn);
+        u[nn] = 0;
+    }
+    if (use_div_newton(dn, nn - dn + 1)) {
+        STAT_ALGO(APINT_ALGO_DIV_NEWTON);
+        mpn_div_qr_newton(qp, u, nn, d, dn);
+    } else {
+        STAT_ALGO(APINT_ALGO_DIV_KNUTH);
+        mpn_div_qr_knuth(qp, u, nn, d, dn);
+    }
+    if (s > 0) {
+        mpn_rshift(rp, u, dn, s);
+    } else {
+        mpn_copy(rp, u, dn);
+    }
+    limbs_free(d, dn + nn + 1);
+}
+
+int apint_divmod(const ApInt *a, const ApInt *b, ApInt **quot, ApInt **rem) {
+    ApInt *q = quot != NULL ? apint_new(a->len) : NULL;
+    ApInt *r = rem != NULL ? apint_new(b->len) : NULL;
+    int status = apint_divmod_into(q, r, a, b);
+    if (status != APINT_OK) {
+        if (q != NULL) {
+            apint_destroy(q);
+        }
+        if (r != NULL) {
+            apint_destroy(r);
+        }
+        return status;
+    }
+    if (quot != NULL) {
+        *quot = q;
+    }
+    if (rem != NULL) {
+        *rem = r;
+    }
+    return APINT_OK;
+}
+
+ApInt *apint_div(const ApInt *a, const ApInt *b) {
+    ApInt *quot = NULL;
+    apint_divmod(a, b, &quot, NULL);
+    return quot;
+}
+
+ApInt *apint_mod(const ApInt *a, const ApInt *b) {
+    ApInt *rem = NULL;
+    apint_divmod(a, b, NULL, &rem);
+    return rem;
+}
+
+/*
+ * Decimal conversion
+ *
+ * Digits are handled 19 at a time, since 10^19 is the largest power of
+ * ten below 2^64.  Short numbers go chunk by chunk (a multiply-add or a
+ * single-limb division per chunk, so quadratic); long ones are split in
+ * half at a power 10^(19*2^j) and converted recursively, which costs a
+ * multiplication or division at each level.
+ */
+
+#define DEC_CHUNK 19
+#define DEC_CHUNK_BASE 10000000000000000000UL // 10^19
+
+/*
+ * dec_powers[j] = 10^(19*2^j), built on first use and kept for the life
+ * of the process.  Whoever finishes computing an entry first publishes
+ * it with a compare-and-swap; a thread that loses the race frees its copy.
+ * The entries come from malloc, not the hooks, as they outlive any pool.
+ */
+typedef struct {
+    size_t n;
+    uint64_t limbs[];
+} DecPower;
+
+#define DEC_POWERS_MAX 48
+static DecPower *dec_powers[DEC_POWERS_MAX];
+
+static const DecPower *dec_power(int j) {
+    DecPower *p = __atomic_load_n(&dec_powers[j], __ATOMIC_ACQUIRE);
+    if (p != NULL) {
+        return p;
+    }
+    if (j == 0) {
+        p = (DecPower*)malloc(sizeof(DecPower) + sizeof(uint64_t));
+        p->n = 1;
+        p->limbs[0] = DEC_CHUNK_BASE;
+    } else {
+        const DecPower *half = dec_power(j - 1);
+        p = (DecPower*)malloc(sizeof(DecPower) + 2 * half->n * sizeof(uint64_t));
+        mpn_mul_n(p->limbs, half->limbs, half->limbs, half->n);
+        p->n = mpn_normalized_size(p->limbs, 2 * half->n);
+    }
+    DecPower *expected = NULL;
+    if (!__atomic_compare_exchange_n(&dec_powers[j], &expected, p, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(p);
+        p = expected;
+    }
+    return p;
+}
+
+static int use_dec_dc(size_t n) {
+    return n >= tune_params[APINT_TUNE_DEC_DC] && n >= 2;
+}
+
+// value of the 8 digits at s, or -1 if they are not all digits (SWAR, after Lemire)
+static int64_t dec_parse8(const char *s) {
+    uint64_t v;
+    memcpy(&v, s, 8); // first digit in the low byte
+    if ((v & 0xf0f0f0f0f0f0f0f0UL) != 0x3030303030303030UL
+            || ((v + 0x0606060606060606UL) & 0xf0f0f0f0f0f0f0f0UL) != 0x3030303030303030UL) {
+        return -1;
+    }
+    v -= 0x3030303030303030UL;
+    v = v * 10 + (v >> 8); // pairs
+    v = (((v & 0x000000ff000000ffUL) * (100 + (1000000UL << 32)))
+        + (((v >> 16) & 0x000000ff000000ffUL) * (1 + (10000UL << 32)))) >> 32;
+    return (int64_t)v;
+}
+
+// value of the n <= 19 digits at s, returns -1 if one is not a digit
+static int dec_parse_chunk(uint64_t *vp, const char *s, size_t n) {
+    uint64_t v = 0;
+    for (; n >= 8; s += 8, n -= 8) {
+        int64_t d = dec_parse8(s);
+        if (d < 0) {
+            return -1;
+        }
+        v = v * 100000000 + (uint64_t)d;
+    }
+    for (; n > 0; s++, n--) {
+        unsigned d = (unsigned char)*s - '0';
+        if (d > 9) {
+            return -1;
+        }
+        v = v * 10 + d;
+    }
+    *vp = v;
+    return 0;
+}
+
+static int dec_parse(uint64_t *rp, const char *s, size_t d);
+
+// the two halves of a divide-and-conquer conversion, for running in parallel
+typedef struct {
+    uint64_t *rp;
+    char *s;
+    const char *cs;
+    size_t d, n;
+    int bad;
+} DecTask;
+
+static void dec_parse_task(void *arg, size_t i) {
+    DecTask *t = (DecTask*)arg + i;
+    t->bad = dec_parse(t->rp, t->cs, t->d);
+}
+
+// r = the d digits at s, r has ceil(d/19) limbs; returns -1 on a non-digit
+static int dec_parse(uint64_t *rp, const char *s, size_t d) {
+    size_t rn = (d + DEC_CHUNK - 1) / DEC_CHUNK;
+    STAT_ALGO(use_dec_dc(rn) ? APINT_ALGO_DEC_DC : APINT_ALGO_DEC_CHUNKED);
+    if (!use_dec_dc(rn)) {
+        size_t first = d - DEC_CHUNK * (rn - 1), n = 1;
+        if (dec_parse_chunk(rp, s, first) < 0) {
+            return -1;
+        }
+        for (s += first; n < rn; s += DEC_CHUNK) {
+            uint64_t chunk;
+            if (dec_parse_chunk(&chunk, s, DEC_CHUNK) < 0) {
+                return -1;
+            }
+            uint64_t carry = mpn_mul_1(rp, rp, n, DEC_CHUNK_BASE);
+            carry += mpn_add_1(rp, rp, n, chunk);
+            rp[n++] = carry;
+        }
+        return 0;
+    }
+
+    // high * 10^k + low with k = 19 * 2^j the largest such that k <= d/2
+    int j = 0;
+    while ((size_t)DEC_CHUNK << (j + 2) <= d) {
+        j++;
+    }
+    size_t k = (size_t)DEC_CHUNK << j;
+    const DecPower *pw = dec_power(j);
+    size_t hn = (d - k + DEC_CHUNK - 1) / DEC_CHUNK, ln = k / DEC_CHUNK;
+    uint64_t *t = limbs_alloc(hn + ln);
+    DecTask halves[2] = { { t, NULL, s, d - k, 0, 0 }, { t + hn, NULL, s + d - k, k, 0, 0 } };
+    pool_run(dec_parse_task, halves, 2, use_parallel(rn));
+    int bad = halves[0].bad | halves[1].bad;
+    if (!bad) {
+        mpn_mul_any(rp, t, hn, pw->limbs, pw->n); // hn + pw->n <= rn limbs
+        mpn_zero(rp + hn + pw->n, rn - hn - pw->n);
+        mpn_add(rp, rp, rn, t + hn, ln);
+    }
+    limbs_free(t, hn + ln);
+    return bad;
+}
+
+// writes v as exactly n <= 19 digits ending at end
+static void dec_format_chunk(char *end, uint64_t v, size_t n) {
+    while (n-- > 0) {
+        *--end = '0' + v % 10;
+        v /= 10;
+    }
+}
+
+static void dec_format(char *s, size_t width, uint64_t *ap, size_t un);
+
+static void dec_format_task(void *arg, size_t i) {
+    DecTask *t = (DecTask*)arg + i;
+    dec_format(t->s, t->d, t->rp, t->n);
+}
+
+/*
+ * writes a (un limbs, destroyed) as exactly width digits, zero padded;
+ * a must be below 10^width
+ */
+static void dec_format(char *s, size_t width, uint64_t *ap, size_t un) {
+    un = mpn_normalized_size(ap, un);
+    if (un == 0) {
+        memset(s, '0', width);
+        return;
+    }
+    STAT_ALGO(use_dec_dc(un) ? APINT_ALGO_DEC_DC : APINT_ALGO_DEC_CHUNKED);
+    if (!use_dec_dc(un)) {
+        char *end = s + width;
+        while (un > 0) {
+            uint64_t chunk = mpn_divrem_1(ap, ap, un, DEC_CHUNK_BASE);
+            un = mpn_normalized_size(ap, un);
+            size_t n = (size_t)(end - s) < DEC_CHUNK ? (size_t)(end - s) : DEC_CHUNK;
+            dec_format_chunk(end, chunk, n);
+            end -= n;
+        }
+        memset(s, '0', end - s);
+        return;
+    }
+
+    // split at the largest 10^(19*2^j) of at most half a's limbs
+    int j = 0;
+    while (j + 1 < DEC_POWERS_MAX && 2 * dec_power(j + 1)->n <= un) {
+        j++;
+    }
+    const DecPower *pw = dec_power(j);
+    size_t k = (size_t)DEC_CHUNK << j, qn = un - pw->n + 1;
+    uint64_t *q = limbs_alloc(qn + pw->n);
+    uint64_t *r = q + qn;
+    mpn_tdiv_qr(q, r, ap, un, pw->limbs, pw->n);
+    DecTask halves[2] = { { r, s + width - k, NULL, k, pw->n, 0 }, { q, s, NULL, width - k, qn, 0 } };
+    pool_run(dec_format_task, halves, 2, use_parallel(un));
+    limbs_free(q, qn + pw->n);
+}
+
+int apint_set_dec(ApInt *dst, const char *dec) {
+    size_t i = 0, len = strlen(dec);
+    uint32_t flags = 0;
+    if (dec[0] == '-') {
+        flags = 1;
+        i++;
+    }
+    if (i == len) {
+        apint_set_u64(dst, 0UL);
+        return APINT_ERR_INVALID;
+    }
+    while (i < len - 1 && dec[i] == '0') {
+        i++;
+    }
+    size_t n = (len - i + DEC_CHUNK - 1) / DEC_CHUNK;
+    STAT_CALL(APINT_STAT_PARSE_DEC, n);
+    if (n > UINT32_MAX) {
+        apint_set_u64(dst, 0UL);
+        return APINT_ERR_INVALID;
+    }
+    apint_reserve(dst, n);
+    if (dec_parse(dst->data, dec + i, len - i) < 0) {
+        apint_set_u64(dst, 0UL);
+        return APINT_ERR_INVALID;
+    }
+    apint_finish(dst, n, flags);
+    return APINT_OK;
+}
+
+// NULL when dec is not a valid decimal string
+ApInt *apint_create_from_dec(const char *dec) {
+    ApInt *ap = apint_new(1);
+    if (apint_set_dec(ap, dec) != APINT_OK) {
+        apint_destroy(ap);
+        return NULL;
+    }
+    return ap;
+}
+
+// 2^(64n) < 10^(19.27n), so 20 digits per limb always suffice
+size_t apint_dec_size(const ApInt *ap) {
+    return (ap->flags == 1) + (size_t)ap->len * 20 + 1;
+}
+
+// the digits of ap into a buffer from the hooks; returns the buffer, *start is the first digit
+static char *dec_digits(const ApInt *ap, size_t *width, size_t *start) {
+    size_t un = ap->len;
+    STAT_CALL(APINT_STAT_FORMAT_DEC, un);
+    *width = un * 20;
+    char *s = (char*)mem_alloc(*width);
+    uint64_t *t = limbs_alloc(un);
+    mpn_copy(t, ap->data, un);
+    dec_format(s, *width, t, un);
+    limbs_free(t, un);
+    size_t i = 0;
+    while (i < *width - 1 && s[i] == '0') {
+        i++;
+    }
+    *start = i;
+    return s;
+}
+
+int apint_format_as_dec_into(char *buf, size_t cap, const ApInt *ap) {
+    size_t width, start;
+    char *digits = dec_digits(ap, &width, &start);
+    int neg = ap->flags == 1;
+    size_t n = width - start;
+    int rc = APINT_ERR_RANGE;
+    if (neg + n + 1 <= cap) {
+        if (neg) {
+            buf[0] = '-';
+        }
+        memcpy(buf + neg, digits + start, n);
+        buf[neg + n] = '\0';
+        rc = APINT_OK;
+    }
+    mem_free(digits, width);
+    return rc;
+}
+
+// the string comes from the allocator hooks; release it with apint_free_str
+char *apint_format_as_dec(const ApInt *ap) {
+    size_t width, start;
+    char *digits = dec_digits(ap, &width, &start);
+    int neg = ap->flags == 1;
+    size_t n = width - start;
+    char *s = (char*)mem_alloc(neg + n + 1);
+    if (neg) {
+        s[0] = '-';
+    }
+    memcpy(s + neg, digits + start, n);
+    s[neg + n] = '\0';
+    mem_free(digits, width);
+    return s;
+}
+
+/*
+ * Binary format
+ *
+ * The header is always written 8 bytes long so that the limbs after it
+ * keep the record's alignment; 7 bits of varint per byte leave room for
+ * any 32-bit length.  Limbs are stored as in memory on little-endian
+ * hosts and byte-swapped elsewhere.
+ */
+#define SER_HEADER 8
+#define SER_HOST_LE (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+size_t apint_serialized_size(const ApInt *ap) {
+    return SER_HEADER + 8 * mpn_normalized_size(ap->data, ap->len);
+}
+
+int apint_serialize_into(void *buf, size_t cap, const ApInt *ap) {
+    size_t n = mpn_normalized_size(ap->data, ap->len);
+    if (SER_HEADER + 8 * n > cap) {
+        return APINT_ERR_RANGE;
+    }
+    uint8_t *p = (uint8_t*)buf;
+    uint64_t h = (uint64_t)n << 1 | (n > 0 && ap->flags == 1);
+    for (int i = 0; i < SER_HEADER - 1; i++) {
+        p[i] = 0x80 | (h & 0x7f);
+        h >>= 7;
+    }
+    p[SER_HEADER - 1] = (uint8_t)h;
+    if (SER_HOST_LE) {
+        memcpy(p + SER_HEADER, ap->data, 8 * n);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            uint64_t limb = __builtin_bswap64(ap->data[i]);
+            memcpy(p + SER_HEADER + 8 * i, &limb, 8);
+        }
+    }
+    return APINT_OK;
+}
+
+// limb count, sign and header size of the record at p; -1 if it is malformed
+static int ser_parse(const uint8_t *p, size_t size, size_t *n, uint32_t *flags, size_t *header) {
+    uint64_t h = 0;
+    size_t i = 0;
+    for (;; i++) {
+        if (i == size || i == SER_HEADER) { // no padding goes past SER_HEADER
+            return -1;
+        }
+        h |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            break;
+        }
+    }
+    *header = i + 1;
+    *n = h >> 1;
+    *flags = h & 1;
+    if (*n > UINT32_MAX || *n > (size - *header) / 8) {
+        return -1;
+    }
+    if (*n > 0) { // the top limb must be nonzero
+        uint64_t top;
+        memcpy(&top, p + *header + 8 * (*n - 1), 8);
+        if (top == 0) {
+            return -1;
+        }
+    } else if (*flags) { // and zero has no sign
+        return -1;
+    }
+    return 0;
+}
+
+int apint_deserialize_into(ApInt *dst, const void *buf, size_t size, size_t *used) {
+    const uint8_t *p = (const uint8_t*)buf;
+    size_t n, header;
+    uint32_t flags;
+    if (ser_parse(p, size, &n, &flags, &header) < 0) {
+        apint_set_u64(dst, 0UL);
+        return APINT_ERR_INVALID;
+    }
+    apint_reserve(dst, n);
+    if (SER_HOST_LE) {
+        memcpy(dst->data, p + header, 8 * n);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            memcpy(&dst->data[i], p + header + 8 * i, 8);
+            dst->data[i] = __builtin_bswap64(dst->data[i]);
+        }
+    }
+    apint_finish(dst, n, flags);
+    if (used != NULL) {
+        *used = header + 8 * n;
+    }
+    return APINT_OK;
+}
+
+// NULL when the record is malformed
+ApInt *apint_deserialize(const void *buf, size_t size, size_t *used) {
+    ApInt *ap = apint_new(1);
+    if (apint_deserialize_into(ap, buf, size, used) != APINT_OK) {
+        apint_destroy(ap);
+        return NULL;
+    }
+    return ap;
+}
+
+int apint_view_init(ApIntView *view, const void *buf, size_t size, size_t *used) {
+    const uint8_t *p = (const uint8_t*)buf;
+    size_t n, header;
+    uint32_t flags;
+    if (!SER_HOST_LE || ser_parse(p, size, &n, &flags, &header) < 0 || (n > 0 && (uintptr_t)(p + header) % 8 != 0)) {
+        return APINT_ERR_INVALID;
+    }
+    ApInt *v = &view->value;
+    v->arena = NULL;
+    v->flags = flags;
+    if (n == 0) {
+        v->small[0] = 0;
+        v->data = v->small;
+        v->len = 1;
+        v->cap = APINT_INLINE_LIMBS;
+    } else {
+        v->data = (uint64_t*)(uintptr_t)(p + header); // never written through: the view is only read
+        v->len = n;
+        v->cap = n;
+    }
+    if (used != NULL) {
+        *used = header + 8 * n;
+    }
+    return APINT_OK;
+}
+
+/*
+ * Stores
+ *
+ * Layout: a 64-byte StoreHeader, the limb region from byte 64 with each
+ * value's limbs padded to a multiple of STORE_ALIGN_LIMBS, then the
+ * index of StoreEntry records.  All fields are little-endian.  The
+ * writer streams limbs out as values arrive and keeps only the index in
+ * memory, writing it and the header last.
+ */
+#define STORE_MAGIC "APINTSTO"
+#define STORE_VERSION 1
+#define STORE_ALIGN_LIMBS 4 // 32 bytes, one AVX2 load
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t count;
+    uint64_t limbs_offset; // bytes from the start of the file
+    uint64_t limbs_size;   // in limbs
+    uint64_t index_offset; // bytes from the start of the file
+    uint8_t reserved[16];
+} StoreHeader;
+
+typedef struct {
+    uint64_t offset; // in limbs from the start of the limb region
+    uint32_t len;    // 0 for zero
+    uint32_t flags;
+} StoreEntry;
+
+struct ApIntStore {
+    void *map;
+    size_t map_size;
+    const uint64_t *limbs;
+    const StoreEntry *index;
+    size_t count;
+};
+
+struct ApIntStoreWriter {
+    FILE *f;
+    StoreEntry *index;
+    size_t count, cap;
+    uint64_t pos; // limbs written so far
+    int failed;
+};
+
+ApIntStore *apint_store_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(StoreHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd); // the mapping keeps the file
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    size_t size = st.st_size;
+    const StoreHeader *h = (const StoreHeader*)map;
+    int ok = SER_HOST_LE && memcmp(h->magic, STORE_MAGIC, 8) == 0 && h->version == STORE_VERSION
+        && h->limbs_offset % 64 == 0 && h->limbs_offset >= sizeof(StoreHeader) && h->limbs_offset <= size
+        && h->limbs_size <= (size - h->limbs_offset) / 8
+        && h->index_offset % 8 == 0 && h->index_offset <= size
+        && h->count <= (size - h->index_offset) / sizeof(StoreEntry);
+    if (!ok) {
+        munmap(map, size);
+        return NULL;
+    }
+    ApIntStore *store = (ApIntStore*)mem_alloc(sizeof(ApIntStore));
+    store->map = map;
+    store->map_size = size;
+    store->limbs = (const uint64_t*)((const char*)map + h->limbs_offset);
+    store->index = (const StoreEntry*)((const char*)map + h->index_offset);
+    store->count = h->count;
+    return store;
+}
+
+void apint_store_close(ApIntStore *store) {
+    munmap(store->map, store->map_size);
+    mem_free(store, sizeof(ApIntStore));
+}
+
+size_t apint_store_count(const ApIntStore *store) {
+    return store->count;
+}
+
+int apint_store_get(const ApIntStore *store, size_t i, ApIntView *view) {
+    if (i >= store->count) {
+        return APINT_ERR_RANGE;
+    }
+    const StoreEntry *e = &store->index[i];
+    const StoreHeader *h = (const StoreHeader*)store->map;
+    if (e->offset > h->limbs_size || e->len > h->limbs_size - e->offset) { // a damaged entry
+        return APINT_ERR_INVALID;
+    }
+    ApInt *v = &view->value;
+    v->arena = NULL;
+    v->flags = e->flags & 1;
+    if (e->len == 0) {
+        v->small[0] = 0;
+        v->data = v->small;
+        v->len = 1;
+        v->cap = APINT_INLINE_LIMBS;
+    } else {
+        v->data = (uint64_t*)(uintptr_t)(store->limbs + e->offset); // read-only mapping, never written
+        v->len = e->len;
+        v->cap = e->len;
+    }
+    return APINT_OK;
+}
+
+ApIntStoreWriter *apint_store_writer_open(const char *path) {
+    FILE *f = SER_HOST_LE ? fopen(path, "wb") : NULL;
+    if (f == NULL) {
+        return NULL;
+    }
+    ApIntStoreWriter *w = (ApIntStoreWriter*)mem_alloc(sizeof(ApIntStoreWriter));
+    w->f = f;
+    w->index = NULL;
+    w->count = w->cap = 0;
+    w->pos = 0;
+    StoreHeader blank = { { 0 }, 0, 0, 0, 0, 0, 0, { 0 } }; // until close knows the sizes
+    w->failed = fwrite(&blank, sizeof(blank), 1, f) != 1;
+    return w;
+}
+
+static void store_write_limbs(ApIntStoreWriter *w, const uint64_t *p, size_t n) {
+    w->failed |= fwrite(p, 8, n, w->f) != n;
+    w->pos += n;
+}
+
+int apint_store_writer_add(ApIntStoreWriter *w, const ApInt *ap) {
+    size_t n = mpn_normalized_size(ap->data, ap->len);
+    static const uint64_t pad[STORE_ALIGN_LIMBS];
+    if (w->pos % STORE_ALIGN_LIMBS != 0) {
+        store_write_limbs(w, pad, STORE_ALIGN_LIMBS - w->pos % STORE_ALIGN_LIMBS);
+    }
+    if (w->count == w->cap) {
+        size_t cap = w->cap ? 2 * w->cap : 64;
+        w->index = w->index == NULL ? (StoreEntry*)mem_alloc(cap * sizeof(StoreEntry))
+            : (StoreEntry*)mem_realloc(w->index, w->cap * sizeof(StoreEntry), cap * sizeof(StoreEntry));
+        w->cap = cap;
+    }
+    w->index[w->count++] = (StoreEntry){ w->pos, (uint32_t)n, n > 0 && ap->flags == 1 };
+    store_write_limbs(w, ap->data, n);
+    return w->failed ? APINT_ERR_IO : APINT_OK;
+}
+
+int apint_store_writer_close(ApIntStoreWriter *w) {
+    StoreHeader h = { STORE_MAGIC, STORE_VERSION, sizeof(StoreHeader), w->count,
+                      sizeof(StoreHeader), w->pos, sizeof(StoreHeader) + 8 * w->pos, { 0 } };
+    w->failed |= fwrite(w->index, sizeof(StoreEntry), w->count, w->f) != w->count;
+    w->failed |= fseek(w->f, 0, SEEK_SET) != 0;
+    w->failed |= fwrite(&h, sizeof(h), 1, w->f) != 1;
+    w->failed |= fclose(w->f) != 0;
+    int rc = w->failed ? APINT_ERR_IO : APINT_OK;
+    if (w->index != NULL) {
+        mem_free(w->index, w->cap * sizeof(StoreEntry));
+    }
+    mem_free(w, sizeof(ApIntStoreWriter));
+    return rc;
+}
+
+/*
+ * Bitwise operations
+ *
+ * Negative values act as infinite two's complement, as in GMP's mpz:
+ * -m is ~(m - 1) with ones extending forever.  When an operand is
+ * negative both are converted to that form over one limb more than the
+ * longer of them, so the top limb carries the sign of the result,
+ * combined with the word kernels and converted back.
+ */
+
+enum { BITWISE_AND, BITWISE_IOR, BITWISE_XOR };
+
+static void mpn_bitwise(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, size_t n, int op) {
+    if (op == BITWISE_AND) {
+        kernels.and_n(rp, ap, bp, n);
+    } else if (op == BITWISE_IOR) {
+        kernels.ior_n(rp, ap, bp, n);
+    } else {
+        kernels.xor_n(rp, ap, bp, n);
+    }
+}
+
+// r = a in two's complement over n > an limbs
+static void mpn_twos_complement(uint64_t *rp, const uint64_t *ap, size_t an, size_t n, int negative) {
+    mpn_copy(rp, ap, an);
+    mpn_zero(rp + an, n - an);
+    if (negative) {
+        mpn_sub_1(rp, rp, n, 1);
+        kernels.com(rp, rp, n);
+    }
+}
+
+static void apint_bitwise_into(ApInt *dst, const ApInt *a, const ApInt *b, int op) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    size_t bn = mpn_normalized_size(b->data, b->len);
+    STAT_CALL(APINT_STAT_BITWISE, an > bn ? an : bn);
+    int aneg = a->flags == 1, bneg = b->flags == 1;
+    if (an < bn) { // make a the longer
+        const ApInt *t = a;
+        a = b;
+        b = t;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+        int tneg = aneg;
+        aneg = bneg;
+        bneg = tneg;
+    }
+    if (an == 0) { // both zero
+        apint_set_u64(dst, 0UL);
+        return;
+    }
+    if (!aneg && !bneg) { // plain magnitudes, b zero-extended
+        size_t n = op == BITWISE_AND ? bn : an;
+        if (n == 0) {
+            apint_set_u64(dst, 0UL);
+            return;
+        }
+        apint_reserve(dst, n);
+        mpn_bitwise(dst->data, a->data, b->data, bn, op);
+        if (n > bn) {
+            mpn_copy(dst->data + bn, a->data + bn, n - bn);
+        }
+        apint_finish(dst, n, 0);
+        return;
+    }
+    size_t n = an + 1;
+    uint64_t *t = limbs_alloc(2 * n);
+    mpn_twos_complement(t, a->data, an, n, aneg);
+    mpn_twos_complement(t + n, b->data, bn, n, bneg);
+    mpn_bitwise(t, t, t + n, n, op);
+    int negative = t[n - 1] >> 63;
+    if (negative) { // back to sign and magnitude
+        kernels.com(t, t, n);
+        mpn_add_1(t, t, n, 1);
+    }
+    apint_reserve(dst, n);
+    mpn_copy(dst->data, t, n);
+    apint_finish(dst, n, negative);
+    limbs_free(t, 2 * n);
+}
+
+void apint_and_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    apint_bitwise_into(dst, a, b, BITWISE_AND);
+}
+
+void apint_or_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    apint_bitwise_into(dst, a, b, BITWISE_IOR);
+}
+
+void apint_xor_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    apint_bitwise_into(dst, a, b, BITWISE_XOR);
+}
+
+// ~a = -a - 1
+void apint_not_into(ApInt *dst, const ApInt *a) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    STAT_CALL(APINT_STAT_BITWISE, an);
+    if (a->flags == 1) { // |a| - 1, never negative
+        apint_reserve(dst, an);
+        mpn_sub_1(dst->data, a->data, an, 1);
+        apint_finish(dst, an, 0);
+    } else { // -(a + 1)
+        apint_reserve(dst, an + 1);
+        dst->data[an] = mpn_add_1(dst->data, a->data, an, 1);
+        apint_finish(dst, an + 1, 1);
+    }
+}
+
+ApInt *apint_and(const ApInt *a, const ApInt *b) {
+    ApInt *r = apint_new(a->len > b->len ? a->len + 1 : b->len + 1);
+    apint_and_into(r, a, b);
+    return r;
+}
+
+ApInt *apint_or(const ApInt *a, const ApInt *b) {
+    ApInt *r = apint_new(a->len > b->len ? a->len + 1 : b->len + 1);
+    apint_or_into(r, a, b);
+    return r;
+}
+
+ApInt *apint_xor(const ApInt *a, const ApInt *b) {
+    ApInt *r = apint_new(a->len > b->len ? a->len + 1 : b->len + 1);
+    apint_xor_into(r, a, b);
+    return r;
+}
+
+ApInt *apint_not(const ApInt *a) {
+    ApInt *r = apint_new(a->len + 1);
+    apint_not_into(r, a);
+    return r;
+}
+
+size_t apint_popcount(const ApInt *ap) {
+    if (apint_is_negative(ap)) { // infinitely many ones
+        return SIZE_MAX;
+    }
+    return kernels.popcount(ap->data, ap->len);
+}
+
+// the same for a and -a, since -m = ~m + 1 keeps m's low zeros
+size_t apint_ctz(const ApInt *ap) {
+    for (size_t i = 0; i < ap->len; i++) {
+        if (ap->data[i] != 0) {
+            return 64 * i + __builtin_ctzll(ap->data[i]);
+        }
+    }
+    return SIZE_MAX;
+}
+
+int apint_test_bit(const ApInt *ap, size_t bit) {
+    size_t i = bit / 64;
+    int mag = i < ap->len ? (ap->data[i] >> (bit % 64)) & 1 : 0;
+    if (!apint_is_negative(ap)) {
+        return mag;
+    }
+    // -m: zeros below m's lowest 1, that 1, then m's bits inverted
+    size_t low = apint_ctz(ap);
+    return bit < low ? 0 : bit == low ? 1 : !mag;
+}
+
+int apint_set_bit(ApInt *ap, size_t bit) {
+    size_t i = bit / 64;
+    uint64_t mask = 1UL << (bit % 64);
+    if (apint_is_negative(ap)) {
+        if (!apint_test_bit(ap, bit)) { // the bit is 0 only inside m, so m - 2^bit > 0
+            mpn_sub_1(ap->data + i, ap->data + i, ap->len - i, mask);
+            apint_finish(ap, ap->len, 1);
+        }
+        return APINT_OK;
+    }
+    if (i >= ap->len) {
+        if (i >= UINT32_MAX) { // more limbs than len can count
+            return APINT_ERR_RANGE;
+        }
+        apint_reserve(ap, i + 1);
+        mpn_zero(ap->data + ap->len, i + 1 - ap->len);
+        ap->len = i + 1;
+    }
+    ap->data[i] |= mask;
+    ap->flags = 0;
+    return APINT_OK;
+}
+
+/*
+ * Modular exponentiation
+ *
+ * Odd moduli use Montgomery multiplication with R = 2^(64n): values are
+ * kept as aR mod m, and a product of two of them is brought back to
+ * that form by adding the multiple of m that clears its low n limbs,
+ * one limb at a time, then dropping those limbs instead of dividing.
+ * Even moduli have no such multiple and divide after every product.
+ */
+
+struct ApIntMontCtx {
+    size_t n;      // limbs in the modulus
+    uint64_t minv; // -m^-1 mod 2^64, 0 for an even modulus
+    uint64_t *mp;  // |modulus|
+    uint64_t *one; // R mod m, or 1 for an even modulus
+    uint64_t *r2;  // R^2 mod m, for converting into Montgomery form
+};
+
+ApIntMontCtx *apint_mont_create(const ApInt *mod) {
+    size_t n = mpn_normalized_size(mod->data, mod->len);
+    if (n == 0) {
+        return NULL;
+    }
+    ApIntMontCtx *ctx = (ApIntMontCtx*)mem_alloc(sizeof(ApIntMontCtx));
+    ctx->n = n;
+    ctx->mp = limbs_alloc(3 * n);
+    ctx->one = ctx->mp + n;
+    ctx->r2 = ctx->one + n;
+    mpn_copy(ctx->mp, mod->data, n);
+    mpn_zero(ctx->one, n);
+    mpn_zero(ctx->r2, n);
+    if ((ctx->mp[0] & 1) == 0) {
+        ctx->minv = 0;
+        ctx->one[0] = 1; // m >= 2
+        return ctx;
+    }
+    uint64_t inv = ctx->mp[0]; // Newton's iteration for m^-1 mod 2^64, as in ntt_prime_init
+    for (int k = 0; k < 5; k++) {
+        inv *= 2 - ctx->mp[0] * inv;
+    }
+    ctx->minv = -inv;
+    uint64_t *t = limbs_alloc(3 * n + 3); // 2^(128n) and the quotient
+    uint64_t *q = t + 2 * n + 1;
+    mpn_zero(t, 2 * n);
+    t[2 * n] = 1;
+    mpn_tdiv_qr(q, ctx->r2, t, 2 * n + 1, ctx->mp, n);
+    mpn_zero(t, n);
+    t[n] = 1;
+    mpn_tdiv_qr(q, ctx->one, t, n + 1, ctx->mp, n);
+    limbs_free(t, 3 * n + 3);
+    return ctx;
+}
+
+void apint_mont_destroy(ApIntMontCtx *ctx) {
+    limbs_free(ctx->mp, 3 * ctx->n);
+    mem_free(ctx, sizeof(ApIntMontCtx));
+}
+
+// r = cnd ? a : r, without a branch on cnd
+static void mpn_cnd_copy(uint64_t *rp, const uint64_t *ap, size_t n, uint64_t cnd) {
+    uint64_t mask = -(uint64_t)(cnd != 0);
+    for (size_t i = 0; i < n; i++) {
+        rp[i] = (rp[i] & ~mask) | (ap[i] & mask);
+    }
+}
+
+// r = t / R mod m for t < mR; t has 2n limbs and is destroyed.  No branches on the data.
+static void mont_redc(uint64_t *rp, uint64_t *tp, const ApIntMontCtx *ctx) {
+    size_t n = ctx->n;
+    for (size_t i = 0; i < n; i++) { // clears t[i], which then holds the carry owed to t[i + n]
+        tp[i] = mpn_addmul_1(tp + i, ctx->mp, n, tp[i] * ctx->minv);
+    }
+    uint64_t carry = mpn_add_n(rp, tp + n, tp, n);
+    uint64_t borrow = mpn_sub_n(tp, rp, ctx->mp, n);
+    mpn_cnd_copy(rp, tp, n, carry == borrow); // r < 2m, so this is r >= m
+}
+
+/*
+ * r = a * b in the context's form, for a, b < m; r may be a or b.  tp
+ * has 3n + 1 limbs.  sec keeps to the schoolbook product and square,
+ * whose kernels have no data-dependent branches (Karatsuba compares
+ * halves).
+ */
+static void mont_mul(uint64_t *rp, const uint64_t *ap, const uint64_t *bp, const ApIntMontCtx *ctx, uint64_t *tp, int sec) {
+    size_t n = ctx->n;
+    if (sec && ap == bp) { // whether a step squares does not depend on the exponent
+        mpn_sqr_basecase(tp, ap, n);
+    } else if (sec) {
+        mpn_mul_basecase(tp, ap, n, bp, n);
+    } else {
+        mpn_mul_n(tp, ap, bp, n);
+    }
+    if (ctx->minv != 0) {
+        mont_redc(rp, tp, ctx);
+    } else {
+        mpn_tdiv_qr(tp + 2 * n, rp, tp, 2 * n, ctx->mp, n);
+    }
+}
+
+// r = base mod m in the context's form, in [0, m) whatever base's sign; tp has 3n + 1 limbs
+static void mont_from_apint(uint64_t *rp, const ApInt *base, const ApIntMontCtx *ctx, uint64_t *tp) {
+    size_t n = ctx->n;
+    size_t bn = mpn_normalized_size(base->data, base->len);
+    if (bn >= n) {
+        uint64_t *q = limbs_alloc(bn - n + 1);
+        mpn_tdiv_qr(q, rp, base->data, bn, ctx->mp, n);
+        limbs_free(q, bn - n + 1);
+    } else {
+        mpn_copy(rp, base->data, bn);
+        mpn_zero(rp + bn, n - bn);
+    }
+    if (base->flags == 1 && mpn_normalized_size(rp, n) != 0) {
+        mpn_sub_n(rp, ctx->mp, rp, n);
+    }
+    if (ctx->minv != 0) {
+        mont_mul(rp, rp, ctx->r2, ctx, tp, 0);
+    }
+}
+
+// bits [lo, lo + w) of e, for w < 64; zero past its en limbs
+static uint64_t mpn_get_bits(const uint64_t *ep, size_t en, size_t lo, unsigned w) {
+    size_t i = lo / 64;
+    unsigned s = lo % 64;
+    uint64_t v = i < en ? ep[i] >> s : 0;
+    if (s + w > 64 && i + 1 < en) {
+        v |= ep[i + 1] << (64 - s);
+    }
+    return v & ((1UL << w) - 1);
+}
+
+// window width for an exponent of this many bits
+static unsigned powmod_window(size_t bits) {
+    return bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4 : bits > 23 ? 3 : 1;
+}
+
+// limbs of scratch mont_powmod needs for an exponent of this many bits
+static size_t mont_powmod_scratch(size_t n, size_t bits) {
+    return ((size_t)1 << (powmod_window(bits) - 1)) * n + 4 * n + 1;
+}
+
+/*
+ * r = b^e with a sliding window: runs of zero bits cost one squaring
+ * each, and every window starts and ends on a 1 bit, so only the odd
+ * powers b, b^3, ..., b^(2^w - 1) are tabulated.  en > 0 limbs,
+ * normalized; table has mont_powmod_scratch limbs for e's bits.
+ */
+static void mont_powmod(uint64_t *rp, const uint64_t *bp, const uint64_t *ep, size_t en, const ApIntMontCtx *ctx, uint64_t *table) {
+    size_t n = ctx->n;
+    size_t bits = 64 * en - __builtin_clzll(ep[en - 1]);
+    unsigned w = powmod_window(bits);
+    uint64_t *b2 = table + ((size_t)1 << (w - 1)) * n;
+    uint64_t *tp = b2 + n;
+    mpn_copy(table, bp, n);
+    if (w > 1) {
+        mont_mul(b2, bp, bp, ctx, tp, 0);
+        for (size_t k = 1; k < ((size_t)1 << (w - 1)); k++) {
+            mont_mul(table + k * n, table + (k - 1) * n, b2, ctx, tp, 0);
+        }
+    }
+    size_t i = bits; // bits at and above i are done
+    int first = 1;
+    while (i > 0) {
+        if (mpn_get_bits(ep, en, i - 1, 1) == 0) { // the top bit is 1, so never first
+            mont_mul(rp, rp, rp, ctx, tp, 0);
+            i--;
+            continue;
+        }
+        size_t j = i > w ? i - w : 0; // the window is bits [j, i), trimmed to end on a 1
+        while (mpn_get_bits(ep, en, j, 1) == 0) {
+            j++;
+        }
+        const uint64_t *entry = table + (mpn_get_bits(ep, en, j, i - j) >> 1) * n;
+        if (first) {
+            mpn_copy(rp, entry, n);
+            first = 0;
+        } else {
+            for (size_t s = j; s < i; s++) {
+                mont_mul(rp, rp, rp, ctx, tp, 0);
+            }
+            mont_mul(rp, rp, entry, ctx, tp, 0);
+        }
+        i = j;
+    }
+}
+
+// r = table[k], reading every entry so the access pattern does not depend on k
+static void mpn_sec_tabselect(uint64_t *rp, const uint64_t *table, size_t n, size_t entries, size_t k) {
+    mpn_zero(rp, n);
+    for (size_t e = 0; e < entries; e++) {
+        uint64_t mask = -(uint64_t)(e == k);
+        for (size_t i = 0; i < n; i++) {
+            rp[i] |= table[e * n + i] & mask;
+        }
+    }
+}
+
+/*
+ * r = b^e with a fixed window over all 64 en bits, for secret e: every
+ * window costs w squarings and one multiplication (by b^0 for a zero
+ * window), table lookups touch the whole table, and the Montgomery
+ * product has no data-dependent branches.  Only en shows in the timing.
+ */
+static void mont_powmod_sec(uint64_t *rp, const uint64_t *bp, const uint64_t *ep, size_t en, const ApIntMontCtx *ctx) {
+    size_t n = ctx->n;
+    size_t bits = 64 * en;
+    unsigned w = powmod_window(bits);
+    size_t entries = (size_t)1 << w;
+    size_t tn = entries * n + 4 * n + 1;
+    uint64_t *table = limbs_alloc(tn);
+    uint64_t *sel = table + entries * n;
+    uint64_t *tp = sel + n;
+    mpn_copy(table, ctx->one, n);
+    for (size_t k = 1; k < entries; k++) {
+        mont_mul(table + k * n, table + (k - 1) * n, bp, ctx, tp, 1);
+    }
+    size_t i = bits - (bits % w == 0 ? w : bits % w);
+    mpn_sec_tabselect(rp, table, n, entries, mpn_get_bits(ep, en, i, bits - i));
+    while (i > 0) {
+        i -= w;
+        for (unsigned s = 0; s < w; s++) {
+            mont_mul(rp, rp, rp, ctx, tp, 1);
+        }
+        mpn_sec_tabselect(sel, table, n, entries, mpn_get_bits(ep, en, i, w));
+        mont_mul(rp, rp, sel, ctx, tp, 1);
+    }
+    limbs_free(table, tn);
+}
+
+// bits in the exponent of a non-secret powmod, as mont_powmod_scratch takes them
+static size_t powmod_exp_bits(const ApInt *exp) {
+    size_t en = mpn_normalized_size(exp->data, exp->len);
+    return en > 0 ? 64 * en - __builtin_clzll(exp->data[en - 1]) : 0;
+}
+
+// limbs of scratch mont_powmod_into needs for exponents of up to this many bits (0 when sec)
+static size_t mont_powmod_into_scratch(size_t n, size_t bits) {
+    return 2 * n + (bits > 0 ? mont_powmod_scratch(n, bits) : 3 * n + 1);
+}
+
+// scratch is NULL, or mont_powmod_into_scratch limbs for exp, which apint_powmod_batch shares
+static int mont_powmod_into(ApInt *dst, const ApInt *base, const ApInt *exp, const ApIntMontCtx *ctx, int sec, uint64_t *scratch) {
+    if (apint_is_negative(exp) || (sec && ctx->minv == 0)) {
+        return APINT_ERR_INVALID;
+    }
+    size_t n = ctx->n;
+    size_t en = sec ? exp->len : mpn_normalized_size(exp->data, exp->len);
+    STAT_CALL(APINT_STAT_POWMOD, n);
+    STAT_ALGO(ctx->minv != 0 ? APINT_ALGO_POWMOD_MONT : APINT_ALGO_POWMOD_DIV);
+    size_t sn = mont_powmod_into_scratch(n, sec ? 0 : powmod_exp_bits(exp));
+    uint64_t *x = scratch != NULL ? scratch : limbs_alloc(sn);
+    uint64_t *b = x + n;
+    uint64_t *tp = b + n; // for mont_from_apint, the table, and leaving Montgomery form
+    mont_from_apint(b, base, ctx, tp);
+    if (en == 0) {
+        mpn_copy(x, ctx->one, n);
+    } else if (sec) {
+        mont_powmod_sec(x, b, exp->data, en, ctx);
+    } else {
+        mont_powmod(x, b, exp->data, en, ctx, tp);
+    }
+    if (ctx->minv != 0) {
+        mpn_copy(tp, x, n);
+        mpn_zero(tp + n, n);
+        mont_redc(x, tp, ctx);
+    }
+    apint_reserve(dst, n);
+    mpn_copy(dst->data, x, n);
+    apint_finish(dst, n, 0);
+    if (scratch == NULL) {
+        limbs_free(x, sn);
+    }
+    return APINT_OK;
+}
+
+int apint_mont_powmod_into(ApInt *dst, const ApInt *base, const ApInt *exp, const ApIntMontCtx *ctx) {
+    return mont_powmod_into(dst, base, exp, ctx, 0, NULL);
+}
+
+int apint_mont_powmod_sec_into(ApInt *dst, const ApInt *base, const ApInt *exp, const ApIntMontCtx *ctx) {
+    return mont_powmod_into(dst, base, exp, ctx, 1, NULL);
+}
+
+int apint_powmod_into(ApInt *dst, const ApInt *base, const ApInt *exp, const ApInt *mod) {
+    ApIntMontCtx *ctx = apint_mont_create(mod);
+    if (ctx == NULL) {
+        return APINT_ERR_DIVZERO;
+    }
+    int status = mont_powmod_into(dst, base, exp, ctx, 0, NULL);
+    apint_mont_destroy(ctx);
+    return status;
+}
+
+ApInt *apint_powmod(const ApInt *base, const ApInt *exp, const ApInt *mod) {
+    ApInt *r = apint_new(mod->len);
+    if (apint_powmod_into(r, base, exp, mod) != APINT_OK) {
+        apint_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+/*
+ * Greatest common divisor
+ *
+ * Values of up to two limbs use the binary algorithm: strip the common
+ * factors of two with ctz, then keep subtracting the smaller odd value
+ * from the larger and stripping again.  Longer ones use Lehmer's
+ * algorithm with two-limb leading digits (Knuth's Algorithm L): the
+ * Euclidean quotients of the top 126 bits, for as long as they are sure
+ * to be those of the full values, are collected into a matrix of
+ * single-limb cofactors that is applied to the full values in one pass,
+ * about 62 bits of reduction at a time.  From APINT_TUNE_GCD_HGCD limbs
+ * the half-gcd takes over: it halves a pair by recursing twice on top
+ * halves, so the matrices are built and applied by the subquadratic
+ * multiplication and the whole gcd costs O(M(n) log n).
+ *
+ * Every step is a matrix of determinant +-1, which keeps the gcd even
+ * when the quotients of top halves turn out wrong for the full values;
+ * a value left negative just has its row negated.  apint_gcdext carries
+ * the cofactor of a through the same steps and divides for b's at the
+ * end.
+ */
+
+// the binary algorithm on single limbs
+static uint64_t gcd_1(uint64_t u, uint64_t v) {
+    if (u == 0 || v == 0) {
+        return u | v;
+    }
+    unsigned k = __builtin_ctzll(u | v);
+    u >>= __builtin_ctzll(u);
+    do {
+        v >>= __builtin_ctzll(v);
+        if (u > v) {
+            uint64_t t = u;
+            u = v;
+            v = t;
+        }
+        v -= u;
+    } while (v != 0);
+    return u << k;
+}
+
+static unsigned ctz_2(u128 v) {
+    uint64_t lo = (uint64_t)v;
+    return lo != 0 ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((uint64_t)(v >> 64));
+}
+
+// and on two limbs, down to gcd_1 once both values fit in one
+static u128 gcd_2(u128 u, u128 v) {
+    if (u == 0 || v == 0) {
+        return u | v;
+    }
+    unsigned k = ctz_2(u | v);
+    u >>= ctz_2(u);
+    v >>= ctz_2(v);
+    while ((u >> 64) != 0 || (v >> 64) != 0) {
+        if (u > v) {
+            u128 t = u;
+            u = v;
+            v = t;
+        }
+        v -= u;
+        if (v == 0) {
+            return u << k;
+        }
+        v >>= ctz_2(v);
+    }
+    return (u128)gcd_1((uint64_t)u, (uint64_t)v) << k;
+}
+
+// a zero ApInt for use inside a function, its limbs released with apint_free_data
+static void apint_init_temp(ApInt *ap) {
+    ap->len = 1;
+    ap->cap = APINT_INLINE_LIMBS;
+    ap->flags = 0;
+    ap->data = ap->small;
+    ap->arena = NULL;
+    ap->small[0] = 0;
+}
+
+// exchanges two values, inline limbs included
+static void apint_swap(ApInt *a, ApInt *b) {
+    ApInt t = *a;
+    *a = *b;
+    *b = t;
+    if (a->data == b->small) {
+        a->data = a->small;
+    }
+    if (b->data == a->small) {
+        b->data = b->small;
+    }
+}
+
+static size_t apint_bits(const ApInt *ap) {
+    size_t n = mpn_normalized_size(ap->data, ap->len);
+    return n == 0 ? 0 : 64 * n - __builtin_clzll(ap->data[n - 1]);
+}
+
+// dst = p P - q Q for single limbs p and q; dst must not be P or Q
+static void apint_lincomb_1(ApInt *dst, const ApInt *P, uint64_t p, const ApInt *Q, uint64_t q) {
+    size_t pn = mpn_normalized_size(P->data, P->len);
+    size_t qn = mpn_normalized_size(Q->data, Q->len);
+    size_t n = (pn > qn ? pn : qn) + 2;
+    uint32_t flags = P->flags;
+    apint_reserve(dst, n);
+    uint64_t *rp = dst->data;
+    mpn_zero(rp, n);
+    if (pn > 0) {
+        rp[pn] = mpn_mul_1(rp, P->data, pn, p);
+    }
+    if (qn > 0 && P->flags != Q->flags) { // p P and -q Q have the same sign
+        mpn_add_1(rp + qn, rp + qn, n - qn, mpn_addmul_1(rp, Q->data, qn, q));
+    } else if (qn > 0 && mpn_sub_1(rp + qn, rp + qn, n - qn, mpn_submul_1(rp, Q->data, qn, q))) {
+        mpn_neg(rp, rp, n);
+        flags ^= 1;
+    }
+    apint_finish(dst, n, flags);
+}
+
+/*
+ * A pair x >= y >= 0 being reduced, and up to two columns carried along:
+ * each step takes (u[j], v[j]) by the same matrix as (x, y).  Everything
+ * lives in the state, so steps trade values with apint_swap.
+ */
+typedef struct {
+    ApInt x, y;
+    ApInt u[2], v[2];
+    int cols;
+    ApInt t, w; // scratch
+} GcdState;
+
+static void gcd_state_init(GcdState *g, int cols) {
+    apint_init_temp(&g->x);
+    apint_init_temp(&g->y);
+    for (int j = 0; j < 2; j++) {
+        apint_init_temp(&g->u[j]);
+        apint_init_temp(&g->v[j]);
+    }
+    apint_init_temp(&g->t);
+    apint_init_temp(&g->w);
+    g->cols = cols;
+}
+
+static void gcd_state_clear(GcdState *g) {
+    apint_free_data(&g->x);
+    apint_free_data(&g->y);
+    for (int j = 0; j < 2; j++) {
+        apint_free_data(&g->u[j]);
+        apint_free_data(&g->v[j]);
+    }
+    apint_free_data(&g->t);
+    apint_free_data(&g->w);
+}
+
+// columns = identity, so they end up holding the matrix of the steps taken
+static void gcd_state_identity(GcdState *g) {
+    apint_set_u64(&g->u[0], 1UL);
+    apint_set_u64(&g->u[1], 0UL);
+    apint_set_u64(&g->v[0], 0UL);
+    apint_set_u64(&g->v[1], 1UL);
+}
+
+static int apint_is_u64(const ApInt *ap, uint64_t v) {
+    return mpn_normalized_size(ap->data, ap->len) <= 1 && ap->data[0] == v && (v == 0 || ap->flags == 0);
+}
+
+static int gcd_is_identity(const GcdState *g) {
+    return apint_is_u64(&g->u[0], 1) && apint_is_u64(&g->u[1], 0) && apint_is_u64(&g->v[0], 0) && apint_is_u64(&g->v[1], 1);
+}
+
+// (x, y) = (y, x mod y) and (u, v) = (v, u - q v)
+static void gcd_divide(GcdState *g) {
+    apint_divmod_into(&g->t, &g->w, &g->x, &g->y);
+    apint_swap(&g->x, &g->y);
+    apint_swap(&g->y, &g->w);
+    for (int j = 0; j < g->cols; j++) {
+        apint_submul_into(&g->u[j], &g->t, &g->v[j]);
+        apint_swap(&g->u[j], &g->v[j]);
+    }
+}
+
+/*
+ * Cofactor magnitudes of a Lehmer matrix, whose signs alternate: the
+ * step takes (X, Y) to (a X - b Y, d Y - c X), or to (b Y - a X,
+ * c X - d Y) after an odd number of quotients.
+ */
+typedef struct {
+    uint64_t a, b, c, d;
+    int odd;
+} LehmerMat;
+
+static void lehmer_apply(ApInt *X, ApInt *Y, const LehmerMat *m, ApInt *t, ApInt *w) {
+    if (!m->odd) {
+        apint_lincomb_1(t, X, m->a, Y, m->b);
+        apint_lincomb_1(w, Y, m->d, X, m->c);
+    } else {
+        apint_lincomb_1(t, Y, m->b, X, m->a);
+        apint_lincomb_1(w, X, m->c, Y, m->d);
+    }
+    apint_swap(X, t);
+    apint_swap(Y, w);
+}
+
+static void lehmer_quotient(LehmerMat *m, uint64_t q) {
+    uint64_t t = m->a + q * m->c;
+    m->a = m->c;
+    m->c = t;
+    t = m->b + q * m->d;
+    m->b = m->d;
+    m->d = t;
+    m->odd ^= 1;
+}
+
+// limb i of a value of n limbs, 0 past either end
+static inline uint64_t limb_or_zero(const uint64_t *p, size_t n, size_t i) {
+    return i < n ? p[i] : 0;
+}
+
+/*
+ * Euclid on the leading bits of x >= y: x' and y', x and y cut to the
+ * bits below the top 126 of x.  With cofactors signed as in LehmerMat,
+ * the remainders of the full values are those of x' and y' scaled up,
+ * give or take the cofactors, so a quotient is taken only if the new y'
+ * is at least its row's negative cofactor and x' - y' at least the two
+ * rows' negative cofactors (Jebelean's condition): then the full values
+ * stay ordered and non-negative.  Remainders of 64 bits or more keep the
+ * cofactors below 2^62.  Returns 0 if not even one quotient is certain.
+ */
+static int lehmer_matrix(LehmerMat *m, const ApInt *x, const ApInt *y) {
+    size_t xn = mpn_normalized_size(x->data, x->len);
+    size_t yn = mpn_normalized_size(y->data, y->len);
+    unsigned s = __builtin_clzll(x->data[xn - 1]);
+    u128 xh = (u128)x->data[xn - 1] << 64 | limb_or_zero(x->data, xn, xn - 2);
+    u128 yh = (u128)limb_or_zero(y->data, yn, xn - 1) << 64 | limb_or_zero(y->data, yn, xn - 2);
+    if (s > 0) {
+        xh = xh << s | limb_or_zero(x->data, xn, xn - 3) >> (64 - s);
+        yh = yh << s | limb_or_zero(y->data, yn, xn - 3) >> (64 - s);
+    }
+    xh >>= 2;
+    yh >>= 2;
+    uint64_t a = 1, b = 0, cc = 0, d = 1;
+    int odd = 0;
+    while ((yh >> 64) != 0) {
+        u128 q = 1, r = xh - yh;
+        if (r >= yh) { // quotients of 1 and 2 are most of them
+            q = 2;
+            r -= yh;
+        }
+        if (r >= yh) { // a double is within one of the rest, but for huge ones
+            double qd = ((double)(uint64_t)(xh >> 64) * 0x1p64 + (double)(uint64_t)xh)
+                      / ((double)(uint64_t)(yh >> 64) * 0x1p64 + (double)(uint64_t)yh);
+            q = qd < 0x1p50 ? (uint64_t)qd : xh / yh;
+            while (q * yh > xh) {
+                q--;
+            }
+            r = xh - q * yh;
+            while (r >= yh) {
+                q++;
+                r -= yh;
+            }
+        }
+        uint64_t nc = a + (uint64_t)q * cc, nd = b + (uint64_t)q * d; // the cofactors of r
+        if (odd ? r < nc || yh - r < d + nd : r < nd || yh - r < cc + nc) {
+            break;
+        }
+        a = cc;
+        b = d;
+        cc = nc;
+        d = nd;
+        odd ^= 1;
+        xh = yh;
+        yh = r;
+    }
+    *m = (LehmerMat){ a, b, cc, d, odd };
+    return m->b != 0;
+}
+
+// the rest of the Euclidean algorithm on one-limb x >= y > 0, as one matrix
+static void lehmer_matrix_1(LehmerMat *m, uint64_t x, uint64_t y) {
+    *m = (LehmerMat){ 1, 0, 0, 1, 0 };
+    while (y != 0) {
+        uint64_t q = x / y, r = x - q * y;
+        lehmer_quotient(m, q);
+        x = y;
+        y = r;
+    }
+}
+
+static void gcd_apply_lehmer(GcdState *g, const LehmerMat *m) {
+    lehmer_apply(&g->x, &g->y, m, &g->t, &g->w);
+    for (int j = 0; j < g->cols; j++) {
+        lehmer_apply(&g->u[j], &g->v[j], m, &g->t, &g->w);
+    }
+}
+
+// one Lehmer matrix, or a division when the top bits settle no quotient
+static void gcd_lehmer_step(GcdState *g) {
+    LehmerMat m;
+    if (!lehmer_matrix(&m, &g->x, &g->y)) {
+        gcd_divide(g);
+        return;
+    }
+    STAT_ALGO(APINT_ALGO_GCD_LEHMER);
+    gcd_apply_lehmer(g, &m);
+}
+
+// (X, Y) = R (X, Y) for the matrix R held in h's columns
+static void gcd_apply_matrix(ApInt *X, ApInt *Y, const GcdState *h, ApInt *t, ApInt *w) {
+    apint_mul_into(t, &h->u[0], X);
+    apint_addmul_into(t, &h->u[1], Y);
+    apint_mul_into(w, &h->v[0], X);
+    apint_addmul_into(w, &h->v[1], Y);
+    apint_swap(X, t);
+    apint_swap(Y, w);
+}
+
+// x >= y >= 0 again after a matrix from top halves, by negating or swapping rows
+static void gcd_normalize(GcdState *g) {
+    if (g->x.flags == 1) {
+        apint_negate_into(&g->x, &g->x);
+        for (int j = 0; j < g->cols; j++) {
+            apint_negate_into(&g->u[j], &g->u[j]);
+        }
+    }
+    if (g->y.flags == 1) {
+        apint_negate_into(&g->y, &g->y);
+        for (int j = 0; j < g->cols; j++) {
+            apint_negate_into(&g->v[j], &g->v[j]);
+        }
+    }
+    if (apint_compare(&g->x, &g->y) < 0) {
+        apint_swap(&g->x, &g->y);
+        for (int j = 0; j < g->cols; j++) {
+            apint_swap(&g->u[j], &g->v[j]);
+        }
+    }
+}
+
+static void gcd_half(GcdState *g);
+
+// the low k bits of ap >= 0, in place
+static void gcd_low_bits(ApInt *ap, size_t k) {
+    size_t n = (k + 63) / 64;
+    if (n == 0) {
+        apint_set_u64(ap, 0UL);
+        return;
+    }
+    if (n > ap->len) {
+        return;
+    }
+    if (k % 64 != 0) {
+        ap->data[n - 1] &= (1UL << (k % 64)) - 1;
+    }
+    apint_finish(ap, n, 0);
+}
+
+// X += T 2^k
+static void gcd_add_shifted(ApInt *X, const ApInt *T, size_t k, ApInt *t) {
+    apint_lshift_bits_into(t, T, k);
+    apint_add_into(X, X, t);
+}
+
+/*
+ * Reduces (x >> k, y >> k) in h and applies the matrix that took to g.
+ * R (x, y) is R (x >> k, y >> k) 2^k, which h already holds, plus R
+ * applied to the low k bits, so only those are multiplied.
+ */
+static void gcd_half_top(GcdState *g, GcdState *h, size_t k) {
+    apint_rshift_bits_into(&h->x, &g->x, k);
+    apint_rshift_bits_into(&h->y, &g->y, k);
+    gcd_state_identity(h);
+    gcd_half(h);
+    gcd_low_bits(&g->x, k);
+    gcd_low_bits(&g->y, k);
+    gcd_apply_matrix(&g->x, &g->y, h, &g->t, &g->w);
+    gcd_add_shifted(&g->x, &h->x, k, &g->t);
+    gcd_add_shifted(&g->y, &h->y, k, &g->t);
+    if (g->cols == 2 && gcd_is_identity(g)) { // R I is just R
+        for (int j = 0; j < 2; j++) {
+            apint_swap(&g->u[j], &h->u[j]);
+            apint_swap(&g->v[j], &h->v[j]);
+        }
+    } else {
+        for (int j = 0; j < g->cols; j++) {
+            gcd_apply_matrix(&g->u[j], &g->v[j], h, &g->t, &g->w);
+        }
+    }
+    gcd_normalize(g);
+}
+
+/*
+ * Half-gcd: reduces x >= y until y has at most h = bits(x) / 2 bits.
+ * The first recursion reduces the top n - h bits to about half that,
+ * which brings the full pair to about 3n/4 bits; after one division the
+ * second starts from the top 2(bits(x) - h) bits, which brings it to h.
+ * The few steps short of h that the top bits could not see are taken
+ * one at a time.
+ */
+static void gcd_half(GcdState *g) {
+    size_t h = apint_bits(&g->x) / 2;
+    if (apint_bits(&g->y) <= h) {
+        return;
+    }
+    if (mpn_normalized_size(g->x.data, g->x.len) < tune_params[APINT_TUNE_GCD_HGCD]) {
+        while (apint_bits(&g->y) > h) {
+            gcd_lehmer_step(g);
+        }
+        return;
+    }
+    STAT_ALGO(APINT_ALGO_GCD_HGCD);
+    GcdState sub;
+    gcd_state_init(&sub, 2);
+    gcd_half_top(g, &sub, h);
+    if (apint_bits(&g->y) > h) {
+        gcd_divide(g);
+    }
+    if (apint_bits(&g->y) > h) {
+        size_t n = apint_bits(&g->x);
+        gcd_half_top(g, &sub, n < 2 * h ? 2 * h - n : 0);
+    }
+    while (apint_bits(&g->y) > h) {
+        gcd_lehmer_step(g);
+    }
+    gcd_state_clear(&sub);
+}
+
+// reduces x >= y >= 0 until y is zero, leaving the gcd in x
+static void gcd_reduce(GcdState *g) {
+    for (;;) {
+        size_t xn = mpn_normalized_size(g->x.data, g->x.len);
+        size_t yn = mpn_normalized_size(g->y.data, g->y.len);
+        if (yn == 0) {
+            return;
+        }
+        if (xn <= 2 && g->cols == 0) {
+            STAT_ALGO(APINT_ALGO_GCD_BINARY);
+            u128 r = gcd_2((u128)limb_or_zero(g->x.data, xn, 1) << 64 | g->x.data[0],
+                           (u128)limb_or_zero(g->y.data, yn, 1) << 64 | g->y.data[0]);
+            apint_reserve(&g->x, 2);
+            g->x.data[0] = (uint64_t)r;
+            g->x.data[1] = (uint64_t)(r >> 64);
+            apint_finish(&g->x, 2, 0);
+            apint_set_u64(&g->y, 0UL);
+            return;
+        }
+        if (xn == 1) {
+            LehmerMat m;
+            lehmer_matrix_1(&m, g->x.data[0], g->y.data[0]);
+            gcd_apply_lehmer(g, &m);
+            return;
+        }
+        if (xn >= tune_params[APINT_TUNE_GCD_HGCD] && 2 * apint_bits(&g->y) > apint_bits(&g->x)) {
+            gcd_half(g);
+        } else {
+            gcd_lehmer_step(g);
+        }
+    }
+}
+
+// g->x = |a|, g->y = |b|, ordered, with u[0] and v[0] the cofactors of |a|
+static void gcd_start(GcdState *g, const ApInt *a, const ApInt *b) {
+    apint_set(&g->x, a);
+    apint_set(&g->y, b);
+    g->x.flags = 0;
+    g->y.flags = 0;
+    apint_set_u64(&g->u[0], 1UL);
+    apint_set_u64(&g->v[0], 0UL);
+    if (apint_compare(&g->x, &g->y) < 0) {
+        apint_swap(&g->x, &g->y);
+        apint_swap(&g->u[0], &g->v[0]);
+    }
+}
+
+void apint_gcd_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    STAT_CALL(APINT_STAT_GCD, a->len > b->len ? a->len : b->len);
+    GcdState g;
+    gcd_state_init(&g, 0);
+    gcd_start(&g, a, b);
+    gcd_reduce(&g);
+    apint_set(dst, &g.x);
+    gcd_state_clear(&g);
+}
+
+void apint_gcdext_into(ApInt *g, ApInt *s, ApInt *t, const ApInt *a, const ApInt *b) {
+    STAT_CALL(APINT_STAT_GCD, a->len > b->len ? a->len : b->len);
+    GcdState st;
+    gcd_state_init(&st, 1);
+    gcd_start(&st, a, b);
+    gcd_reduce(&st);
+    // st.x = gcd, st.u[0] its cofactor of |a|; the rest of st is scratch from here
+    ApInt *gcd = &st.x, *sa = &st.u[0], *bg = &st.y, *r = &st.v[0];
+    uint32_t aflags = apint_is_zero(a) ? 0 : a->flags;
+    if (apint_is_zero(gcd)) {
+        apint_set_u64(sa, 0UL);
+    } else if (apint_is_zero(b)) {
+        apint_set_u64(sa, 1UL);
+        apint_finish(sa, 1, aflags);
+    } else { // bring sa into (-|b|/2g, |b|/2g]
+        sa->flags ^= aflags;
+        apint_divmod_into(bg, NULL, b, gcd);
+        bg->flags = 0;
+        apint_divmod_into(NULL, r, sa, bg);
+        if (r->flags == 1) {
+            apint_add_into(r, r, bg);
+        }
+        apint_lshift_bits_into(sa, r, 1);
+        if (apint_compare(sa, bg) > 0) {
+            apint_sub_into(r, r, bg);
+        }
+        apint_swap(sa, r);
+    }
+    if (t != NULL) { // t = (g - a s) / b, exact
+        apint_set(&st.w, gcd);
+        apint_submul_into(&st.w, a, sa);
+        if (apint_is_zero(b)) {
+            apint_set_u64(t, 0UL);
+        } else {
+            apint_divmod_into(t, NULL, &st.w, b);
+        }
+    }
+    if (s != NULL) {
+        apint_set(s, sa);
+    }
+    apint_set(g, gcd);
+    gcd_state_clear(&st);
+}
+
+int apint_invert_into(ApInt *dst, const ApInt *a, const ApInt *mod) {
+    if (apint_is_zero(mod)) {
+        return APINT_ERR_DIVZERO;
+    }
+    ApInt g, s;
+    apint_init_temp(&g);
+    apint_init_temp(&s);
+    apint_gcdext_into(&g, &s, NULL, a, mod);
+    int status = APINT_ERR_INVALID;
+    if (g.len == 1 && g.data[0] == 1) {
+        if (s.flags == 1) { // s + |mod|
+            if (mod->flags == 1) {
+                apint_sub_into(&s, &s, mod);
+            } else {
+                apint_add_into(&s, &s, mod);
+            }
+        }
+        apint_set(dst, &s);
+        status = APINT_OK;
+    }
+    apint_free_data(&g);
+    apint_free_data(&s);
+    return status;
+}
+
+ApInt *apint_gcd(const ApInt *a, const ApInt *b) {
+    ApInt *r = apint_new(a->len < b->len ? a->len : b->len);
+    apint_gcd_into(r, a, b);
+    return r;
+}
+
+ApInt *apint_gcdext(const ApInt *a, const ApInt *b, ApInt **s, ApInt **t) {
+    ApInt *g = apint_new(a->len < b->len ? a->len : b->len);
+    ApInt *sv = s != NULL ? apint_new(b->len) : NULL;
+    ApInt *tv = t != NULL ? apint_new(a->len) : NULL;
+    apint_gcdext_into(g, sv, tv, a, b);
+    if (s != NULL) {
+        *s = sv;
+    }
+    if (t != NULL) {
+        *t = tv;
+    }
+    return g;
+}
+
+ApInt *apint_invert(const ApInt *a, const ApInt *mod) {
+    ApInt *r = apint_new(mod->len);
+    if (apint_invert_into(r, a, mod) != APINT_OK) {
+        apint_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+/*
+ * Integer roots
+ *
+ * Square roots use Zimmermann's Karatsuba square root, which needs a
+ * half-size division and a quarter-size squaring per level.  Other roots
+ * use Newton's iteration r' = ((n - 1) r + a / r^(n-1)) / n, which from
+ * anywhere above the root stays at or above it and moves down to it.
+ * The start comes from the root of a >> ns, found the same way: plus one
+ * and shifted back up by s it is above the root by at most 2^s, and with
+ * s a little under half the root's bits one step leaves it at most one
+ * unit too large.  Either way each level works at twice the precision of
+ * the one below, so all of them cost a small multiple of the top one.
+ */
+
+// r^n > a for values of up to two limbs
+static int root_2_exceeds(u128 r, unsigned long n, u128 a) {
+    if (r <= 1) {
+        return r > a;
+    }
+    u128 p = r;
+    for (unsigned long i = 1; i < n; i++) {
+        if (__builtin_mul_overflow(p, r, &p) || p > a) {
+            return 1;
+        }
+    }
+    return p > a;
+}
+
+/*
+ * floor(a^(1/n)) for up to two limbs, from libm's estimate.  Past 2^53
+ * a square root estimate is only good to about 2^11, so it takes one
+ * Newton step first; the corrections are then a unit or two.
+ */
+static u128 root_2(u128 a, unsigned long n) {
+    double d = (double)(uint64_t)(a >> 64) * 0x1p64 + (double)(uint64_t)a;
+    double e = n == 2 ? sqrt(d) : pow(d, 1.0 / (double)n);
+    u128 r = e < 0x1p64 ? (uint64_t)e : UINT64_MAX;
+    if (n == 2 && r > (1UL << 26)) {
+        r = (r + a / r) / 2;
+    }
+    while (r > 0 && root_2_exceeds(r, n, a)) {
+        r--;
+    }
+    while (!root_2_exceeds(r + 1, n, a)) {
+        r++;
+    }
+    return r;
+}
+
+// dst = b^e for e >= 1, dst not b
+static void apint_pow_ui(ApInt *dst, const ApInt *b, unsigned long e) {
+    apint_set(dst, b);
+    for (int i = 62 - __builtin_clzl(e); i >= 0; i--) {
+        apint_sqr_into(dst, dst);
+        if ((e >> i) & 1) {
+            apint_mul_into(dst, dst, b);
+        }
+    }
+}
+
+/*
+ * s = floor(sqrt(a)) and r = a - s^2 for a >= 0.  With B = 2^l for l a
+ * quarter of a's bits, a = a3 B^3 + a2 B^2 + a1 B + a0 with a3 >= B and
+ * a2, a1, a0 < B.  From s' and r' for a3 B + a2, s = s' B + q with q the
+ * quotient and u the remainder of (r' B + a1) / 2s', and r = u B + a0 -
+ * q^2; q is at most one too large, which r < 0 shows.  s, r and a are
+ * distinct.
+ */
+static void sqrtrem_kara(ApInt *s, ApInt *r, const ApInt *a) {
+    size_t bits = apint_bits(a);
+    if (bits <= 128) {
+        u128 x = (u128)limb_or_zero(a->data, a->len, 1) << 64 | a->data[0];
+        u128 y = root_2(x, 2), rem = x - y * y; // below 2^65
+        apint_set_u64(s, (uint64_t)y);
+        apint_reserve(r, 2);
+        r->data[0] = (uint64_t)rem;
+        r->data[1] = (uint64_t)(rem >> 64);
+        apint_finish(r, 2, 0);
+        return;
+    }
+    size_t l = (bits - 1) / 4;
+    ApInt t, u, q;
+    apint_init_temp(&t);
+    apint_init_temp(&u);
+    apint_init_temp(&q);
+    apint_rshift_bits_into(&t, a, 2 * l);
+    sqrtrem_kara(s, r, &t);
+    apint_rshift_bits_into(&t, a, l);
+    gcd_low_bits(&t, l);
+    apint_lshift_bits_into(&u, r, l);
+    apint_add_into(&u, &u, &t);
+    apint_lshift_bits_into(&t, s, 1);
+    apint_divmod_into(&q, &u, &u, &t);
+    apint_lshift_bits_into(s, s, l);
+    apint_add_into(s, s, &q);
+
+    apint_lshift_bits_into(r, &u, l);
+    size_t n = (l + 63) / 64 < a->len ? (l + 63) / 64 : a->len; // a0
+    apint_reserve(&t, n);
+    mpn_copy(t.data, a->data, n);
+    t.len = n;
+    t.flags = 0;
+    gcd_low_bits(&t, l);
+    apint_add_into(r, r, &t);
+    apint_sqr_into(&t, &q);
+    apint_sub_into(r, r, &t);
+    if (r->flags == 1) { // q was one too large: r += 2s - 1, s -= 1
+        apint_add_into(r, r, s);
+        apint_add_into(r, r, s);
+        apint_set_u64(&t, 1UL);
+        apint_sub_into(r, r, &t);
+        apint_sub_into(s, s, &t);
+    }
+    apint_free_data(&t);
+    apint_free_data(&u);
+    apint_free_data(&q);
+}
+
+// r = ((n - 1) r + floor(a / r^(n-1))) / n, with t and q as scratch
+static void root_step(ApInt *r, const ApInt *a, unsigned long n, ApInt *t, ApInt *q) {
+    apint_pow_ui(t, r, n - 1);
+    apint_divmod_into(q, NULL, a, t);
+    apint_set_u64(t, n - 1);
+    apint_mul_into(r, r, t);
+    apint_add_into(r, r, q);
+    apint_set_u64(t, n);
+    apint_divmod_into(r, NULL, r, t);
+}
+
+/*
+ * r = floor(a^(1/n)) and p = r^n for a >= 0 of more than n bits (so r >=
+ * 2) and n >= 3.  r, p and a are distinct.
+ */
+static void root_newton(ApInt *r, ApInt *p, const ApInt *a, unsigned long n) {
+    size_t bits = apint_bits(a);
+    if (bits <= 128) {
+        u128 x = root_2((u128)limb_or_zero(a->data, a->len, 1) << 64 | a->data[0], n), xn = x;
+        for (unsigned long i = 1; i < n; i++) {
+            xn *= x;
+        }
+        apint_set_u64(r, (uint64_t)x);
+        apint_reserve(p, 2);
+        p->data[0] = (uint64_t)xn;
+        p->data[1] = (uint64_t)(xn >> 64);
+        apint_finish(p, 2, 0);
+        return;
+    }
+    size_t rbits = (bits + n - 1) / n; // r < 2^rbits
+    size_t guard = 2 + (64 - __builtin_clzl(n)); // the step leaves (n - 1) 2^(2s - rbits) < 1/2 of error
+    ApInt t, q;
+    apint_init_temp(&t);
+    apint_init_temp(&q);
+    if (rbits < guard + 4) { // a small root: step down from 2^rbits until r^n <= a
+        apint_set_u64(r, 1UL);
+        apint_lshift_bits_into(r, r, rbits);
+        do {
+            root_step(r, a, n, &t, &q);
+            apint_pow_ui(p, r, n);
+        } while (apint_compare(p, a) > 0);
+    } else { // r = (root(a >> ns) + 1) 2^s, one step, and r - 1 if that is still above
+        size_t s = (rbits - guard) / 2;
+        apint_rshift_bits_into(&t, a, n * s);
+        root_newton(r, p, &t, n);
+        apint_set_u64(&q, 1UL);
+        apint_add_into(r, r, &q);
+        apint_lshift_bits_into(r, r, s);
+        root_step(r, a, n, &t, &q);
+        apint_pow_ui(p, r, n);
+        if (apint_compare(p, a) > 0) {
+            apint_set_u64(&q, 1UL);
+            apint_sub_into(r, r, &q);
+            apint_pow_ui(p, r, n);
+        }
+    }
+    apint_free_data(&t);
+    apint_free_data(&q);
+}
+
+// r = floor(|a|^(1/n)) and p = r^n for n >= 1; r and p must not be a
+static void root_abs(ApInt *r, ApInt *p, const ApInt *a, unsigned long n) {
+    ApInt abs = *a; // a shallow copy that only reads a's limbs
+    abs.flags = 0;
+    if (n == 1) {
+        apint_set(r, &abs);
+        apint_set(p, &abs);
+    } else if (apint_bits(&abs) <= n) { // |a| < 2^n, so the root is 0 or 1
+        apint_set_u64(r, !apint_is_zero(a));
+        apint_set(p, r);
+    } else if (n == 2) {
+        sqrtrem_kara(r, p, &abs);
+        apint_sub_into(p, &abs, p);
+    } else {
+        root_newton(r, p, &abs, n);
+    }
+}
+
+int apint_sqrtrem_into(ApInt *root, ApInt *rem, const ApInt *a) {
+    STAT_CALL(APINT_STAT_ROOT, a->len);
+    if (a->flags == 1 && !apint_is_zero(a)) {
+        return APINT_ERR_INVALID;
+    }
+    ApInt r, p;
+    apint_init_temp(&r);
+    apint_init_temp(&p);
+    root_abs(&r, &p, a, 2);
+    if (rem != NULL) {
+        apint_sub_into(rem, a, &p);
+    }
+    if (root != NULL) {
+        apint_set(root, &r);
+    }
+    apint_free_data(&r);
+    apint_free_data(&p);
+    return APINT_OK;
+}
+
+int apint_root_into(ApInt *dst, const ApInt *a, unsigned long n) {
+    STAT_CALL(APINT_STAT_ROOT, a->len);
+    uint32_t flags = apint_is_zero(a) ? 0 : a->flags;
+    if (n == 0 || (flags == 1 && n % 2 == 0)) {
+        return APINT_ERR_INVALID;
+    }
+    ApInt r, p;
+    apint_init_temp(&r);
+    apint_init_temp(&p);
+    root_abs(&r, &p, a, n);
+    apint_set(dst, &r);
+    dst->flags = flags; // the root of a non-zero value is at least 1
+    apint_free_data(&r);
+    apint_free_data(&p);
+    return APINT_OK;
+}
+
+/*
+ * Squares modulo 64, 63, 65 and 11 (bit k set if k is one): together
+ * they let through under 1% of non-squares.  63 * 65 * 11 = 45045 takes
+ * one pass over the limbs, and the low limb gives the rest mod 64.
+ */
+static const uint64_t sq_mod64 = 0x202021202030213UL;
+static const uint64_t sq_mod63 = 0x402483012450293UL;
+static const uint64_t sq_mod65_lo = 0x218a019866014613UL; // and 64, which is -1
+static const uint64_t sq_mod11 = 0x23bUL;
+
+int apint_is_perfect_square(const ApInt *a) {
+    size_t n = mpn_normalized_size(a->data, a->len);
+    if (n == 0) {
+        return 1;
+    }
+    if (a->flags == 1 || !((sq_mod64 >> (a->data[0] % 64)) & 1)) {
+        return 0;
+    }
+    uint64_t r = mpn_mod_1(a->data, n, 45045);
+    if (!((sq_mod63 >> (r % 63)) & 1) || !((sq_mod11 >> (r % 11)) & 1)
+            || (r % 65 != 64 && !((sq_mod65_lo >> (r % 65)) & 1))) {
+        return 0;
+    }
+    STAT_CALL(APINT_STAT_ROOT, n);
+    ApInt root, p;
+    apint_init_temp(&root);
+    apint_init_temp(&p);
+    root_abs(&root, &p, a, 2);
+    int square = apint_compare(&p, a) == 0;
+    apint_free_data(&root);
+    apint_free_data(&p);
+    return square;
+}
+
+ApInt *apint_sqrt(const ApInt *a) {
+    return apint_root(a, 2);
+}
+
+ApInt *apint_sqrtrem(const ApInt *a, ApInt **rem) {
+    ApInt *r = apint_new(a->len / 2 + 1);
+    ApInt *m = rem != NULL ? apint_new(a->len / 2 + 1) : NULL;
+    if (apint_sqrtrem_into(r, m, a) != APINT_OK) {
+        apint_destroy(r);
+        if (m != NULL) {
+            apint_destroy(m);
+        }
+        return NULL;
+    }
+    if (rem != NULL) {
+        *rem = m;
+    }
+    return r;
+}
+
+ApInt *apint_root(const ApInt *a, unsigned long n) {
+    ApInt *r = apint_new(n > 0 ? a->len / n + 1 : 1);
+    if (apint_root_into(r, a, n) != APINT_OK) {
+        apint_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+/*
+ * Batch operations
+ *
+ * Adding or comparing small values one call at a time costs more in
+ * branches on signs and lengths than in arithmetic.  Pairs of one-limb
+ * values are done here without any, as signed 128-bit sums, and longer
+ * ones go through the general functions.  Sorting the pairs by length
+ * into structure-of-arrays lanes was measured too: for values scattered
+ * in memory, transposing them into lanes and back cost several times
+ * what it saved, so the pairs are taken in order.  Modular
+ * exponentiation shares its context and its scratch across the batch.
+ */
+
+// a one-limb value with its sign, as a signed 128-bit integer
+static inline i128 limb_signed(const ApInt *ap) {
+    i128 m = -(i128)(ap->flags & 1);
+    return ((i128)ap->data[0] ^ m) - m;
+}
+
+void apint_add_batch(ApInt **dst, const ApInt *const *a, const ApInt *const *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        const ApInt *x = a[i], *y = b[i];
+        ApInt *r = dst[i];
+        if ((x->len | y->len) != 1) {
+            apint_add_into(r, x, y);
+            continue;
+        }
+        STAT_CALL(APINT_STAT_ADD, 1);
+        i128 s = limb_signed(x) + limb_signed(y); // x and y are not read past here, so r may be either
+        i128 m = s >> 127;
+        u128 mag = (u128)((s ^ m) - m);
+        uint64_t hi = (uint64_t)(mag >> 64);
+        r->data[0] = (uint64_t)mag; // cap is never below APINT_INLINE_LIMBS
+        r->data[1] = hi;
+        r->len = 1 + (hi != 0);
+        r->flags = (uint32_t)m & 1;
+    }
+}
+
+void apint_compare_batch(int *result, const ApInt *const *a, const ApInt *const *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        const ApInt *x = a[i], *y = b[i];
+        if ((x->len | y->len) != 1) {
+            result[i] = apint_compare(x, y);
+            continue;
+        }
+        STAT_CALL(APINT_STAT_COMPARE, 1);
+        // 2v, less 1 if negative, so that -0 sorts between -1 and 0 as in apint_compare
+        i128 kx = 2 * limb_signed(x) - (x->flags & 1);
+        i128 ky = 2 * limb_signed(y) - (y->flags & 1);
+        result[i] = (kx > ky) - (kx < ky);
+    }
+}
+
+// one context for the shared modulus and one scratch block, sized for the longest exponent
+int apint_powmod_batch(ApInt **dst, const ApInt *const *base, const ApInt *const *exp, const ApInt *mod, size_t n) {
+    ApIntMontCtx *ctx = apint_mont_create(mod);
+    if (ctx == NULL) {
+        return APINT_ERR_DIVZERO;
+    }
+    size_t bits = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t eb = powmod_exp_bits(exp[i]);
+        if (eb > bits) {
+            bits = eb;
+        }
+    }
+    size_t sn = mont_powmod_into_scratch(ctx->n, bits); // the window, and so the table, only grows with the bits
+    uint64_t *scratch = limbs_alloc(sn);
+    int status = APINT_OK;
+    for (size_t i = 0; i < n; i++) { // an element's error does not stop the others
+        int s = mont_powmod_into(dst[i], base[i], exp[i], ctx, 0, scratch);
+        if (s != APINT_OK) {
+            status = s;
+        }
+    }
+    limbs_free(scratch, sn);
+    apint_mont_destroy(ctx);
+    return status;
+}
+
+/*
+ * Destination-first API
+ *
+ * Results are written into an existing ApInt whose storage is reused.
+ * Operand limb pointers are only read after apint_reserve, since dst may
+ * be one of the operands and growing it can move its data.
+ */
+
+void apint_reserve(ApInt *ap, uint32_t limbs) {
+    if (limbs <= ap->cap) {
+        return;
+    }
+    uint32_t cap = ap->cap + ap->cap / 2; // amortized growth
+    if (cap < limbs) {
+        cap = limbs;
+    }
+    if (ap->data == ap->small) { // spill to the heap
+        ap->data = apint_alloc_data(ap->arena, cap);
+        memcpy(ap->data, ap->small, sizeof(ap->small));
+    } else if (ap->arena != NULL) {
+        ap->data = (uint64_t*)arena_realloc(ap->arena, ap->data, ap->cap * sizeof(uint64_t), cap * sizeof(uint64_t));
+    } else {
+        ap->data = (uint64_t*)mem_realloc(ap->data, ap->cap * sizeof(uint64_t), cap * sizeof(uint64_t));
+    }
+    ap->cap = cap;
+}
+
+// trims leading zero limbs from the first n and sets the sign (zero is never negative)
+static void apint_finish(ApInt *ap, size_t n, uint32_t flags) {
+    n = mpn_normalized_size(ap->data, n);
+    if (n == 0) {
+        ap->data[0] = 0;
+        ap->len = 1;
+        ap->flags = 0;
+    } else {
+        ap->len = n;
+        ap->flags = flags;
+    }
+}
+
+void apint_set(ApInt *dst, const ApInt *src) {
+    if (dst == src) {
+        return;
+    }
+    size_t n = mpn_normalized_size(src->data, src->len);
+    apint_reserve(dst, n > 0 ? n : 1);
+    mpn_copy(dst->data, src->data, n);
+    apint_finish(dst, n, src->flags);
+}
+
+void apint_set_u64(ApInt *dst, uint64_t val) {
+    dst->data[0] = val; // cap is never 0
+    apint_finish(dst, 1, 0);
+}
+
+void apint_negate_into(ApInt *dst, const ApInt *src) {
+    uint32_t flags = src->flags ^ 1;
+    apint_set(dst, src);
+    apint_finish(dst, dst->len, flags);
+}
+
+// dst = a + b where b counts as having sign bflags
+static void apint_add_signed(ApInt *dst, const ApInt *a, const ApInt *b, uint32_t bflags) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    size_t bn = mpn_normalized_size(b->data, b->len);
+    uint32_t aflags = a->flags;
+    if (an < bn || (an == bn && mpn_cmp(a->data, b->data, an) < 0)) { // make |a| >= |b|
+        const ApInt *t = a;
+        a = b;
+        b = t;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+        uint32_t tf = aflags;
+        aflags = bflags;
+        bflags = tf;
+    }
+    if (an == 0) { // both zero
+        apint_set_u64(dst, 0UL);
+    } else if (aflags == bflags) {
+        apint_reserve(dst, an);
+        uint64_t carry = mpn_add(dst->data, a->data, an, b->data, bn);
+        if (carry) { // only now grow, so two-limb sums can stay inline
+            apint_reserve(dst, an + 1);
+            dst->data[an] = carry;
+        }
+        apint_finish(dst, an + carry, aflags);
+    } else {
+        apint_reserve(dst, an);
+        mpn_sub(dst->data, a->data, an, b->data, bn);
+        apint_finish(dst, an, aflags);
+    }
+}
+
+void apint_add_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    STAT_CALL(APINT_STAT_ADD, a->len > b->len ? a->len : b->len);
+    apint_add_signed(dst, a, b, b->flags);
+}
+
+void apint_sub_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    STAT_CALL(APINT_STAT_SUB, a->len > b->len ? a->len : b->len);
+    apint_add_signed(dst, a, b, b->flags ^ 1);
+}
+
+void apint_mul_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    size_t bn = mpn_normalized_size(b->data, b->len);
+    STAT_CALL(APINT_STAT_MUL, an > bn ? an : bn);
+    if (an == 0 || bn == 0) {
+        apint_set_u64(dst, 0UL);
+        return;
+    }
+    if (an < bn) { // keep the longer operand first
+        const ApInt *t = a;
+        a = b;
+        b = t;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    uint32_t flags = a->flags ^ b->flags;
+    if (dst == a || dst == b) { // the kernels need a separate output
+        uint64_t *prod = apint_alloc_data(dst->arena, an + bn);
+        mpn_mul(prod, a->data, an, b->data, bn);
+        apint_free_data(dst);
+        dst->data = prod;
+        dst->cap = an + bn;
+    } else {
+        apint_reserve(dst, an + bn);
+        mpn_mul(dst->data, a->data, an, b->data, bn);
+    }
+    apint_finish(dst, an + bn, flags);
+}
+
+// dst += a * b, or -= when neg, through a scratch product rather than an ApInt
+static void apint_addmul_signed(ApInt *dst, const ApInt *a, const ApInt *b, uint32_t neg) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    size_t bn = mpn_normalized_size(b->data, b->len);
+    STAT_CALL(APINT_STAT_MUL, an > bn ? an : bn);
+    if (an == 0 || bn == 0) {
+        return;
+    }
+    if (an < bn) {
+        const ApInt *t = a;
+        a = b;
+        b = t;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    ApInt prod = { 0, an + bn, 0, limbs_alloc(an + bn), NULL, { 0, 0 } };
+    mpn_mul(prod.data, a->data, an, b->data, bn);
+    prod.len = mpn_normalized_size(prod.data, an + bn);
+    apint_add_signed(dst, dst, &prod, a->flags ^ b->flags ^ neg);
+    limbs_free(prod.data, an + bn);
+}
+
+void apint_addmul_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    apint_addmul_signed(dst, a, b, 0);
+}
+
+void apint_submul_into(ApInt *dst, const ApInt *a, const ApInt *b) {
+    apint_addmul_signed(dst, a, b, 1);
+}
+
+int apint_lshift_bits_into(ApInt *dst, const ApInt *a, size_t bits) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    STAT_CALL(APINT_STAT_SHIFT, an);
+    uint32_t flags = a->flags;
+    if (an == 0) {
+        apint_set_u64(dst, 0UL);
+        return APINT_OK;
+    }
+    size_t q = bits / 64;
+    unsigned s = bits % 64;
+    if (q >= UINT32_MAX - an) { // an + q + 1 limbs would not fit in len
+        return APINT_ERR_RANGE;
+    }
+    apint_reserve(dst, an + q + 1);
+    const uint64_t *ap = a->data;
+    if (s > 0) { // r sits at or above a, as mpn_lshift allows
+        dst->data[an + q] = mpn_lshift(dst->data + q, ap, an, s);
+    } else {
+        mpn_copy(dst->data + q, ap, an);
+        dst->data[an + q] = 0;
+    }
+    mpn_zero(dst->data, q);
+    apint_finish(dst, an + q + 1, flags);
+    return APINT_OK;
+}
+
+/*
+ * Floor semantics, as with >> on negative two's complement values: a
+ * negative value that loses any 1 bits rounds away from zero, so -1
+ * stays -1 and -5 >> 1 is -3.
+ */
+void apint_rshift_bits_into(ApInt *dst, const ApInt *a, size_t bits) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    STAT_CALL(APINT_STAT_SHIFT, an);
+    uint32_t flags = a->flags;
+    size_t q = bits / 64;
+    unsigned s = bits % 64;
+    if (q >= an) { // nothing left but the rounding
+        apint_set_u64(dst, an > 0 && flags == 1);
+        apint_finish(dst, 1, flags);
+        return;
+    }
+    const uint64_t *ap = a->data;
+    int round = 0;
+    if (flags == 1) { // any 1 bits shifted out?
+        round = mpn_normalized_size(ap, q) != 0 || (s > 0 && (ap[q] & ((1UL << s) - 1)) != 0);
+    }
+    size_t rn = an - q;
+    apint_reserve(dst, rn + 1);
+    ap = a->data; // dst may be a
+    if (s > 0) { // r sits at or below a, as mpn_rshift allows
+        mpn_rshift(dst->data, ap + q, rn, s);
+    } else {
+        mpn_copy(dst->data, ap + q, rn);
+    }
+    dst->data[rn] = round ? mpn_add_1(dst->data, dst->data, rn, 1) : 0;
+    apint_finish(dst, rn + 1, flags);
+}
+
+int apint_divmod_into(ApInt *quot, ApInt *rem, const ApInt *a, const ApInt *b) {
+    size_t an = mpn_normalized_size(a->data, a->len);
+    size_t bn = mpn_normalized_size(b->data, b->len);
+    STAT_CALL(APINT_STAT_DIVMOD, an);
+    uint32_t aflags = a->flags, bflags = b->flags;
+    if (bn == 0) {
+        return APINT_ERR_DIVZERO;
+    }
+    if (an < bn || (an == bn && mpn_cmp(a->data, b->data, an) < 0)) { // |a| < |b|
+        if (rem != NULL) {
+            apint_set(rem, a);
+        }
+        if (quot != NULL) {
+            apint_set_u64(quot, 0UL);
+        }
+        return APINT_OK;
+    }
+    uint64_t *q = limbs_alloc(an + 1);
+    uint64_t *r = q + an - bn + 1;
+    mpn_tdiv_qr(q, r, a->data, an, b->data, bn);
+    if (quot != NULL) { // a and b are not read past this point, so they may alias quot and rem
+        apint_reserve(quot, an - bn + 1);
+        mpn_copy(quot->data, q, an - bn + 1);
+        apint_finish(quot, an - bn + 1, aflags ^ bflags);
+    }
+    if (rem != NULL) {
+        apint_reserve(rem, bn);
+        mpn_copy(rem->data, r, bn);
+        apint_finish(rem, bn, aflags);
+    }
+    limbs_free(q, an + 1);
+    return APINT_OK;
 }
@@ -7,6 +7,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,35 +15,484 @@ extern "C" {
 
 /*
  * Representation: the data field is a little-endian bitstring ---
- * data[0] is bits 0..63, data[1] is bits 64..127, etc.
+ * data[0] is bits 0..63, data[1] is bits 64..127, etc.  Values of up to
+ * APINT_INLINE_LIMBS limbs keep them in the struct, so an ApInt must not
+ * be copied by value.
  */
+typedef struct ApIntArena ApIntArena;
+
+/* Limbs stored inside the struct itself before a value spills to the heap */
+#define APINT_INLINE_LIMBS 2
+
 typedef struct {
-	/* TODO: add fields */
-    /* nw: added fields*/
     uint32_t len;
+    uint32_t cap; // limbs allocated in data, always >= len
     uint32_t flags;
     uint64_t *data; // each element represents 64 bits
+    ApIntArena *arena; // owner of the struct and data, NULL when they come from the allocator hooks
+    uint64_t small[APINT_INLINE_LIMBS]; // data points here until the value outgrows it
 } ApInt;
 
-/* Constructors and destructors */
+/* Status codes returned by functions that can fail */
+enum {
+    APINT_OK = 0,
+    APINT_ERR_DIVZERO = -1, // divisor was zero
+    APINT_ERR_INVALID = -2, // malformed input string
+    APINT_ERR_RANGE = -3,   // output buffer too small
+    APINT_ERR_IO = -4,      // file could not be read or written
+};
+
+/*
+ * Thread safety.  Unless the comment on its group says otherwise, a
+ * function only reads its const ApInt arguments and only writes its
+ * non-const ones, and may run in any number of threads at once as long
+ * as no ApInt it writes is read or written by another thread meanwhile.
+ * Any number of threads may read the same value.  Each group below says
+ * which outputs may alias which inputs and what, if anything, it shares
+ * with other threads.
+ */
+
+/*
+ * Constructors and destructors.  A new value is private to the calling
+ * thread until it hands the pointer on; apint_destroy writes ap.
+ */
 ApInt *apint_create_from_u64(uint64_t val);
-ApInt *apint_create_from_hex(const char *hex);
+ApInt *apint_create_from_hex(const char *hex); // NULL if hex is malformed
 void apint_destroy(ApInt *ap);
 
-/* Operations */
+/*
+ * Allocator hooks.  Every allocation for values, scratch, arenas, stores
+ * and strings goes through them, the strings from apint_format_as_hex
+ * included (free those with apint_free_str).  Three kinds of block,
+ * which can outlive a change of hooks, come from malloc instead: the
+ * worker pool's thread array (apint_set_threads), the decimal-power
+ * cache (never freed, see apint_create_from_dec) and, in APINT_STATS
+ * builds, one counter block per thread.  Counting or capping memory
+ * through the hooks leaves those out.  realloc and free are passed the
+ * block's current size, as in GMP's mp_set_memory_functions.  NULL
+ * arguments restore the malloc/realloc/free defaults.  Set the hooks
+ * before creating any value: blocks must be released by the hooks that
+ * allocated them.
+ *
+ * apint_set_allocator stores the hooks in globals without a lock, so call
+ * it once, before any other thread starts.  From then on the hooks are
+ * called from every thread that creates or grows a value, worker threads
+ * included, and must be thread-safe themselves.  apint_get_allocator and
+ * apint_free_str may be called from any thread.
+ */
+typedef void *(*ApIntAllocFunc)(size_t size);
+typedef void *(*ApIntReallocFunc)(void *ptr, size_t old_size, size_t new_size);
+typedef void (*ApIntFreeFunc)(void *ptr, size_t size);
+
+void apint_set_allocator(ApIntAllocFunc alloc, ApIntReallocFunc realloc_fn, ApIntFreeFunc free_fn);
+void apint_get_allocator(ApIntAllocFunc *alloc, ApIntReallocFunc *realloc_fn, ApIntFreeFunc *free_fn);
+void apint_free_str(char *s);
+
+/*
+ * Arenas hand out values by bumping a pointer through large blocks, so a
+ * request can build all its temporaries in one arena and drop them
+ * together.  apint_destroy is a no-op on arena values; they live until
+ * apint_arena_reset (which keeps one block for reuse) or
+ * apint_arena_destroy.  Results of the destination-first functions stay
+ * in their dst's arena, while apint_add and friends always return values
+ * from the allocator hooks.  block_bytes of 0 picks a default of 64 KiB.
+ *
+ * Arenas take no lock: an arena and every value in it belong to one
+ * thread at a time, and that includes any call that writes such a value,
+ * since growing it allocates from the arena.  Different arenas may be
+ * used by different threads at once.
+ */
+ApIntArena *apint_arena_create(size_t block_bytes);
+void apint_arena_reset(ApIntArena *arena);
+void apint_arena_destroy(ApIntArena *arena);
+ApInt *apint_arena_create_from_u64(ApIntArena *arena, uint64_t val);
+ApInt *apint_arena_create_from_hex(ApIntArena *arena, const char *hex);
+
+/*
+ * Operations.  apint_lshift and apint_lshift_n take a non-const ap but
+ * only read it; apint_set_bit writes ap.  addition and subtraction write
+ * their last argument, reusing its storage like the destination-first
+ * functions below (it may be a or b).  The rest write only the value
+ * they return.
+ */
 int apint_is_zero(const ApInt *ap);
 int apint_is_negative(const ApInt *ap);
 uint64_t apint_get_bits(const ApInt *ap, unsigned n);
 int apint_highest_bit_set(const ApInt *ap);
 char *apint_format_as_hex(const ApInt *ap);
 ApInt *apint_negate(const ApInt *ap);
-ApInt* addition(const ApInt *a, const ApInt *b, ApInt *sum);
-ApInt* subtraction(const ApInt *a, const ApInt *b, ApInt *sum);
+ApInt* addition(const ApInt *a, const ApInt *b, ApInt *sum); // sum = |a| + |b| for |a| >= |b|, returns sum
+ApInt* subtraction(const ApInt *a, const ApInt *b, ApInt *sum); // sum = |a| - |b| for |a| >= |b|, returns sum
 ApInt *apint_add(const ApInt *a, const ApInt *b);
 ApInt *apint_sub(const ApInt *a, const ApInt *b);
 int apint_compare(const ApInt *left, const ApInt *right);
 ApInt *apint_lshift(ApInt *ap);
-ApInt *apint_lshift_n(ApInt *ap, unsigned n);
+ApInt *apint_lshift_n(ApInt *ap, unsigned n); // keeps ap's width, dropping the bits shifted out
+
+/*
+ * Shifts by any number of bits.  The result of a left shift grows as
+ * needed, up to the UINT32_MAX limbs len can count: past that
+ * apint_lshift_bits returns NULL and apint_lshift_bits_into returns
+ * APINT_ERR_RANGE, leaving dst alone (apint_lshift_n never grows).  A
+ * right shift rounds toward negative infinity, so negative values
+ * behave like two's complement: -5 >> 1 is -3.
+ */
+ApInt *apint_lshift_bits(const ApInt *ap, size_t bits);
+ApInt *apint_rshift_bits(const ApInt *ap, size_t bits);
+
+/*
+ * Bitwise operations treat negative values as two's complement with
+ * infinitely many leading ones, like GMP's mpz functions: ~a is -a - 1,
+ * apint_popcount of a negative value is SIZE_MAX, and so is apint_ctz
+ * (the index of the lowest 1 bit) of zero.  apint_set_bit returns
+ * APINT_ERR_RANGE, leaving ap alone, for a bit past the largest length.
+ */
+ApInt *apint_and(const ApInt *a, const ApInt *b);
+ApInt *apint_or(const ApInt *a, const ApInt *b);
+ApInt *apint_xor(const ApInt *a, const ApInt *b);
+ApInt *apint_not(const ApInt *a);
+size_t apint_popcount(const ApInt *ap);
+size_t apint_ctz(const ApInt *ap);
+int apint_test_bit(const ApInt *ap, size_t bit);
+int apint_set_bit(ApInt *ap, size_t bit);
+ApInt *apint_mul(const ApInt *a, const ApInt *b);
+
+/*
+ * a * a.  apint_mul and apint_mul_into square the same way whenever both
+ * operands are the same ApInt; the squaring kernels form each cross
+ * product once, which makes a square cost roughly 2/3 of a product.
+ */
+ApInt *apint_sqr(const ApInt *a);
+
+/*
+ * Truncating division, as with C's / and %: a = quot * b + rem, the
+ * quotient is rounded toward zero and rem takes the sign of a.
+ * apint_divmod stores into whichever of quot/rem is non-NULL and returns
+ * APINT_OK or APINT_ERR_DIVZERO; apint_div and apint_mod return NULL
+ * when b is zero.
+ */
+int apint_divmod(const ApInt *a, const ApInt *b, ApInt **quot, ApInt **rem);
+ApInt *apint_div(const ApInt *a, const ApInt *b);
+ApInt *apint_mod(const ApInt *a, const ApInt *b);
+
+/*
+ * Destination-first variants, in the style of GMP's mpz_add(r, a, b).
+ * dst must already be a valid ApInt (apint_create_from_u64(0) will do);
+ * its limb storage is reused and only grows, by at least half its
+ * capacity, when the result does not fit.
+ *
+ * dst may be the same object as any of the operands, and an operand may
+ * be passed twice (apint_mul_into(dst, a, a) squares a).  quot and rem
+ * of apint_divmod_into may each alias a or b but must not be the same
+ * object.  dst is written even when it is also an operand, so while the
+ * call runs no other thread may use it; other threads may go on reading
+ * the operands that are not dst.  apint_reserve writes ap.
+ */
+void apint_reserve(ApInt *ap, uint32_t limbs);
+void apint_set(ApInt *dst, const ApInt *src);
+void apint_set_u64(ApInt *dst, uint64_t val);
+void apint_negate_into(ApInt *dst, const ApInt *src);
+void apint_add_into(ApInt *dst, const ApInt *a, const ApInt *b);
+void apint_sub_into(ApInt *dst, const ApInt *a, const ApInt *b);
+void apint_mul_into(ApInt *dst, const ApInt *a, const ApInt *b);
+void apint_sqr_into(ApInt *dst, const ApInt *a);
+void apint_addmul_into(ApInt *dst, const ApInt *a, const ApInt *b); // dst += a * b
+void apint_submul_into(ApInt *dst, const ApInt *a, const ApInt *b); // dst -= a * b
+int apint_divmod_into(ApInt *quot, ApInt *rem, const ApInt *a, const ApInt *b);
+int apint_lshift_bits_into(ApInt *dst, const ApInt *a, size_t bits);
+void apint_rshift_bits_into(ApInt *dst, const ApInt *a, size_t bits);
+void apint_and_into(ApInt *dst, const ApInt *a, const ApInt *b);
+void apint_or_into(ApInt *dst, const ApInt *a, const ApInt *b);
+void apint_xor_into(ApInt *dst, const ApInt *a, const ApInt *b);
+void apint_not_into(ApInt *dst, const ApInt *a);
+
+/*
+ * Modular exponentiation: base^exp mod |mod|, in [0, |mod|) whatever
+ * base's sign.  Negative exponents are APINT_ERR_INVALID (apint_powmod
+ * returns NULL for them and for a zero modulus).  An ApIntMontCtx holds
+ * what depends on the modulus alone, so repeated calls with the same
+ * one skip that setup; it is read-only once created and may be shared
+ * between threads, which must all be done with it before
+ * apint_mont_destroy.  apint_mont_create returns NULL for a zero modulus.
+ *
+ * apint_mont_powmod_sec_into is for secret exponents: its run time and
+ * memory accesses depend only on the sizes of the operands, not on the
+ * exponent's bits.  It needs an odd modulus (APINT_ERR_INVALID
+ * otherwise), as for RSA.  The base is reduced by ordinary division, so
+ * it is not protected.
+ */
+typedef struct ApIntMontCtx ApIntMontCtx;
+
+ApInt *apint_powmod(const ApInt *base, const ApInt *exp, const ApInt *mod);
+int apint_powmod_into(ApInt *dst, const ApInt *base, const ApInt *exp, const ApInt *mod);
+ApIntMontCtx *apint_mont_create(const ApInt *mod);
+void apint_mont_destroy(ApIntMontCtx *ctx);
+int apint_mont_powmod_into(ApInt *dst, const ApInt *base, const ApInt *exp, const ApIntMontCtx *ctx);
+int apint_mont_powmod_sec_into(ApInt *dst, const ApInt *base, const ApInt *exp, const ApIntMontCtx *ctx);
+
+/*
+ * Greatest common divisor, never negative, with gcd(0, 0) = 0.
+ * apint_gcdext also finds s and t with a*s + b*t = gcd(a, b), taking the
+ * s in (-|b|/2g, |b|/2g] (sign(a) if b is zero, and s = t = 0 if both
+ * are), so the cofactors do not depend on the algorithm that found
+ * them; s and t may be NULL.  apint_invert_into sets dst to the inverse
+ * of a modulo |mod|, in [0, |mod|), and returns APINT_ERR_INVALID if
+ * there is none or APINT_ERR_DIVZERO for a zero modulus; apint_invert
+ * returns NULL for both.  Outputs may be the same objects as operands,
+ * but g, s and t must be different objects.
+ */
+ApInt *apint_gcd(const ApInt *a, const ApInt *b);
+ApInt *apint_gcdext(const ApInt *a, const ApInt *b, ApInt **s, ApInt **t);
+ApInt *apint_invert(const ApInt *a, const ApInt *mod);
+void apint_gcd_into(ApInt *dst, const ApInt *a, const ApInt *b);
+void apint_gcdext_into(ApInt *g, ApInt *s, ApInt *t, const ApInt *a, const ApInt *b);
+int apint_invert_into(ApInt *dst, const ApInt *a, const ApInt *mod);
+
+/*
+ * Integer roots, rounded toward zero.  apint_root_into sets dst to the
+ * n-th root of a, negative for negative a and odd n, and returns
+ * APINT_ERR_INVALID for n = 0 or for negative a and even n.
+ * apint_sqrtrem_into sets root = floor(sqrt(a)) and rem = a - root^2
+ * (either may be NULL) and returns APINT_ERR_INVALID for negative a.
+ * apint_sqrt, apint_sqrtrem and apint_root return NULL in those cases.
+ * apint_is_perfect_square turns away most non-squares by their residues
+ * before taking a root.  Outputs may be the same objects as a, but root
+ * and rem must be different objects.
+ */
+ApInt *apint_sqrt(const ApInt *a);
+ApInt *apint_sqrtrem(const ApInt *a, ApInt **rem);
+ApInt *apint_root(const ApInt *a, unsigned long n);
+int apint_is_perfect_square(const ApInt *a);
+int apint_sqrtrem_into(ApInt *root, ApInt *rem, const ApInt *a);
+int apint_root_into(ApInt *dst, const ApInt *a, unsigned long n);
+
+/*
+ * Batch operations over arrays of n pairs: dst[i] = a[i] + b[i],
+ * result[i] = apint_compare(a[i], b[i]), dst[i] = base[i]^exp[i] mod
+ * |mod|.  As with the destination-first functions, every dst[i] must be
+ * a valid ApInt; it may be the same object as a[i] or b[i] (base[i] or
+ * exp[i]) but not as an operand or dst of another element.
+ *
+ * apint_add_batch and apint_compare_batch are loops over the elements
+ * that take pairs of one-limb values without branches on their signs,
+ * as 128-bit sums and compares, and pass longer pairs to apint_add_into
+ * and apint_compare; on one-limb values apint_add_batch is several times
+ * faster than calling apint_add_into in a loop.  Neither allocates, but
+ * for a dst that has to grow.  apint_powmod_batch sets up the modulus
+ * once and shares one scratch block, sized for the longest exponent,
+ * among the elements, so its allocations do not grow with n; it returns
+ * the status of the last element that failed, or APINT_OK.
+ */
+void apint_add_batch(ApInt **dst, const ApInt *const *a, const ApInt *const *b, size_t n);
+void apint_compare_batch(int *result, const ApInt *const *a, const ApInt *const *b, size_t n);
+int apint_powmod_batch(ApInt **dst, const ApInt *const *base, const ApInt *const *exp, const ApInt *mod, size_t n);
+
+/*
+ * Hex strings: an optional '-', then one or more hex digits of either
+ * case.  apint_set_hex returns APINT_ERR_INVALID, leaving dst zero, for
+ * anything else.  apint_hex_size is the buffer size apint_format_as_hex
+ * needs, terminating NUL included; apint_format_as_hex_into returns
+ * APINT_ERR_RANGE if cap is smaller.
+ */
+int apint_set_hex(ApInt *dst, const char *hex);
+size_t apint_hex_size(const ApInt *ap);
+int apint_format_as_hex_into(char *buf, size_t cap, const ApInt *ap);
+
+/*
+ * Decimal strings, with the same rules (an optional '-', then one or
+ * more digits) and error codes as the hex functions.  Conversion is
+ * subquadratic for long numbers.  apint_dec_size is an upper bound, not
+ * the exact size; the string from apint_format_as_dec is released with
+ * apint_free_str.
+ *
+ * The divide-and-conquer conversions share a process-wide cache of the
+ * powers 10^(19*2^j), built on first use and never freed.  Threads that
+ * miss the same entry at once each compute it and the first to finish
+ * publishes it with an atomic compare-and-swap, so conversions may run
+ * in any number of threads without a lock.  The cache is allocated with
+ * malloc, not the hooks.
+ */
+ApInt *apint_create_from_dec(const char *dec); // NULL if dec is malformed
+int apint_set_dec(ApInt *dst, const char *dec);
+size_t apint_dec_size(const ApInt *ap);
+char *apint_format_as_dec(const ApInt *ap);
+int apint_format_as_dec_into(char *buf, size_t cap, const ApInt *ap);
+
+/*
+ * Binary format: a LEB128 varint of len << 1 | sign, padded with
+ * redundant 0x80 bytes to 8 bytes, then len little-endian limbs without
+ * leading zero limbs (none for zero).  apint_serialize_into returns
+ * APINT_ERR_RANGE if the record does not fit in cap bytes.  The decoders
+ * take the size available at buf, accept unpadded varints too, store the
+ * record's size in *used (if not NULL) and return APINT_ERR_INVALID, or
+ * NULL, for a truncated or non-canonical record.
+ *
+ * An ApIntView reads a record in place: view.value is an ApInt whose
+ * limbs are those in the buffer, to be passed only where a const ApInt*
+ * is taken, and only while the buffer lives.  It needs the limbs 8-byte
+ * aligned (a record starting at an aligned address, as records written
+ * back to back into an aligned buffer or file are) and a little-endian
+ * host; apint_view_init returns APINT_ERR_INVALID otherwise.
+ */
+typedef struct {
+    ApInt value;
+} ApIntView;
+
+size_t apint_serialized_size(const ApInt *ap);
+int apint_serialize_into(void *buf, size_t cap, const ApInt *ap);
+ApInt *apint_deserialize(const void *buf, size_t size, size_t *used);
+int apint_deserialize_into(ApInt *dst, const void *buf, size_t size, size_t *used);
+int apint_view_init(ApIntView *view, const void *buf, size_t size, size_t *used);
+
+/*
+ * Stores: read-only tables of values in a file that is mapped rather than
+ * parsed, so opening one costs page faults instead of conversions.  The
+ * file holds a header, the limbs of every value (each starting on a
+ * 32-byte boundary) and an index of offsets and lengths into them.
+ * apint_store_get gives value i as a view into the mapping in O(1),
+ * valid until apint_store_close; it returns APINT_ERR_RANGE past the
+ * last value.  apint_store_open returns NULL if the file cannot be
+ * mapped or is not a store.  A writer appends values one by one, and
+ * apint_store_writer_close adds the index and returns APINT_ERR_IO if
+ * any write failed.  Stores are little-endian and can be neither
+ * written nor opened on big-endian hosts.
+ *
+ * An open store is read-only: any number of threads may call
+ * apint_store_count and apint_store_get and share the views, until
+ * apint_store_close, which must wait for all of them.  A writer belongs
+ * to one thread.
+ */
+typedef struct ApIntStore ApIntStore;
+typedef struct ApIntStoreWriter ApIntStoreWriter;
+
+ApIntStore *apint_store_open(const char *path);
+void apint_store_close(ApIntStore *store);
+size_t apint_store_count(const ApIntStore *store);
+int apint_store_get(const ApIntStore *store, size_t i, ApIntView *view);
+ApIntStoreWriter *apint_store_writer_open(const char *path); // NULL if path cannot be created
+int apint_store_writer_add(ApIntStoreWriter *writer, const ApInt *ap);
+int apint_store_writer_close(ApIntStoreWriter *writer);
+
+/*
+ * Algorithm cross-over points, measured in limbs of the smaller operand.
+ * The defaults come from "apintBench tune", which measures the PARALLEL
+ * ones with every online CPU (see apint.c); apint_tune_set is meant for
+ * that tuner and for tests, not for use while other calls are running.
+ */
+typedef enum {
+    APINT_TUNE_MUL_KARATSUBA, // smallest size multiplied with Karatsuba
+    APINT_TUNE_MUL_TOOM3,     // smallest size multiplied with Toom-3
+    APINT_TUNE_MUL_NTT,       // smallest size multiplied with the number-theoretic transform
+    APINT_TUNE_SQR_KARATSUBA, // smallest size squared with Karatsuba (Toom-3 and NTT as for products)
+    APINT_TUNE_DIV_NEWTON,    // smallest divisor (and quotient) size divided via Newton reciprocals
+    APINT_TUNE_DEC_DC,        // smallest value converted to or from decimal by divide and conquer
+    APINT_TUNE_GCD_HGCD,      // smallest gcd reduced with the half-gcd rather than Lehmer steps
+    APINT_TUNE_PARALLEL,      // smallest multiplication or decimal conversion split across threads
+    APINT_TUNE_PARALLEL_ADD,  // smallest addition or subtraction split across threads
+    APINT_TUNE_COUNT
+} ApIntTuneParam;
+
+size_t apint_tune_get(ApIntTuneParam param);
+void apint_tune_set(ApIntTuneParam param, size_t limbs);
+
+/*
+ * Worker threads for very large operands, none by default.
+ * apint_set_threads(n) lets operations above the APINT_TUNE_PARALLEL
+ * sizes use up to n threads, the calling one included, and returns the
+ * number it got (fewer if threads could not be created); 0 or 1 stops
+ * the workers.  Smaller values never touch the pool.
+ *
+ * apint_set_threads starts and joins the workers without stopping other
+ * calls, so like apint_tune_set it must not be called while other calls
+ * are running; apint_get_threads may be called from any thread.  Calls
+ * in several threads may use the pool at once: their jobs share one
+ * queue under a mutex, and each caller works through its own job's
+ * items rather than wait for a free worker.
+ */
+unsigned apint_set_threads(unsigned threads);
+unsigned apint_get_threads(void);
+
+/*
+ * The limb kernels (add/sub, single-limb multiplies, shifts) are picked
+ * for the host CPU once at load time: ADX/BMI2 and AVX2 versions where
+ * available, portable C otherwise.  Setting APINT_FORCE_GENERIC=1 in the
+ * environment keeps the portable ones, so results can be compared.
+ * apint_kernels names the set in use.  apint_use_generic_kernels switches
+ * at run time, for tests; like apint_tune_set it must not be called
+ * while other calls are running.
+ */
+const char *apint_kernels(void);
+void apint_use_generic_kernels(int generic);
+
+/*
+ * Instrumentation, compiled in by building the library with -DAPINT_STATS
+ * (make APINT_STATS=1) and absent otherwise.  Each thread counts into its
+ * own block; apint_stats_get sums every thread's counts since the last
+ * apint_stats_reset, exited threads included, and apint_stats_dump
+ * writes the nonzero ones as "name value" lines.  All three may be
+ * called from any thread at any time; the counts of calls running at
+ * that moment may land on either side of the snapshot.  Without APINT_STATS
+ * the snapshot is all zeros and apint_stats_get returns
+ * APINT_ERR_INVALID.
+ */
+typedef enum {
+    APINT_STAT_CREATE,  // new values, from the hooks or an arena
+    APINT_STAT_DESTROY,
+    APINT_STAT_ADD,
+    APINT_STAT_SUB,
+    APINT_STAT_MUL,
+    APINT_STAT_DIVMOD,
+    APINT_STAT_COMPARE,
+    APINT_STAT_SHIFT,
+    APINT_STAT_BITWISE,
+    APINT_STAT_PARSE_HEX,
+    APINT_STAT_FORMAT_HEX,
+    APINT_STAT_PARSE_DEC,
+    APINT_STAT_FORMAT_DEC,
+    APINT_STAT_POWMOD,
+    APINT_STAT_GCD,     // gcd, gcdext and invert
+    APINT_STAT_ROOT,    // roots, and perfect-square tests that get past the residues
+    APINT_STAT_OP_COUNT
+} ApIntStatOp;
+
+/* Algorithm branches, counted each time one is taken, recursive steps included */
+typedef enum {
+    APINT_ALGO_MUL_BASECASE,
+    APINT_ALGO_MUL_KARATSUBA,
+    APINT_ALGO_MUL_TOOM3,
+    APINT_ALGO_MUL_NTT,
+    APINT_ALGO_MUL_SLICED,    // unbalanced operands cut into balanced products
+    APINT_ALGO_DIV_1,         // single-limb divisor
+    APINT_ALGO_DIV_KNUTH,
+    APINT_ALGO_DIV_NEWTON,
+    APINT_ALGO_DEC_CHUNKED,
+    APINT_ALGO_DEC_DC,
+    APINT_ALGO_POWMOD_MONT,   // odd modulus, Montgomery reduction
+    APINT_ALGO_POWMOD_DIV,    // even modulus, reduction by division
+    APINT_ALGO_GCD_BINARY,    // operands of up to two limbs
+    APINT_ALGO_GCD_LEHMER,    // one matrix of single-limb cofactors applied
+    APINT_ALGO_GCD_HGCD,
+    APINT_ALGO_PARALLEL,      // work handed to the worker pool
+    APINT_ALGO_COUNT
+} ApIntStatAlgo;
+
+/* Operand size buckets: bucket k counts largest operands of 2^(k-1)+1 to 2^k limbs */
+#define APINT_STATS_SIZE_BUCKETS 24
+
+typedef struct {
+    uint64_t calls[APINT_STAT_OP_COUNT];
+    uint64_t sizes[APINT_STAT_OP_COUNT][APINT_STATS_SIZE_BUCKETS];
+    uint64_t algo[APINT_ALGO_COUNT];
+    uint64_t allocs;      // alloc hook calls
+    uint64_t reallocs;    // realloc hook calls, i.e. values outgrowing their limbs
+    uint64_t frees;       // free hook calls
+    uint64_t alloc_bytes; // requested by allocs and by reallocs that grew
+    uint64_t free_bytes;  // released by frees and by reallocs that shrank
+} ApIntStats;
+
+int apint_stats_get(ApIntStats *stats);
+void apint_stats_reset(void);
+void apint_stats_dump(FILE *out);
 
 #ifdef __cplusplus
 }
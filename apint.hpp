@@ -0,0 +1,891 @@
+/*
+ * Arbitrary-precision integer data type, C++ interface
+ *
+ * cmath::ApInt owns one ApInt from apint.h and releases it with
+ * apint_destroy.  The arithmetic operators build expression objects
+ * rather than values; assigning one (or constructing from it) grows the
+ * destination once to a bound on the result's size and then evaluates
+ * the whole tree straight into it with the _into functions:
+ *
+ *     r = a + b - c;      // apint_set, apint_add_into, apint_sub_into on r
+ *     x += y * z;         // apint_addmul_into
+ *
+ * No intermediate values are created, except one for each compound
+ * operand of a product, quotient or remainder.  An integral operand
+ * (x * 2, x += 1) is held in the expression as a one-limb value.  An
+ * expression refers to its operands and must be used before they
+ * change, so don't keep one in an auto variable.
+ *
+ * Errors throw: std::invalid_argument for malformed strings,
+ * std::domain_error for division by zero and std::length_error for a
+ * left shift too long to represent.  A moved-from ApInt may only be
+ * assigned to or destroyed.
+ *
+ * cmath::FixedApInt<Bits> is a value type of a fixed width with no heap
+ * behind it, for add, sub, compare and shift in constexpr code and in
+ * hot loops on small values.
+ */
+
+#ifndef APINT_HPP
+#define APINT_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "apint.h"
+
+namespace cmath {
+
+class ApInt;
+
+namespace detail {
+
+// base of every expression, so that the operators only match these types
+template<class E>
+struct Expr {
+    const E &self() const {
+        return static_cast<const E&>(*this);
+    }
+};
+
+enum class Op { Add, Sub, Mul, Div, Mod };
+
+template<class T>
+using if_integral = typename std::enable_if<std::is_integral<T>::value, int>::type;
+
+template<class T>
+constexpr uint64_t magnitude(T val) {
+    if constexpr (std::is_signed<T>::value) {
+        if (val < 0) {
+            return 0 - (uint64_t)val;
+        }
+    }
+    return (uint64_t)val;
+}
+
+// an integral operand, as a one-limb value kept inside the expression
+// (like an ApIntView's), so x * 2 allocates no more than x * y
+struct Scalar : Expr<Scalar> {
+    ::ApInt v;
+
+    template<class T>
+    explicit Scalar(T val) : v() {
+        v.len = 1;
+        v.cap = 1;
+        if constexpr (std::is_signed<T>::value) {
+            v.flags = val < 0;
+        }
+        v.small[0] = magnitude(val);
+        v.data = v.small;
+    }
+
+    Scalar(const Scalar &other) : v(other.v) {
+        v.data = v.small;
+    }
+
+    Scalar &operator=(const Scalar &) = delete;
+
+    size_t limbs() const {
+        return 1;
+    }
+
+    bool refers_to(const ::ApInt *) const {
+        return false;
+    }
+};
+
+template<class T>
+struct is_leaf : std::disjunction<std::is_same<T, ApInt>, std::is_same<T, Scalar>> {};
+
+// values are held by reference, scalars and subexpressions (small and
+// short-lived) by value
+template<class T>
+using Hold = typename std::conditional<std::is_same<T, ApInt>::value, const T&, T>::type;
+
+template<Op O, class L, class R>
+struct Binary : Expr<Binary<O, L, R>> {
+    static constexpr Op op = O;
+    Hold<L> l;
+    Hold<R> r;
+
+    Binary(const L &l_, const R &r_) : l(l_), r(r_) {}
+
+    // bound on the result's length in limbs
+    size_t limbs() const {
+        switch (O) {
+        case Op::Add:
+        case Op::Sub:
+            return std::max(l.limbs(), r.limbs()) + 1;
+        case Op::Mul:
+            return l.limbs() + r.limbs();
+        case Op::Div:
+            return l.limbs();
+        default:
+            return r.limbs();
+        }
+    }
+
+    bool refers_to(const ::ApInt *p) const {
+        return l.refers_to(p) || r.refers_to(p);
+    }
+};
+
+template<class E>
+struct Negate : Expr<Negate<E>> {
+    Hold<E> e;
+
+    explicit Negate(const E &e_) : e(e_) {}
+
+    size_t limbs() const {
+        return e.limbs();
+    }
+
+    bool refers_to(const ::ApInt *p) const {
+        return e.refers_to(p);
+    }
+};
+
+template<class T>
+struct is_negate : std::false_type {};
+
+template<class E>
+struct is_negate<Negate<E>> : std::true_type {};
+
+} // namespace detail
+
+class ApInt : public detail::Expr<ApInt> {
+public:
+    ApInt() : p_(apint_create_from_u64(0UL)) {}
+
+    template<class T, class = typename std::enable_if<std::is_integral<T>::value>::type>
+    ApInt(T val) : p_(apint_create_from_u64(detail::magnitude(val))) {
+        if constexpr (std::is_signed<T>::value) {
+            if (val < 0) {
+                apint_negate_into(p_, p_);
+            }
+        }
+    }
+
+    ApInt(const ApInt &other) : ApInt() {
+        apint_set(p_, other.p_);
+    }
+
+    ApInt(ApInt &&other) noexcept : p_(other.p_) {
+        other.p_ = nullptr;
+    }
+
+    template<class E>
+    ApInt(const detail::Expr<E> &e) : ApInt() {
+        assign(e.self(), false);
+    }
+
+    ~ApInt() {
+        if (p_ != nullptr) {
+            apint_destroy(p_);
+        }
+    }
+
+    // takes ownership of a value from the C API
+    static ApInt adopt(::ApInt *ap) {
+        ApInt r(nullptr);
+        r.p_ = ap;
+        return r;
+    }
+
+    static ApInt from_hex(const char *hex) {
+        ApInt r;
+        if (apint_set_hex(r.p_, hex) != APINT_OK) {
+            throw std::invalid_argument("cmath::ApInt: malformed hex string");
+        }
+        return r;
+    }
+
+    static ApInt from_dec(const char *dec) {
+        ApInt r;
+        if (apint_set_dec(r.p_, dec) != APINT_OK) {
+            throw std::invalid_argument("cmath::ApInt: malformed decimal string");
+        }
+        return r;
+    }
+
+    ApInt &operator=(const ApInt &other) {
+        revive();
+        apint_set(p_, other.p_);
+        return *this;
+    }
+
+    ApInt &operator=(ApInt &&other) noexcept {
+        std::swap(p_, other.p_);
+        return *this;
+    }
+
+    template<class E>
+    ApInt &operator=(const detail::Expr<E> &e) {
+        revive();
+        assign(e.self(), false);
+        return *this;
+    }
+
+    template<class E>
+    ApInt &operator+=(const detail::Expr<E> &e) {
+        accumulate_into(e.self(), false);
+        return *this;
+    }
+
+    template<class E>
+    ApInt &operator-=(const detail::Expr<E> &e) {
+        accumulate_into(e.self(), true);
+        return *this;
+    }
+
+    template<class E>
+    ApInt &operator*=(const detail::Expr<E> &e);
+
+    template<class E>
+    ApInt &operator/=(const detail::Expr<E> &e);
+
+    template<class E>
+    ApInt &operator%=(const detail::Expr<E> &e);
+
+    template<class T, detail::if_integral<T> = 0>
+    ApInt &operator+=(T val) {
+        return *this += detail::Scalar(val);
+    }
+
+    template<class T, detail::if_integral<T> = 0>
+    ApInt &operator-=(T val) {
+        return *this -= detail::Scalar(val);
+    }
+
+    template<class T, detail::if_integral<T> = 0>
+    ApInt &operator*=(T val) {
+        return *this *= detail::Scalar(val);
+    }
+
+    template<class T, detail::if_integral<T> = 0>
+    ApInt &operator/=(T val) {
+        return *this /= detail::Scalar(val);
+    }
+
+    template<class T, detail::if_integral<T> = 0>
+    ApInt &operator%=(T val) {
+        return *this %= detail::Scalar(val);
+    }
+
+    ApInt &operator<<=(size_t bits) {
+        if (apint_lshift_bits_into(p_, p_, bits) != APINT_OK) {
+            throw std::length_error("cmath::ApInt: shifted value too long");
+        }
+        return *this;
+    }
+
+    ApInt &operator>>=(size_t bits) {
+        apint_rshift_bits_into(p_, p_, bits);
+        return *this;
+    }
+
+    ::ApInt *get() {
+        return p_;
+    }
+
+    const ::ApInt *get() const {
+        return p_;
+    }
+
+    // gives up ownership; the caller releases the value with apint_destroy
+    ::ApInt *release() {
+        ::ApInt *p = p_;
+        p_ = nullptr;
+        return p;
+    }
+
+    bool is_zero() const {
+        return apint_is_zero(p_);
+    }
+
+    bool is_negative() const {
+        return apint_is_negative(p_);
+    }
+
+    int compare(const ApInt &other) const {
+        return apint_compare(p_, other.p_);
+    }
+
+    std::string hex() const {
+        std::string s(apint_hex_size(p_), '\0');
+        apint_format_as_hex_into(&s[0], s.size(), p_);
+        s.pop_back();
+        return s;
+    }
+
+    std::string dec() const {
+        std::string s(apint_dec_size(p_), '\0');
+        apint_format_as_dec_into(&s[0], s.size(), p_);
+        s.resize(s.find('\0'));
+        return s;
+    }
+
+    // the expression interface, for a value as a leaf
+    size_t limbs() const {
+        return p_->len;
+    }
+
+    bool refers_to(const ::ApInt *p) const {
+        return p_ == p;
+    }
+
+private:
+    explicit ApInt(std::nullptr_t) : p_(nullptr) {}
+
+    void revive() {
+        if (p_ == nullptr) { // moved from
+            p_ = apint_create_from_u64(0UL);
+        }
+    }
+
+    void reserve(size_t limbs) {
+        if (limbs > p_->cap) {
+            apint_reserve(p_, (uint32_t)limbs);
+        }
+    }
+
+    static const ::ApInt *leaf(const ApInt &a) {
+        return a.p_;
+    }
+
+    static const ::ApInt *leaf(const detail::Scalar &s) {
+        return &s.v;
+    }
+
+    // e itself if it is a value, otherwise a new value holding it
+    template<class E>
+    static decltype(auto) evaluate(const E &e) {
+        if constexpr (detail::is_leaf<E>::value) {
+            return (e);
+        } else {
+            return ApInt(e);
+        }
+    }
+
+    // whether p_ may be written while e is evaluated into it: the leftmost
+    // chain of sums writes p_ first, so no other part of them may read it
+    template<class E>
+    bool safe_into(const E &e) const {
+        using detail::Op;
+        if constexpr (detail::is_leaf<E>::value) {
+            return true;
+        } else if constexpr (detail::is_negate<E>::value) {
+            return safe_into(e.e);
+        } else if constexpr (E::op == Op::Add || E::op == Op::Sub) {
+            return safe_into(e.l) && !e.r.refers_to(p_);
+        } else {
+            return true; // operands are read before the result is written
+        }
+    }
+
+    // *this = e, negated if neg
+    template<class E>
+    void assign(const E &e, bool neg) {
+        if (!safe_into(e)) {
+            ApInt t;
+            t.assign(e, neg);
+            std::swap(p_, t.p_);
+            return;
+        }
+        reserve(e.limbs());
+        assign_into(e, neg);
+    }
+
+    template<class E>
+    void assign_into(const E &e, bool neg) {
+        using detail::Op;
+        if constexpr (detail::is_leaf<E>::value) {
+            if (neg) {
+                apint_negate_into(p_, leaf(e));
+            } else {
+                apint_set(p_, leaf(e));
+            }
+        } else if constexpr (detail::is_negate<E>::value) {
+            assign_into(e.e, !neg);
+        } else if constexpr (E::op == Op::Add || E::op == Op::Sub) {
+            assign_into(e.l, neg);
+            accumulate(e.r, neg != (E::op == Op::Sub));
+        } else {
+            auto &&l = evaluate(e.l);
+            auto &&r = evaluate(e.r);
+            if constexpr (E::op == Op::Mul) {
+                apint_mul_into(p_, leaf(l), leaf(r));
+            } else {
+                int rc = E::op == Op::Div ? apint_divmod_into(p_, nullptr, leaf(l), leaf(r))
+                                          : apint_divmod_into(nullptr, p_, leaf(l), leaf(r));
+                if (rc == APINT_ERR_DIVZERO) {
+                    throw std::domain_error("cmath::ApInt: division by zero");
+                }
+            }
+            if (neg) {
+                apint_negate_into(p_, p_);
+            }
+        }
+    }
+
+    // *this += e, or -= when neg
+    template<class E>
+    void accumulate(const E &e, bool neg) {
+        using detail::Op;
+        if constexpr (detail::is_leaf<E>::value) {
+            if (neg) {
+                apint_sub_into(p_, p_, leaf(e));
+            } else {
+                apint_add_into(p_, p_, leaf(e));
+            }
+        } else if constexpr (detail::is_negate<E>::value) {
+            accumulate(e.e, !neg);
+        } else if constexpr (E::op == Op::Add || E::op == Op::Sub) {
+            accumulate(e.l, neg);
+            accumulate(e.r, neg != (E::op == Op::Sub));
+        } else if constexpr (E::op == Op::Mul) {
+            auto &&l = evaluate(e.l);
+            auto &&r = evaluate(e.r);
+            if (neg) {
+                apint_submul_into(p_, leaf(l), leaf(r));
+            } else {
+                apint_addmul_into(p_, leaf(l), leaf(r));
+            }
+        } else {
+            accumulate(ApInt(e), neg);
+        }
+    }
+
+    template<class E>
+    void accumulate_into(const E &e, bool neg) {
+        if (!detail::is_leaf<E>::value && e.refers_to(p_)) { // x += x * y: take x's value first
+            accumulate(ApInt(e), neg);
+            return;
+        }
+        reserve(std::max(limbs(), e.limbs()) + 1);
+        accumulate(e, neg);
+    }
+
+    ::ApInt *p_;
+};
+
+template<class L, class R>
+detail::Binary<detail::Op::Add, L, R> operator+(const detail::Expr<L> &l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Add, L, R>(l.self(), r.self());
+}
+
+template<class L, class R>
+detail::Binary<detail::Op::Sub, L, R> operator-(const detail::Expr<L> &l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Sub, L, R>(l.self(), r.self());
+}
+
+template<class L, class R>
+detail::Binary<detail::Op::Mul, L, R> operator*(const detail::Expr<L> &l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Mul, L, R>(l.self(), r.self());
+}
+
+// truncating, as apint_divmod
+template<class L, class R>
+detail::Binary<detail::Op::Div, L, R> operator/(const detail::Expr<L> &l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Div, L, R>(l.self(), r.self());
+}
+
+template<class L, class R>
+detail::Binary<detail::Op::Mod, L, R> operator%(const detail::Expr<L> &l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Mod, L, R>(l.self(), r.self());
+}
+
+// an integral operand on either side, as the comparisons take one through ApInt(T)
+template<class L, class T, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Add, L, detail::Scalar> operator+(const detail::Expr<L> &l, T r) {
+    return detail::Binary<detail::Op::Add, L, detail::Scalar>(l.self(), detail::Scalar(r));
+}
+
+template<class T, class R, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Add, detail::Scalar, R> operator+(T l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Add, detail::Scalar, R>(detail::Scalar(l), r.self());
+}
+
+template<class L, class T, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Sub, L, detail::Scalar> operator-(const detail::Expr<L> &l, T r) {
+    return detail::Binary<detail::Op::Sub, L, detail::Scalar>(l.self(), detail::Scalar(r));
+}
+
+template<class T, class R, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Sub, detail::Scalar, R> operator-(T l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Sub, detail::Scalar, R>(detail::Scalar(l), r.self());
+}
+
+template<class L, class T, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Mul, L, detail::Scalar> operator*(const detail::Expr<L> &l, T r) {
+    return detail::Binary<detail::Op::Mul, L, detail::Scalar>(l.self(), detail::Scalar(r));
+}
+
+template<class T, class R, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Mul, detail::Scalar, R> operator*(T l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Mul, detail::Scalar, R>(detail::Scalar(l), r.self());
+}
+
+template<class L, class T, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Div, L, detail::Scalar> operator/(const detail::Expr<L> &l, T r) {
+    return detail::Binary<detail::Op::Div, L, detail::Scalar>(l.self(), detail::Scalar(r));
+}
+
+template<class T, class R, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Div, detail::Scalar, R> operator/(T l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Div, detail::Scalar, R>(detail::Scalar(l), r.self());
+}
+
+template<class L, class T, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Mod, L, detail::Scalar> operator%(const detail::Expr<L> &l, T r) {
+    return detail::Binary<detail::Op::Mod, L, detail::Scalar>(l.self(), detail::Scalar(r));
+}
+
+template<class T, class R, detail::if_integral<T> = 0>
+detail::Binary<detail::Op::Mod, detail::Scalar, R> operator%(T l, const detail::Expr<R> &r) {
+    return detail::Binary<detail::Op::Mod, detail::Scalar, R>(detail::Scalar(l), r.self());
+}
+
+template<class E>
+detail::Negate<E> operator-(const detail::Expr<E> &e) {
+    return detail::Negate<E>(e.self());
+}
+
+template<class E>
+ApInt &ApInt::operator*=(const detail::Expr<E> &e) {
+    return *this = *this * e;
+}
+
+template<class E>
+ApInt &ApInt::operator/=(const detail::Expr<E> &e) {
+    return *this = *this / e;
+}
+
+template<class E>
+ApInt &ApInt::operator%=(const detail::Expr<E> &e) {
+    return *this = *this % e;
+}
+
+inline ApInt operator<<(const ApInt &a, size_t bits) {
+    ::ApInt *r = apint_lshift_bits(a.get(), bits);
+    if (r == nullptr) {
+        throw std::length_error("cmath::ApInt: shifted value too long");
+    }
+    return ApInt::adopt(r);
+}
+
+inline ApInt operator>>(const ApInt &a, size_t bits) {
+    return ApInt::adopt(apint_rshift_bits(a.get(), bits));
+}
+
+inline bool operator==(const ApInt &a, const ApInt &b) {
+    return a.compare(b) == 0;
+}
+
+inline bool operator!=(const ApInt &a, const ApInt &b) {
+    return a.compare(b) != 0;
+}
+
+inline bool operator<(const ApInt &a, const ApInt &b) {
+    return a.compare(b) < 0;
+}
+
+inline bool operator<=(const ApInt &a, const ApInt &b) {
+    return a.compare(b) <= 0;
+}
+
+inline bool operator>(const ApInt &a, const ApInt &b) {
+    return a.compare(b) > 0;
+}
+
+inline bool operator>=(const ApInt &a, const ApInt &b) {
+    return a.compare(b) >= 0;
+}
+
+/*
+ * FixedApInt<Bits>: the same sign and magnitude representation as ApInt,
+ * with the magnitude in a std::array of Bits / 64 limbs instead of the
+ * heap.  Every operation is constexpr, with loops of a fixed count that
+ * the compiler unrolls, and follows the ApInt function it mirrors
+ * exactly, down to -0 and the rounding of >> on negative values, so
+ * converting the result of FixedApInt a + b gives what apint_add gives
+ * on the converted operands.  The exception is a magnitude that
+ * outgrows Bits: it wraps, which add_overflow and sub_overflow report.
+ * Converting from an ApInt that does not fit throws std::out_of_range.
+ */
+template<size_t Bits>
+class FixedApInt {
+    static_assert(Bits > 0 && Bits % 64 == 0, "FixedApInt holds whole limbs");
+
+public:
+    static constexpr size_t limb_count = Bits / 64;
+
+    std::array<uint64_t, limb_count> limbs{}; // magnitude, least significant first
+    bool negative = false;                    // the flags of an ApInt, so -0 exists too
+
+    constexpr FixedApInt() = default;
+
+    template<class T, class = typename std::enable_if<std::is_integral<T>::value>::type>
+    constexpr FixedApInt(T val) {
+        if constexpr (std::is_signed<T>::value) {
+            negative = val < 0;
+            limbs[0] = negative ? 0 - (uint64_t)val : (uint64_t)val;
+        } else {
+            limbs[0] = (uint64_t)val;
+        }
+    }
+
+    explicit FixedApInt(const ApInt &v) {
+        const ::ApInt *p = v.get();
+        size_t n = p->len;
+        while (n > 1 && p->data[n - 1] == 0) {
+            n--;
+        }
+        if (n > limb_count) {
+            throw std::out_of_range("cmath::FixedApInt: value wider than Bits");
+        }
+        for (size_t i = 0; i < n; i++) {
+            limbs[i] = p->data[i];
+        }
+        negative = p->flags == 1;
+    }
+
+    // a hex string as apint_set_hex takes it, for constants built at compile time
+    static constexpr FixedApInt from_hex(std::string_view hex) {
+        FixedApInt r;
+        size_t i = 0;
+        if (!hex.empty() && hex[0] == '-') {
+            r.negative = true;
+            i++;
+        }
+        if (i == hex.size()) {
+            throw std::invalid_argument("cmath::FixedApInt: malformed hex string");
+        }
+        for (size_t bit = 0, j = hex.size(); j-- > i; bit += 4) {
+            char c = hex[j];
+            uint64_t d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                       : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 16;
+            if (d == 16) {
+                throw std::invalid_argument("cmath::FixedApInt: malformed hex string");
+            }
+            if (d != 0 && bit >= Bits) {
+                throw std::out_of_range("cmath::FixedApInt: value wider than Bits");
+            }
+            if (d != 0) {
+                r.limbs[bit / 64] |= d << (bit % 64);
+            }
+        }
+        return r;
+    }
+
+    ApInt to_apint() const {
+        ::ApInt *p = apint_create_from_u64(0UL);
+        apint_reserve(p, limb_count);
+        size_t n = limb_count;
+        for (size_t i = 0; i < n; i++) {
+            p->data[i] = limbs[i];
+        }
+        while (n > 1 && limbs[n - 1] == 0) {
+            n--;
+        }
+        p->len = (uint32_t)n;
+        p->flags = negative;
+        return ApInt::adopt(p);
+    }
+
+    constexpr bool is_zero() const {
+        return size() == 0;
+    }
+
+    // apint_compare: sign first (-0 below +0), then magnitude
+    constexpr int compare(const FixedApInt &b) const {
+        if (negative != b.negative) {
+            return negative ? -1 : 1;
+        }
+        int c = cmp_mag(limbs, b.limbs);
+        return negative ? -c : c;
+    }
+
+    // r = a + b and r = a - b as apint_add and apint_sub; true if |r| wrapped
+    friend constexpr bool add_overflow(const FixedApInt &a, const FixedApInt &b, FixedApInt &r) {
+        return add_signed(a, b, b.negative, r);
+    }
+
+    friend constexpr bool sub_overflow(const FixedApInt &a, const FixedApInt &b, FixedApInt &r) {
+        return add_signed(a, b, !b.negative, r);
+    }
+
+    friend constexpr FixedApInt operator+(const FixedApInt &a, const FixedApInt &b) {
+        FixedApInt r;
+        add_overflow(a, b, r);
+        return r;
+    }
+
+    friend constexpr FixedApInt operator-(const FixedApInt &a, const FixedApInt &b) {
+        FixedApInt r;
+        sub_overflow(a, b, r);
+        return r;
+    }
+
+    // apint_lshift_bits, dropping the bits shifted past Bits
+    friend constexpr FixedApInt operator<<(const FixedApInt &a, size_t bits) {
+        FixedApInt r;
+        if (a.is_zero()) {
+            return r;
+        }
+        size_t q = bits / 64;
+        unsigned s = bits % 64;
+#pragma GCC unroll 16
+        for (size_t i = 0; i < limb_count; i++) {
+            uint64_t hi = i >= q ? a.limbs[i - q] : 0;
+            uint64_t lo = i >= q + 1 ? a.limbs[i - q - 1] : 0;
+            r.limbs[i] = s == 0 ? hi : hi << s | lo >> (64 - s);
+        }
+        r.negative = a.negative && !r.is_zero();
+        return r;
+    }
+
+    // apint_rshift_bits: floor, so negative values that lose 1 bits round away from zero
+    friend constexpr FixedApInt operator>>(const FixedApInt &a, size_t bits) {
+        FixedApInt r;
+        size_t an = a.size();
+        size_t q = bits / 64;
+        unsigned s = bits % 64;
+        if (q >= an) { // nothing left but the rounding
+            r.limbs[0] = an > 0 && a.negative;
+            r.negative = r.limbs[0] != 0;
+            return r;
+        }
+        bool round = false;
+        if (a.negative) { // any 1 bits shifted out?
+            for (size_t i = 0; i < q; i++) {
+                round |= a.limbs[i] != 0;
+            }
+            round |= s > 0 && (a.limbs[q] & ((uint64_t(1) << s) - 1)) != 0;
+        }
+#pragma GCC unroll 16
+        for (size_t i = 0; i < limb_count; i++) {
+            uint64_t lo = i + q < limb_count ? a.limbs[i + q] : 0;
+            uint64_t hi = i + q + 1 < limb_count ? a.limbs[i + q + 1] : 0;
+            r.limbs[i] = s == 0 ? lo : lo >> s | hi << (64 - s);
+        }
+        if (round) {
+            add_mag_1(r.limbs);
+        }
+        r.negative = a.negative && !r.is_zero();
+        return r;
+    }
+
+    constexpr FixedApInt &operator+=(const FixedApInt &b) {
+        return *this = *this + b;
+    }
+
+    constexpr FixedApInt &operator-=(const FixedApInt &b) {
+        return *this = *this - b;
+    }
+
+    friend constexpr bool operator==(const FixedApInt &a, const FixedApInt &b) {
+        return a.compare(b) == 0;
+    }
+
+    friend constexpr bool operator!=(const FixedApInt &a, const FixedApInt &b) {
+        return a.compare(b) != 0;
+    }
+
+    friend constexpr bool operator<(const FixedApInt &a, const FixedApInt &b) {
+        return a.compare(b) < 0;
+    }
+
+    friend constexpr bool operator<=(const FixedApInt &a, const FixedApInt &b) {
+        return a.compare(b) <= 0;
+    }
+
+    friend constexpr bool operator>(const FixedApInt &a, const FixedApInt &b) {
+        return a.compare(b) > 0;
+    }
+
+    friend constexpr bool operator>=(const FixedApInt &a, const FixedApInt &b) {
+        return a.compare(b) >= 0;
+    }
+
+private:
+    using Limbs = std::array<uint64_t, limb_count>;
+
+    // limbs up to the highest nonzero one
+    constexpr size_t size() const {
+        size_t n = limb_count;
+        while (n > 0 && limbs[n - 1] == 0) {
+            n--;
+        }
+        return n;
+    }
+
+    static constexpr int cmp_mag(const Limbs &a, const Limbs &b) {
+#pragma GCC unroll 16
+        for (size_t k = 1; k <= limb_count; k++) {
+            size_t i = limb_count - k;
+            if (a[i] != b[i]) {
+                return a[i] > b[i] ? 1 : -1;
+            }
+        }
+        return 0;
+    }
+
+    static constexpr bool add_mag(Limbs &r, const Limbs &a, const Limbs &b) {
+        uint64_t carry = 0;
+#pragma GCC unroll 16
+        for (size_t i = 0; i < limb_count; i++) {
+            uint64_t s = a[i] + carry;
+            carry = s < carry;
+            r[i] = s + b[i];
+            carry += r[i] < s;
+        }
+        return carry != 0;
+    }
+
+    static constexpr void sub_mag(Limbs &r, const Limbs &a, const Limbs &b) {
+        uint64_t borrow = 0;
+#pragma GCC unroll 16
+        for (size_t i = 0; i < limb_count; i++) {
+            uint64_t d = a[i] - b[i];
+            uint64_t out = a[i] < b[i];
+            r[i] = d - borrow;
+            borrow = out | (d < borrow);
+        }
+    }
+
+    static constexpr void add_mag_1(Limbs &r) {
+        for (size_t i = 0; i < limb_count && ++r[i] == 0; i++) {
+        }
+    }
+
+    // apint_add_signed: the larger magnitude gives the sign, zero is never negative
+    static constexpr bool add_signed(const FixedApInt &a, const FixedApInt &b, bool bneg, FixedApInt &r) {
+        const FixedApInt *x = &a, *y = &b;
+        bool xneg = a.negative, yneg = bneg;
+        if (cmp_mag(a.limbs, b.limbs) < 0) {
+            x = &b;
+            y = &a;
+            xneg = bneg;
+            yneg = a.negative;
+        }
+        bool wrapped = false;
+        if (xneg == yneg) {
+            wrapped = add_mag(r.limbs, x->limbs, y->limbs);
+        } else {
+            sub_mag(r.limbs, x->limbs, y->limbs);
+        }
+        r.negative = xneg && !r.is_zero();
+        return wrapped;
+    }
+};
+
+} // namespace cmath
+
+#endif
@@ -0,0 +1,834 @@
+/*
+ * Benchmarks for the arbitrary-precision integer data type
+ *
+ * Usage:
+ *   apintBench tune    measure the algorithm cross-over points that
+ *                      apint.c uses as its tune_params defaults
+ *   apintBench small   heap allocations and ns per operation on values
+ *                      of one and two limbs
+ *   apintBench sweep [--json] [--max-bits N] [--ops op,op...] [--threads N]
+ *                      ns/op, limbs/ns, allocations/op and cycles/op of
+ *                      each operation on operands of 64 bits up to 16M
+ *                      bits, as CSV (or JSON) on stdout; gcd_naive is
+ *                      Euclid by repeated apint_sub, for comparison
+ *   apintBench compare [--threshold PCT] OLD NEW
+ *                      diff two sweep outputs, flagging operations that
+ *                      got more than PCT percent (default 10) slower;
+ *                      exits with status 2 if any did
+ *   apintBench scaling [--max-ratio R]
+ *                      time 2n by n limb division and the square root
+ *                      of 2n limbs against an n by n product M(n) from
+ *                      1024 to 65536 limbs; exits with status 2 if
+ *                      either took more than R (default 6) times M(n)
+ *                      anywhere
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "apint.h"
+
+static uint64_t bench_rand_state = 0x2545F4914F6CDD1DUL;
+
+static uint64_t bench_rand(void) {
+    uint64_t x = bench_rand_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    bench_rand_state = x;
+    return x;
+}
+
+// random non-negative value with exactly len limbs
+static ApInt *random_apint(uint32_t len) {
+    ApInt *ap = apint_create_from_u64(0UL);
+    apint_reserve(ap, len);
+    ap->len = len;
+    for (uint32_t i = 0; i < len; i++) {
+        ap->data[i] = bench_rand();
+    }
+    ap->data[len - 1] |= 1UL << 63;
+    return ap;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef ApInt *(*BinaryOp)(const ApInt *a, const ApInt *b);
+
+// best-of-five ns per op(a, b), each trial running for at least ~2ms
+static double time_op(BinaryOp op, const ApInt *a, const ApInt *b) {
+    double best = 0;
+    long reps = 1;
+    for (int trial = 0; trial < 5; trial++) {
+        double start, elapsed;
+        for (;;) {
+            start = now_ns();
+            for (long i = 0; i < reps; i++) {
+                apint_destroy(op(a, b));
+            }
+            elapsed = now_ns() - start;
+            if (elapsed >= 2e6) {
+                break;
+            }
+            reps *= 2;
+        }
+        double per_op = elapsed / reps;
+        if (trial == 0 || per_op < best) {
+            best = per_op;
+        }
+    }
+    return best;
+}
+
+/*
+ * Find the smallest size at which algorithm "fast" (selected by setting
+ * param to the size itself, so only the top level uses it) beats "slow"
+ * (param out of reach) on this size and the next two probed sizes.
+ * Operands are n limbs each, or 2n and n limbs for division.
+ */
+static size_t find_crossover(BinaryOp op, ApIntTuneParam param, size_t from, size_t to, size_t step, double growth) {
+    int wins = 0;
+    size_t first_win = 0;
+    for (size_t n = from; n <= to; n = n * growth > n + step ? (size_t)(n * growth) : n + step) {
+        ApInt *a = random_apint(op == apint_div ? 2 * n : n);
+        ApInt *b = random_apint(n);
+        apint_tune_set(param, SIZE_MAX);
+        double slow = time_op(op, a, b);
+        apint_tune_set(param, n);
+        double fast = time_op(op, a, b);
+        apint_destroy(a);
+        apint_destroy(b);
+        printf("  %5zu limbs: %12.0f ns  vs %12.0f ns  (%.3f)\n", n, slow, fast, fast / slow);
+        if (fast < slow) {
+            if (wins++ == 0) {
+                first_win = n;
+            }
+            if (wins == 3) {
+                return first_win;
+            }
+        } else {
+            wins = 0;
+        }
+    }
+    return wins > 0 ? first_win : to;
+}
+
+// decimal round trip of a, in the shape find_crossover expects
+static ApInt *dec_round_trip(const ApInt *a, const ApInt *b) {
+    (void)b;
+    char *s = apint_format_as_dec(a);
+    ApInt *r = apint_create_from_dec(s);
+    apint_free_str(s);
+    return r;
+}
+
+// a squared, in the shape find_crossover expects
+static ApInt *sqr_op(const ApInt *a, const ApInt *b) {
+    (void)b;
+    return apint_sqr(a);
+}
+
+static int tune(void) {
+    printf("kernels: %s\n", apint_kernels());
+    printf("schoolbook vs Karatsuba:\n");
+    apint_tune_set(APINT_TUNE_MUL_TOOM3, SIZE_MAX);
+    apint_tune_set(APINT_TUNE_MUL_NTT, SIZE_MAX);
+    size_t kara = find_crossover(apint_mul, APINT_TUNE_MUL_KARATSUBA, 8, 160, 4, 1.0);
+    apint_tune_set(APINT_TUNE_MUL_KARATSUBA, kara);
+
+    printf("schoolbook vs Karatsuba squaring:\n");
+    size_t sqr = find_crossover(sqr_op, APINT_TUNE_SQR_KARATSUBA, 8, 240, 4, 1.0);
+    apint_tune_set(APINT_TUNE_SQR_KARATSUBA, sqr);
+
+    printf("Karatsuba vs Toom-3:\n");
+    size_t toom = find_crossover(apint_mul, APINT_TUNE_MUL_TOOM3, kara * 2, 800, 16, 1.0);
+    apint_tune_set(APINT_TUNE_MUL_TOOM3, toom);
+
+    printf("Toom-3 vs NTT:\n");
+    size_t ntt = find_crossover(apint_mul, APINT_TUNE_MUL_NTT, toom * 2, 65536, 64, 1.15);
+    apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+
+    printf("Knuth vs Newton division (2n by n limbs):\n");
+    size_t newton = find_crossover(apint_div, APINT_TUNE_DIV_NEWTON, 16, 4000, 8, 1.15);
+    apint_tune_set(APINT_TUNE_DIV_NEWTON, newton);
+
+    printf("chunked vs divide-and-conquer decimal conversion:\n");
+    size_t dec = find_crossover(dec_round_trip, APINT_TUNE_DEC_DC, 4, 400, 2, 1.1);
+    apint_tune_set(APINT_TUNE_DEC_DC, dec);
+
+    printf("Lehmer vs half-gcd:\n");
+    size_t hgcd = find_crossover(apint_gcd, APINT_TUNE_GCD_HGCD, 50, 4000, 25, 1.15);
+    apint_tune_set(APINT_TUNE_GCD_HGCD, hgcd);
+
+    // the pool cross-overs depend on the core count, so measure with every online CPU
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t par = apint_tune_get(APINT_TUNE_PARALLEL), par_add = apint_tune_get(APINT_TUNE_PARALLEL_ADD);
+    if (cpus > 1 && apint_set_threads((unsigned)cpus) > 1) {
+        printf("serial vs %ld threads, multiplication:\n", cpus);
+        par = find_crossover(apint_mul, APINT_TUNE_PARALLEL, 64, 40000, 64, 1.25);
+        apint_tune_set(APINT_TUNE_PARALLEL, par);
+        printf("serial vs %ld threads, addition:\n", cpus);
+        par_add = find_crossover(apint_add, APINT_TUNE_PARALLEL_ADD, 1024, 1 << 22, 1024, 1.5);
+        apint_tune_set(APINT_TUNE_PARALLEL_ADD, par_add);
+        apint_set_threads(1);
+    } else {
+        printf("one CPU: APINT_TUNE_PARALLEL and APINT_TUNE_PARALLEL_ADD keep their defaults\n");
+    }
+
+    printf("APINT_TUNE_MUL_KARATSUBA = %zu\n", kara);
+    printf("APINT_TUNE_MUL_TOOM3 = %zu\n", toom);
+    printf("APINT_TUNE_MUL_NTT = %zu\n", ntt);
+    printf("APINT_TUNE_SQR_KARATSUBA = %zu\n", sqr);
+    printf("APINT_TUNE_DIV_NEWTON = %zu\n", newton);
+    printf("APINT_TUNE_DEC_DC = %zu\n", dec);
+    printf("APINT_TUNE_GCD_HGCD = %zu\n", hgcd);
+    printf("APINT_TUNE_PARALLEL = %zu\n", par);
+    printf("APINT_TUNE_PARALLEL_ADD = %zu\n", par_add);
+    return 0;
+}
+
+// allocator hooks that count calls into the heap, and allocations alone
+static long heap_calls;
+static long heap_allocs;
+
+static void *counting_alloc(size_t size) {
+    heap_calls++;
+    heap_allocs++;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *ptr, size_t old_size, size_t new_size) {
+    (void)old_size;
+    heap_calls++;
+    heap_allocs++;
+    return realloc(ptr, new_size);
+}
+
+static void counting_free(void *ptr, size_t size) {
+    (void)size;
+    heap_calls++;
+    free(ptr);
+}
+
+// operands of one and two limbs, both signs
+#define SMALL_COUNT 64
+static ApInt *small_vals[SMALL_COUNT];
+static ApInt *small_dst;
+static ApInt *small_next[SMALL_COUNT]; // small_vals rotated by one, the second operands
+static ApInt *small_dsts[SMALL_COUNT];
+static volatile int small_sink;
+
+static void small_create(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_create_from_u64(i));
+    }
+}
+
+static void small_add(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_add(small_vals[i % SMALL_COUNT], small_vals[(i + 1) % SMALL_COUNT]));
+    }
+}
+
+static void small_add_into(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_add_into(small_dst, small_vals[i % SMALL_COUNT], small_vals[(i + 1) % SMALL_COUNT]);
+    }
+}
+
+static void small_add_batch(long reps) {
+    for (long i = 0; i < reps; i += SMALL_COUNT) {
+        apint_add_batch(small_dsts, (const ApInt *const *)small_vals, (const ApInt *const *)small_next, SMALL_COUNT);
+    }
+}
+
+static void small_sub_into(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_sub_into(small_dst, small_vals[i % SMALL_COUNT], small_vals[(i + 1) % SMALL_COUNT]);
+    }
+}
+
+static void small_compare(long reps) {
+    int acc = 0;
+    for (long i = 0; i < reps; i++) {
+        acc += apint_compare(small_vals[i % SMALL_COUNT], small_vals[(i + 1) % SMALL_COUNT]);
+    }
+    small_sink = acc;
+}
+
+static void small_lshift(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_lshift_n(small_vals[i % SMALL_COUNT], 7));
+    }
+}
+
+// best-of-five ns per iteration of fn, and heap calls per iteration
+static double time_small(void (*fn)(long), double *calls_per_op) {
+    double best = 0;
+    long reps = 1024;
+    for (int trial = 0; trial < 5; trial++) {
+        double start, elapsed;
+        for (;;) {
+            heap_calls = 0;
+            start = now_ns();
+            fn(reps);
+            elapsed = now_ns() - start;
+            if (elapsed >= 2e6) {
+                break;
+            }
+            reps *= 2;
+        }
+        *calls_per_op = (double)heap_calls / reps;
+        if (trial == 0 || elapsed / reps < best) {
+            best = elapsed / reps;
+        }
+    }
+    return best;
+}
+
+static int small(void) {
+    static const struct {
+        const char *name;
+        void (*fn)(long);
+    } ops[] = {
+        { "create_from_u64+destroy", small_create },
+        { "apint_add+destroy", small_add },
+        { "apint_add_into", small_add_into },
+        { "apint_add_batch", small_add_batch },
+        { "apint_sub_into", small_sub_into },
+        { "apint_compare", small_compare },
+        { "apint_lshift_n+destroy", small_lshift },
+    };
+    apint_set_allocator(counting_alloc, counting_realloc, counting_free);
+    for (int i = 0; i < SMALL_COUNT; i++) {
+        small_vals[i] = random_apint(1 + i % 2);
+        small_vals[i]->data[small_vals[i]->len - 1] >>= 2; // sums stay within two limbs
+        small_vals[i]->flags = (i / 2) % 2;
+    }
+    small_dst = apint_create_from_u64(0UL);
+    for (int i = 0; i < SMALL_COUNT; i++) {
+        small_next[i] = small_vals[(i + 1) % SMALL_COUNT];
+        small_dsts[i] = apint_create_from_u64(0UL);
+    }
+    printf("kernels: %s\n", apint_kernels());
+    printf("%-26s %10s %12s\n", "operation", "ns/op", "heap calls");
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        double calls;
+        double ns = time_small(ops[i].fn, &calls);
+        printf("%-26s %10.1f %12.2f\n", ops[i].name, ns, calls);
+    }
+    for (int i = 0; i < SMALL_COUNT; i++) {
+        apint_destroy(small_vals[i]);
+        apint_destroy(small_dsts[i]);
+    }
+    apint_destroy(small_dst);
+    apint_set_allocator(NULL, NULL, NULL);
+    return 0;
+}
+
+/*
+ * Cycle counter: the CPU's own cycle count through perf_event_open where
+ * the kernel allows it, otherwise the time stamp counter (reference
+ * cycles at a fixed rate) on x86, otherwise nothing.
+ */
+static int cycles_fd = -1;
+static const char *cycles_source = "none";
+
+static void cycles_init(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cycles_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (cycles_fd >= 0) {
+        cycles_source = "perf";
+        return;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    cycles_source = "rdtsc";
+#endif
+}
+
+static uint64_t cycles_now(void) {
+#ifdef __linux__
+    uint64_t count;
+    if (cycles_fd >= 0 && read(cycles_fd, &count, sizeof(count)) == sizeof(count)) {
+        return count;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Operands of the current sweep size n: a and b of n limbs, wide of 2n
+ * limbs (the dividend for div), a in hex and decimal, and for powmod
+ * the context of b, which is odd so it is a Montgomery modulus.
+ */
+static ApInt *sweep_a, *sweep_b, *sweep_a_copy, *sweep_wide, *sweep_dst;
+static char *sweep_hex, *sweep_dec;
+static ApIntMontCtx *sweep_ctx;
+
+static void sweep_create_from_hex(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_create_from_hex(sweep_hex));
+    }
+}
+
+static void sweep_format_as_hex(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_free_str(apint_format_as_hex(sweep_a));
+    }
+}
+
+static void sweep_create_from_dec(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_create_from_dec(sweep_dec));
+    }
+}
+
+static void sweep_format_as_dec(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_free_str(apint_format_as_dec(sweep_a));
+    }
+}
+
+static void sweep_add(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_add(sweep_a, sweep_b));
+    }
+}
+
+static void sweep_sub(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_sub(sweep_a, sweep_b));
+    }
+}
+
+static void sweep_add_into(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_add_into(sweep_dst, sweep_a, sweep_b);
+    }
+}
+
+// equal values, so every limb is looked at
+static void sweep_compare(long reps) {
+    int acc = 0;
+    for (long i = 0; i < reps; i++) {
+        acc += apint_compare(sweep_a, sweep_a_copy);
+    }
+    small_sink = acc;
+}
+
+static void sweep_lshift_bits(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_lshift_bits(sweep_a, 37));
+    }
+}
+
+static void sweep_rshift_bits(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_rshift_bits(sweep_a, 37));
+    }
+}
+
+static void sweep_and(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_and(sweep_a, sweep_b));
+    }
+}
+
+static void sweep_xor(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_xor(sweep_a, sweep_b));
+    }
+}
+
+static void sweep_mul(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_mul(sweep_a, sweep_b));
+    }
+}
+
+static void sweep_sqr(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_sqr(sweep_a));
+    }
+}
+
+static void sweep_div(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_destroy(apint_div(sweep_wide, sweep_b));
+    }
+}
+
+static void sweep_powmod(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_mont_powmod_into(sweep_dst, sweep_a, sweep_b, sweep_ctx);
+    }
+}
+
+static void sweep_gcd(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_gcd_into(sweep_dst, sweep_a, sweep_b);
+    }
+}
+
+static void sweep_gcdext(long reps) {
+    ApInt *s = apint_create_from_u64(0), *t = apint_create_from_u64(0);
+    for (long i = 0; i < reps; i++) {
+        apint_gcdext_into(sweep_dst, s, t, sweep_a, sweep_b);
+    }
+    apint_destroy(s);
+    apint_destroy(t);
+}
+
+// random a and b are coprime about 61% of the time; the work is the same either way
+static void sweep_invert(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_invert_into(sweep_dst, sweep_a, sweep_b);
+    }
+}
+
+// Euclid by subtraction alone, the baseline apint_gcd replaces
+static void sweep_gcd_naive(long reps) {
+    ApInt *x = apint_create_from_u64(0), *y = apint_create_from_u64(0);
+    for (long i = 0; i < reps; i++) {
+        apint_set(x, sweep_a);
+        apint_set(y, sweep_b);
+        while (!apint_is_zero(y)) {
+            if (apint_compare(x, y) < 0) {
+                ApInt *t = x;
+                x = y;
+                y = t;
+            }
+            apint_sub_into(x, x, y);
+        }
+    }
+    apint_destroy(x);
+    apint_destroy(y);
+}
+
+static void sweep_sqrt(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_sqrtrem_into(sweep_dst, NULL, sweep_a);
+    }
+}
+
+static void sweep_root3(long reps) {
+    for (long i = 0; i < reps; i++) {
+        apint_root_into(sweep_dst, sweep_a, 3);
+    }
+}
+
+// max_bits keeps the slower-growing operations to sizes that finish
+static const struct {
+    const char *name;
+    void (*fn)(long);
+    size_t max_bits;
+} sweep_ops[] = {
+    { "create_from_hex", sweep_create_from_hex, SIZE_MAX },
+    { "format_as_hex", sweep_format_as_hex, SIZE_MAX },
+    { "add", sweep_add, SIZE_MAX },
+    { "sub", sweep_sub, SIZE_MAX },
+    { "add_into", sweep_add_into, SIZE_MAX },
+    { "compare", sweep_compare, SIZE_MAX },
+    { "lshift_bits", sweep_lshift_bits, SIZE_MAX },
+    { "rshift_bits", sweep_rshift_bits, SIZE_MAX },
+    { "and", sweep_and, SIZE_MAX },
+    { "xor", sweep_xor, SIZE_MAX },
+    { "mul", sweep_mul, SIZE_MAX },
+    { "sqr", sweep_sqr, SIZE_MAX },
+    { "div", sweep_div, SIZE_MAX },
+    { "create_from_dec", sweep_create_from_dec, 1UL << 22 },
+    { "format_as_dec", sweep_format_as_dec, 1UL << 22 },
+    { "powmod", sweep_powmod, 4096 },
+    { "gcd", sweep_gcd, 1UL << 22 },
+    { "gcdext", sweep_gcdext, 1UL << 20 },
+    { "invert", sweep_invert, 1UL << 20 },
+    { "gcd_naive", sweep_gcd_naive, 4096 },
+    { "sqrt", sweep_sqrt, 1UL << 22 },
+    { "root3", sweep_root3, 1UL << 22 },
+};
+
+typedef struct {
+    double ns, cycles, allocs;
+} SweepResult;
+
+// best of up to five trials of at least ~2ms, fewer once ~1s has gone by
+static SweepResult time_sweep(void (*fn)(long)) {
+    SweepResult best = { 0, 0, 0 };
+    double total = 0;
+    long reps = 1;
+    for (int trial = 0; trial < 5 && total < 1e9; trial++) {
+        double start, elapsed;
+        uint64_t cycles;
+        for (;;) {
+            heap_allocs = 0;
+            start = now_ns();
+            uint64_t c0 = cycles_now();
+            fn(reps);
+            cycles = cycles_now() - c0;
+            elapsed = now_ns() - start;
+            total += elapsed;
+            if (elapsed >= 2e6) {
+                break;
+            }
+            reps *= 2;
+        }
+        if (trial == 0 || elapsed / reps < best.ns) {
+            best.ns = elapsed / reps;
+            best.cycles = (double)cycles / reps;
+            best.allocs = (double)heap_allocs / reps;
+        }
+    }
+    return best;
+}
+
+// op listed in a comma-separated list, or no list given
+static int sweep_selected(const char *list, const char *op) {
+    if (list == NULL) {
+        return 1;
+    }
+    size_t len = strlen(op);
+    for (const char *p = list; p != NULL; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL) {
+        if (strncmp(p, op, len) == 0 && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int sweep(int argc, char **argv) {
+    int json = 0;
+    size_t max_bits = 1UL << 24;
+    const char *ops = NULL;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "--max-bits") == 0 && i + 1 < argc) {
+            max_bits = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            ops = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            apint_set_threads((unsigned)strtoul(argv[++i], NULL, 0));
+        } else {
+            fprintf(stderr, "sweep: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    int progress = isatty(2);
+    cycles_init();
+    apint_set_allocator(counting_alloc, counting_realloc, counting_free);
+    fprintf(stderr, "kernels: %s, threads: %u, cycles: %s\n", apint_kernels(), apint_get_threads(), cycles_source);
+    if (json) {
+        printf("{\"kernels\":\"%s\",\"threads\":%u,\"cycles\":\"%s\",\"results\":[\n",
+               apint_kernels(), apint_get_threads(), cycles_source);
+    } else {
+        printf("op,bits,limbs,ns_per_op,limbs_per_ns,allocs_per_op,cycles_per_op\n");
+    }
+    int first = 1;
+    for (size_t bits = 64; bits <= max_bits; bits *= 2) {
+        uint32_t n = (uint32_t)(bits / 64);
+        sweep_a = random_apint(n);
+        sweep_b = random_apint(n);
+        sweep_b->data[0] |= 1; // odd, or powmod would time the division fallback instead of Montgomery
+        sweep_a_copy = apint_add(sweep_a, sweep_dst = apint_create_from_u64(0UL));
+        sweep_wide = random_apint(2 * n);
+        sweep_hex = apint_format_as_hex(sweep_a);
+        sweep_dec = bits <= (1UL << 22) && sweep_selected(ops, "create_from_dec") ? apint_format_as_dec(sweep_a) : NULL;
+        sweep_ctx = bits <= 4096 ? apint_mont_create(sweep_b) : NULL;
+        for (size_t i = 0; i < sizeof(sweep_ops) / sizeof(sweep_ops[0]); i++) {
+            if (bits > sweep_ops[i].max_bits || !sweep_selected(ops, sweep_ops[i].name)) {
+                continue;
+            }
+            if (progress) {
+                fprintf(stderr, "  %-16s %9zu bits\r", sweep_ops[i].name, bits);
+            }
+            SweepResult r = time_sweep(sweep_ops[i].fn);
+            if (json) {
+                printf("%s{\"op\":\"%s\",\"bits\":%zu,\"limbs\":%u,\"ns_per_op\":%.2f,\"limbs_per_ns\":%.4f,\"allocs_per_op\":%.2f,",
+                       first ? "" : ",\n", sweep_ops[i].name, bits, n, r.ns, n / r.ns, r.allocs);
+                if (strcmp(cycles_source, "none") != 0) {
+                    printf("\"cycles_per_op\":%.1f}", r.cycles);
+                } else {
+                    printf("\"cycles_per_op\":null}");
+                }
+            } else {
+                printf("%s,%zu,%u,%.2f,%.4f,%.2f,", sweep_ops[i].name, bits, n, r.ns, n / r.ns, r.allocs);
+                if (strcmp(cycles_source, "none") != 0) {
+                    printf("%.1f", r.cycles);
+                }
+                printf("\n");
+            }
+            first = 0;
+            fflush(stdout);
+        }
+        if (sweep_ctx != NULL) {
+            apint_mont_destroy(sweep_ctx);
+        }
+        if (sweep_dec != NULL) {
+            apint_free_str(sweep_dec);
+        }
+        apint_free_str(sweep_hex);
+        apint_destroy(sweep_wide);
+        apint_destroy(sweep_dst);
+        apint_destroy(sweep_a_copy);
+        apint_destroy(sweep_b);
+        apint_destroy(sweep_a);
+    }
+    if (json) {
+        printf("\n]}\n");
+    }
+    if (progress) {
+        fprintf(stderr, "%40s\r", "");
+    }
+    apint_set_allocator(NULL, NULL, NULL);
+    return 0;
+}
+
+// one measurement read back from a sweep's CSV or JSON output
+typedef struct {
+    char op[64];
+    size_t bits;
+    double ns;
+} SweepRow;
+
+static SweepRow *read_sweep(const char *path, size_t *count) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    SweepRow *rows = NULL;
+    size_t n = 0, cap = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        SweepRow row;
+        if (sscanf(line, "{\"op\":\"%63[^\"]\",\"bits\":%zu,\"limbs\":%*u,\"ns_per_op\":%lf", row.op, &row.bits, &row.ns) != 3
+            && sscanf(line, "%63[^,],%zu,%*u,%lf", row.op, &row.bits, &row.ns) != 3) {
+            continue; // header and framing lines
+        }
+        if (n == cap) {
+            cap = cap ? 2 * cap : 64;
+            rows = realloc(rows, cap * sizeof(*rows));
+        }
+        rows[n++] = row;
+    }
+    fclose(f);
+    *count = n;
+    return rows;
+}
+
+static int compare(int argc, char **argv) {
+    double threshold = 10;
+    if (argc >= 2 && strcmp(argv[0], "--threshold") == 0) {
+        threshold = strtod(argv[1], NULL);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 2) {
+        fprintf(stderr, "compare: expected two sweep files\n");
+        return 1;
+    }
+    size_t old_n, new_n;
+    SweepRow *old_rows = read_sweep(argv[0], &old_n);
+    SweepRow *new_rows = read_sweep(argv[1], &new_n);
+    if (old_rows == NULL || new_rows == NULL) {
+        free(old_rows);
+        free(new_rows);
+        return 1;
+    }
+    int regressions = 0;
+    printf("%-16s %10s %14s %14s %8s\n", "op", "bits", "old ns/op", "new ns/op", "change");
+    for (size_t i = 0; i < new_n; i++) {
+        for (size_t j = 0; j < old_n; j++) {
+            if (strcmp(new_rows[i].op, old_rows[j].op) != 0 || new_rows[i].bits != old_rows[j].bits) {
+                continue;
+            }
+            double change = (new_rows[i].ns / old_rows[j].ns - 1) * 100;
+            int regressed = change > threshold;
+            regressions += regressed;
+            printf("%-16s %10zu %14.1f %14.1f %+7.1f%%%s\n", new_rows[i].op, new_rows[i].bits,
+                   old_rows[j].ns, new_rows[i].ns, change, regressed ? "  REGRESSION" : "");
+            break;
+        }
+    }
+    printf("%d regression%s over %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+    free(old_rows);
+    free(new_rows);
+    return regressions ? 2 : 0;
+}
+
+// the square root of a, in the shape time_op expects
+static ApInt *sqrt_op(const ApInt *a, const ApInt *b) {
+    (void)b;
+    return apint_sqrt(a);
+}
+
+static int scaling(int argc, char **argv) {
+    double max_ratio = 6;
+    if (argc >= 2 && strcmp(argv[0], "--max-ratio") == 0) {
+        max_ratio = strtod(argv[1], NULL);
+    }
+    int over = 0;
+    printf("%8s %14s %14s %8s %14s %9s\n", "limbs", "mul ns", "div ns", "div/mul", "sqrt ns", "sqrt/mul");
+    for (uint32_t n = 1024; n <= 65536; n *= 2) {
+        ApInt *a = random_apint(2 * n);
+        ApInt *b = random_apint(n);
+        ApInt *c = random_apint(n);
+        double mul = time_op(apint_mul, b, c);
+        double div = time_op(apint_div, a, b);
+        double root = time_op(sqrt_op, a, NULL);
+        int slow = div > max_ratio * mul || root > max_ratio * mul;
+        over += slow;
+        printf("%8u %14.0f %14.0f %8.2f %14.0f %9.2f%s\n", n, mul, div, div / mul, root, root / mul,
+               slow ? "  TOO SLOW" : "");
+        apint_destroy(a);
+        apint_destroy(b);
+        apint_destroy(c);
+    }
+    return over ? 2 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "tune") == 0) {
+        return tune();
+    }
+    if (argc > 1 && strcmp(argv[1], "small") == 0) {
+        return small();
+    }
+    if (argc > 1 && strcmp(argv[1], "sweep") == 0) {
+        return sweep(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "compare") == 0) {
+        return compare(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "scaling") == 0) {
+        return scaling(argc - 2, argv + 2);
+    }
+    fprintf(stderr, "Usage: %s tune|small|sweep|compare|scaling\n", argv[0]);
+    return 1;
+}
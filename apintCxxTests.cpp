@@ -0,0 +1,320 @@
+/*
+ * Unit tests for the C++ interface (apint.hpp)
+ */
+
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include "apint.hpp"
+#include "tctest.h"
+
+typedef struct {
+    cmath::ApInt *a, *b, *c; // a few hundred bits, both signs
+} TestObjs;
+
+TestObjs *setup(void);
+void cleanup(TestObjs *objs);
+
+void testCxxLifetime(TestObjs *objs);
+void testCxxArithmetic(TestObjs *objs);
+void testCxxFused(TestObjs *objs);
+void testCxxAliasing(TestObjs *objs);
+void testCxxErrors(TestObjs *objs);
+void testCxxFixed(TestObjs *objs);
+
+// heap calls through the allocator hooks
+static long heap_allocs;
+
+static void *counting_alloc(size_t size) {
+    heap_allocs++;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *ptr, size_t old_size, size_t new_size) {
+    (void)old_size;
+    heap_allocs++;
+    return realloc(ptr, new_size);
+}
+
+static void counting_free(void *ptr, size_t size) {
+    (void)size;
+    free(ptr);
+}
+
+// the same value computed with the C API, for comparison
+static bool same(const cmath::ApInt &x, ::ApInt *expected) {
+    bool eq = apint_compare(x.get(), expected) == 0;
+    apint_destroy(expected);
+    return eq;
+}
+
+// bit for bit: len, flags and limbs, not just the value
+static bool identical(const cmath::ApInt &x, ::ApInt *expected) {
+    const ::ApInt *p = x.get();
+    bool eq = p->len == expected->len && p->flags == expected->flags;
+    for (uint32_t i = 0; eq && i < p->len; i++) {
+        eq = p->data[i] == expected->data[i];
+    }
+    apint_destroy(expected);
+    return eq;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        tctest_testname_to_execute = argv[1];
+    }
+
+    TEST_INIT();
+
+    TEST(testCxxLifetime);
+    TEST(testCxxArithmetic);
+    TEST(testCxxFused);
+    TEST(testCxxAliasing);
+    TEST(testCxxErrors);
+    TEST(testCxxFixed);
+
+    TEST_FINI();
+}
+
+TestObjs *setup(void) {
+    TestObjs *objs = new TestObjs;
+    objs->a = new cmath::ApInt(cmath::ApInt::from_hex("1f2e3d4c5b6a79880123456789abcdeffedcba98765432100f1e2d3c4b5a6978"));
+    objs->b = new cmath::ApInt(cmath::ApInt::from_hex("-ffffffffffffffffffffffffffffffff0000000000000001"));
+    objs->c = new cmath::ApInt(cmath::ApInt::from_dec("98765432109876543210987654321"));
+    return objs;
+}
+
+void cleanup(TestObjs *objs) {
+    delete objs->a;
+    delete objs->b;
+    delete objs->c;
+    delete objs;
+}
+
+void testCxxLifetime(TestObjs *objs) {
+    cmath::ApInt x = *objs->a; // copy
+    ASSERT(x == *objs->a && x.get() != objs->a->get());
+    ::ApInt *p = x.get();
+    cmath::ApInt y = std::move(x); // move takes the value, not a copy
+    ASSERT(y.get() == p);
+    x = *objs->b; // a moved-from value can be assigned again
+    ASSERT(x == *objs->b);
+    y = std::move(x);
+    ASSERT(y == *objs->b);
+
+    cmath::ApInt small = -5, big = 0xffffffffffffffffUL;
+    ASSERT(small.is_negative() && small.dec() == "-5");
+    ASSERT(big.hex() == "ffffffffffffffff");
+    ASSERT(cmath::ApInt().is_zero());
+
+    ::ApInt *raw = apint_create_from_u64(7UL);
+    cmath::ApInt adopted = cmath::ApInt::adopt(raw);
+    ASSERT(adopted.get() == raw && adopted == 7);
+    ::ApInt *released = adopted.release();
+    ASSERT(released == raw);
+    apint_destroy(released);
+}
+
+void testCxxArithmetic(TestObjs *objs) {
+    const cmath::ApInt &a = *objs->a, &b = *objs->b, &c = *objs->c;
+    ASSERT(same(a + b, apint_add(a.get(), b.get())));
+    ASSERT(same(a - b, apint_sub(a.get(), b.get())));
+    ASSERT(same(a * b, apint_mul(a.get(), b.get())));
+    ASSERT(same(a / c, apint_div(a.get(), c.get())));
+    ASSERT(same(a % c, apint_mod(a.get(), c.get())));
+    ASSERT(same(-b, apint_negate(b.get())));
+    ASSERT(same(a << 100, apint_lshift_bits(a.get(), 100)));
+    ASSERT(same(b >> 3, apint_rshift_bits(b.get(), 3)));
+
+    // compound expressions, against the same steps done by hand
+    ::ApInt *t = apint_add(a.get(), b.get());
+    apint_sub_into(t, t, c.get());
+    ASSERT(same(a + b - c, t));
+    t = apint_mul(b.get(), c.get());
+    apint_sub_into(t, a.get(), t);
+    apint_negate_into(t, t);
+    ASSERT(same(-(a - b * c), t));
+    t = apint_add(a.get(), b.get());
+    ::ApInt *u = apint_sub(c.get(), b.get());
+    apint_mul_into(t, t, u);
+    apint_destroy(u);
+    ASSERT(same((a + b) * (c - b), t));
+
+    cmath::ApInt x = a;
+    x *= b;
+    x -= c;
+    x /= c;
+    ASSERT(x == (a * b - c) / c);
+    x %= c;
+    ASSERT(x == ((a * b - c) / c) % c);
+    x <<= 64;
+    x >>= 64;
+    ASSERT(x == ((a * b - c) / c) % c);
+    ASSERT(a > b && b < c && a != c && a >= a && b <= b);
+
+    // integral operands, on either side
+    cmath::ApInt one(1), two(2), minus3(-3);
+    ASSERT(same(a + 1, apint_add(a.get(), one.get())));
+    t = apint_mul(b.get(), two.get());
+    apint_sub_into(t, t, one.get());
+    ASSERT(same(2 * b - 1, t));
+    ASSERT(a * -3 == a * minus3 && -3 * a == minus3 * a);
+    ASSERT(a / 2u == a / two && a % 2u == a % two && 1 - a == one - a);
+    x = a;
+    x += 1;
+    x *= 2;
+    x -= 2;
+    x /= -3;
+    x %= 7;
+    ASSERT(x == ((a + one) * two - two) / minus3 % cmath::ApInt(7));
+}
+
+void testCxxFused(TestObjs *objs) {
+    const cmath::ApInt &a = *objs->a, &b = *objs->b, &c = *objs->c;
+    cmath::ApInt r = a * a, x = a * a; // room for everything below
+    x = a;
+    ApIntAllocFunc old_alloc;
+    ApIntReallocFunc old_realloc;
+    ApIntFreeFunc old_free;
+    apint_get_allocator(&old_alloc, &old_realloc, &old_free);
+    apint_set_allocator(counting_alloc, counting_realloc, counting_free);
+    heap_allocs = 0;
+    r = a + b - c + a - b; // straight into r, no temporaries
+    long sum_allocs = heap_allocs;
+    x += b * c;            // through apint_addmul_into: only its scratch product
+    long addmul_allocs = heap_allocs - sum_allocs;
+    apint_set_allocator(old_alloc, old_realloc, old_free);
+    ASSERT(sum_allocs == 0);
+    ASSERT(addmul_allocs == 1);
+    ASSERT(r == cmath::ApInt(a + a - c));
+    ::ApInt *t = apint_mul(b.get(), c.get());
+    apint_add_into(t, t, a.get());
+    ASSERT(same(x, t));
+    x -= b * c;
+    ASSERT(x == a);
+}
+
+void testCxxAliasing(TestObjs *objs) {
+    const cmath::ApInt &a = *objs->a, &b = *objs->b;
+    cmath::ApInt x = a;
+    x = b - x; // x is read after the destination is first written
+    ASSERT(x == cmath::ApInt(b - a));
+    x = a;
+    x = x + x * x;
+    ASSERT(x == cmath::ApInt(a + a * a));
+    x = a;
+    x += x * b;
+    ASSERT(x == cmath::ApInt(a + a * b));
+    x = a;
+    x -= x;
+    ASSERT(x.is_zero());
+    x = a;
+    x = -(b - x);
+    ASSERT(x == cmath::ApInt(a - b));
+    x = a;
+    x = x * x;
+    ASSERT(x == cmath::ApInt(a * a));
+}
+
+void testCxxErrors(TestObjs *objs) {
+    bool thrown = false;
+    try {
+        cmath::ApInt::from_hex("12g4");
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+    thrown = false;
+    try {
+        cmath::ApInt q = *objs->a / cmath::ApInt(0);
+        (void)q;
+    } catch (const std::domain_error &) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+    thrown = false;
+    try {
+        cmath::ApInt::from_dec("");
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+    thrown = false;
+    try {
+        cmath::ApInt x(1);
+        x <<= 64 * (size_t)UINT32_MAX;
+    } catch (const std::length_error &) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+}
+
+void testCxxFixed(TestObjs *objs) {
+    typedef cmath::FixedApInt<256> F256;
+
+    // usable at compile time
+    constexpr F256 p = F256::from_hex("ffffffff00000001000000000000000000000000ffffffffffffffffffffffff");
+    constexpr F256 one = 1;
+    static_assert(p - one + one == p, "constexpr add and sub");
+    static_assert(((p >> 100) << 100) < p && (p >> 255) == one, "constexpr shifts");
+    static_assert(F256(-5) >> 1 == F256(-3) && F256(-1) >> 70 == F256(-1), "floor shifts");
+    static_assert(F256(-2) < F256(1) && F256(3) - F256(5) == F256(-2), "signs");
+
+    // round trips, -0 included
+    F256 a(*objs->a), b(*objs->b);
+    ASSERT(a.to_apint() == *objs->a && b.to_apint() == *objs->b);
+    ::ApInt *negzero = apint_create_from_u64(0UL);
+    negzero->flags = 1;
+    cmath::ApInt nz = cmath::ApInt::adopt(negzero);
+    F256 fz(nz);
+    ASSERT(fz.negative && fz.is_zero());
+    ASSERT(fz.to_apint().get()->flags == 1 && fz.to_apint().get()->len == 1);
+    ASSERT(fz < F256(0) && fz > F256(-1));
+
+    // against the C functions on random values of every length and sign
+    uint64_t seed = 0x9e3779b97f4a7c15UL;
+    for (int iter = 0; iter < 2000; iter++) {
+        F256 x, y;
+        for (F256 *v : { &x, &y }) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            size_t n = seed % 5;
+            for (size_t i = 0; i < n; i++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                v->limbs[i] = seed % 7 == 0 ? ~0UL : seed;
+            }
+            v->negative = (seed >> 32) & 1;
+        }
+        cmath::ApInt cx = x.to_apint(), cy = y.to_apint();
+        F256 r;
+        if (!add_overflow(x, y, r)) {
+            ASSERT(identical(r.to_apint(), apint_add(cx.get(), cy.get())));
+        }
+        if (!sub_overflow(x, y, r)) {
+            ASSERT(identical(r.to_apint(), apint_sub(cx.get(), cy.get())));
+        }
+        int c = apint_compare(cx.get(), cy.get());
+        ASSERT(x.compare(y) == (c > 0) - (c < 0));
+        size_t bits = seed % 300;
+        ASSERT(identical((x >> bits).to_apint(), apint_rshift_bits(cx.get(), bits)));
+        cmath::ApInt shifted = cx << bits;
+        if (apint_highest_bit_set(shifted.get()) < 256) {
+            ASSERT(identical((x << bits).to_apint(), apint_lshift_bits(cx.get(), bits)));
+        }
+    }
+
+    // wrapping is reported, and too wide a value does not convert
+    F256 max = F256::from_hex("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"), r;
+    ASSERT(add_overflow(max, one, r) && r.is_zero());
+    ASSERT(!sub_overflow(max, one, r) && r < max);
+    bool thrown = false;
+    try {
+        cmath::FixedApInt<128> small(*objs->a);
+    } catch (const std::out_of_range &) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+}
@@ -0,0 +1,107 @@
+/*
+ * Builds and reads ApInt stores (see apint_store_open in apint.h)
+ *
+ * Usage:
+ *   apintStore build OUT [IN]   write the hex values in IN (one per line,
+ *                               stdin if omitted, blank lines skipped) to
+ *                               the store OUT; on any error OUT is removed
+ *   apintStore get FILE I...    print values I... of FILE in hex
+ *   apintStore count FILE       print the number of values in FILE
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apint.h"
+
+static int build(const char *out, const char *in) {
+    FILE *f = in != NULL ? fopen(in, "r") : stdin;
+    if (f == NULL) {
+        perror(in);
+        return 1;
+    }
+    ApIntStoreWriter *w = apint_store_writer_open(out);
+    if (w == NULL) {
+        perror(out);
+        if (f != stdin) {
+            fclose(f);
+        }
+        return 1;
+    }
+    ApInt *val = apint_create_from_u64(0UL);
+    char *line = NULL;
+    size_t line_cap = 0, lineno = 0;
+    ssize_t len;
+    int rc = 0;
+    while (rc == 0 && (len = getline(&line, &line_cap, f)) >= 0) {
+        lineno++;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+        if (apint_set_hex(val, line) != APINT_OK) {
+            fprintf(stderr, "%s:%zu: not a hex value\n", in != NULL ? in : "stdin", lineno);
+            rc = 1;
+        } else if (apint_store_writer_add(w, val) != APINT_OK) {
+            rc = 1;
+        }
+    }
+    if (apint_store_writer_close(w) != APINT_OK) {
+        perror(out);
+        rc = 1;
+    }
+    if (rc != 0) { // a store cut short would still read as a valid one
+        remove(out);
+    }
+    free(line);
+    apint_destroy(val);
+    if (f != stdin) {
+        fclose(f);
+    }
+    return rc;
+}
+
+static int get(const char *path, int argc, char **argv) {
+    ApIntStore *store = apint_store_open(path);
+    if (store == NULL) {
+        fprintf(stderr, "%s: not a readable store\n", path);
+        return 1;
+    }
+    int rc = 0;
+    for (int i = 0; i < argc; i++) {
+        ApIntView view;
+        if (apint_store_get(store, strtoul(argv[i], NULL, 0), &view) != APINT_OK) {
+            fprintf(stderr, "%s: no value %s\n", path, argv[i]);
+            rc = 1;
+            continue;
+        }
+        char *hex = apint_format_as_hex(&view.value);
+        printf("%s\n", hex);
+        apint_free_str(hex);
+    }
+    apint_store_close(store);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "build") == 0) {
+        return build(argv[2], argc == 4 ? argv[3] : NULL);
+    }
+    if (argc >= 4 && strcmp(argv[1], "get") == 0) {
+        return get(argv[2], argc - 3, argv + 3);
+    }
+    if (argc == 3 && strcmp(argv[1], "count") == 0) {
+        ApIntStore *store = apint_store_open(argv[2]);
+        if (store == NULL) {
+            fprintf(stderr, "%s: not a readable store\n", argv[2]);
+            return 1;
+        }
+        printf("%zu\n", apint_store_count(store));
+        apint_store_close(store);
+        return 0;
+    }
+    fprintf(stderr, "Usage: %s build OUT [IN] | get FILE I... | count FILE\n", argv[0]);
+    return 1;
+}
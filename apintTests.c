@@ -14,6 +14,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "apint.h"
 #include "tctest.h"
 
@@ -47,6 +49,32 @@ void testSub(TestObjs *objs);
 void testNegate(TestObjs *objs);
 void testShift(TestObjs *objs);
 void testCreateFromHex(TestObjs *objs);
+void testMul(TestObjs *objs);
+void testMulRandom(TestObjs *objs);
+void testMulLarge(TestObjs *objs);
+void testDivmod(TestObjs *objs);
+void testDivRandom(TestObjs *objs);
+void testIntoAliasing(TestObjs *objs);
+void testIntoReuse(TestObjs *objs);
+void testAllocatorHooks(TestObjs *objs);
+void testArena(TestObjs *objs);
+void testInlineStorage(TestObjs *objs);
+void testKernelDispatch(TestObjs *objs);
+void testHexConversion(TestObjs *objs);
+void testDecConversion(TestObjs *objs);
+void testShiftBits(TestObjs *objs);
+void testBitwise(TestObjs *objs);
+void testPowmod(TestObjs *objs);
+void testBatch(TestObjs *objs);
+void testThreads(TestObjs *objs);
+void testThreadStress(TestObjs *objs);
+void testStats(TestObjs *objs);
+void testSerialize(TestObjs *objs);
+void testStore(TestObjs *objs);
+void testAddmul(TestObjs *objs);
+void testGcd(TestObjs *objs);
+void testSqr(TestObjs *objs);
+void testRoots(TestObjs *objs);
 
 
 int main(int argc, char **argv) {
@@ -70,6 +98,32 @@ int main(int argc, char **argv) {
 	TEST(testNegate);
     TEST(testShift);
     TEST(testCreateFromHex);
+    TEST(testMul);
+    TEST(testMulRandom);
+    TEST(testMulLarge);
+    TEST(testDivmod);
+    TEST(testDivRandom);
+    TEST(testIntoAliasing);
+    TEST(testIntoReuse);
+    TEST(testAllocatorHooks);
+    TEST(testArena);
+    TEST(testInlineStorage);
+    TEST(testKernelDispatch);
+    TEST(testHexConversion);
+    TEST(testDecConversion);
+    TEST(testShiftBits);
+    TEST(testBitwise);
+    TEST(testPowmod);
+    TEST(testBatch);
+    TEST(testThreads);
+    TEST(testThreadStress);
+    TEST(testStats);
+    TEST(testSerialize);
+    TEST(testStore);
+    TEST(testAddmul);
+    TEST(testGcd);
+    TEST(testSqr);
+    TEST(testRoots);
 
 	TEST_FINI();
 }
@@ -420,3 +474,1773 @@ void testCreateFromHex(TestObjs *objs){
     
     ASSERT(apint_get_bits(objs->twoblocks, 1) == apint_get_bits(objs->twoblocks, 0));
 }
+
+void testMul(TestObjs *objs){
+    ApInt *a, *b, *prod;
+    char *s;
+
+    prod = apint_mul(objs->ap0, objs->max1);
+    ASSERT(apint_is_zero(prod));
+    ASSERT(prod->flags == 0);
+    apint_destroy(prod);
+
+    prod = apint_mul(objs->minus1, objs->ap0);
+    ASSERT(apint_is_zero(prod));
+    ASSERT(prod->flags == 0);
+    apint_destroy(prod);
+
+    // ffffffffffffffff^2 = fffffffffffffffe0000000000000001
+    prod = apint_mul(objs->max1, objs->max1);
+    ASSERT(0 == strcmp("fffffffffffffffe0000000000000001", (s = apint_format_as_hex(prod))));
+    apint_destroy(prod);
+    apint_free_str(s);
+
+    prod = apint_mul(objs->minus1, objs->max1);
+    ASSERT(0 == strcmp("-ffffffffffffffff", (s = apint_format_as_hex(prod))));
+    apint_destroy(prod);
+    apint_free_str(s);
+
+    prod = apint_mul(objs->minus1, objs->minus1);
+    ASSERT(0 == strcmp("1", (s = apint_format_as_hex(prod))));
+    apint_destroy(prod);
+    apint_free_str(s);
+
+    a = apint_create_from_hex("-7e35207519b6b06429378631ca460905c19537644f31dc50114e9dc90bb4e4ebc43cfebe6b86d");
+    b = apint_create_from_hex("9fa0fb165441ade7cb8b17c3ab3653465e09e8078e09631ec8f6fe3a5b301dc");
+    prod = apint_mul(a, b);
+    ASSERT(0 == strcmp("-4eb25c261d15f3e2a03c34accedd25db91db9dc600525b28577375acafbce0dcdcad0eb019320afc1d"
+        "6e4eb1872587187eada8b21517b768d4dd5d2a965c8beb8972d635eaac",
+        (s = apint_format_as_hex(prod))));
+    apint_destroy(prod);
+    apint_destroy(b);
+    apint_destroy(a);
+    apint_free_str(s);
+}
+
+// deterministic generator so failures can be reproduced
+static uint64_t test_rand_state = 0x9E3779B97F4A7C15UL;
+
+static uint64_t test_rand(void) {
+    uint64_t x = test_rand_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    test_rand_state = x;
+    return x;
+}
+
+// random value of exactly len limbs; sparse or all-ones limbs now and then to hit carries
+static ApInt *random_apint(uint32_t len) {
+    ApInt *ap = apint_create_from_u64(0UL);
+    apint_reserve(ap, len);
+    ap->len = len;
+    uint64_t style = test_rand() % 4;
+    for (uint32_t i = 0; i < len; i++) {
+        uint64_t r = test_rand();
+        ap->data[i] = style == 0 ? ~(r & 1) : style == 1 ? (r & 3) : r;
+    }
+    if (ap->data[len - 1] == 0) {
+        ap->data[len - 1] = 1;
+    }
+    ap->flags = test_rand() & 1;
+    return ap;
+}
+
+__extension__ typedef unsigned __int128 test_u128;
+
+// straightforward O(n^2) reference product, compared limb by limb
+static int mul_matches_reference(const ApInt *a, const ApInt *b, const ApInt *prod) {
+    uint32_t n = a->len + b->len;
+    uint64_t *ref = calloc(n, sizeof(uint64_t));
+    for (uint32_t i = 0; i < a->len; i++) {
+        uint64_t carry = 0;
+        for (uint32_t j = 0; j < b->len; j++) {
+            test_u128 t = (test_u128)a->data[i] * b->data[j] + ref[i + j] + carry;
+            ref[i + j] = (uint64_t)t;
+            carry = (uint64_t)(t >> 64);
+        }
+        ref[i + b->len] = carry;
+    }
+    while (n > 1 && ref[n - 1] == 0) {
+        n--;
+    }
+    int ok = prod->len == n && memcmp(ref, prod->data, n * sizeof(uint64_t)) == 0
+        && prod->flags == (a->flags ^ b->flags);
+    free(ref);
+    return ok;
+}
+
+void testMulRandom(TestObjs *objs){
+    (void)objs;
+    size_t kara = apint_tune_get(APINT_TUNE_MUL_KARATSUBA);
+    size_t toom = apint_tune_get(APINT_TUNE_MUL_TOOM3);
+    size_t ntt = apint_tune_get(APINT_TUNE_MUL_NTT);
+    // low thresholds push small operands through every algorithm, then the defaults
+    size_t thresholds[][3] = { {4, 16, SIZE_MAX}, {8, 24, 40}, {kara, toom, ntt} };
+
+    for (int t = 0; t < 3; t++) {
+        apint_tune_set(APINT_TUNE_MUL_KARATSUBA, thresholds[t][0]);
+        apint_tune_set(APINT_TUNE_MUL_TOOM3, thresholds[t][1]);
+        apint_tune_set(APINT_TUNE_MUL_NTT, thresholds[t][2]);
+        for (int iter = 0; iter < 200; iter++) {
+            uint32_t limit = t < 2 ? 80 : 2 * toom + 40;
+            uint32_t alen = 1 + test_rand() % limit;
+            uint32_t blen = iter % 3 == 0 ? alen : 1 + test_rand() % limit;
+            if (t == 1 && iter % 4 == 1) { // just past a power of two: the half-length transform
+                alen = 32 + test_rand() % 3;
+                blen = 33 + test_rand() % 2;
+            }
+            ApInt *a = random_apint(alen);
+            ApInt *b = random_apint(blen);
+            ApInt *prod = apint_mul(a, b);
+            int ok = mul_matches_reference(a, b, prod);
+            apint_destroy(prod);
+            apint_destroy(a);
+            apint_destroy(b);
+            if (!ok) {
+                apint_tune_set(APINT_TUNE_MUL_KARATSUBA, kara);
+                apint_tune_set(APINT_TUNE_MUL_TOOM3, toom);
+                apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+            }
+            ASSERT(ok);
+        }
+    }
+    apint_tune_set(APINT_TUNE_MUL_KARATSUBA, kara);
+    apint_tune_set(APINT_TUNE_MUL_TOOM3, toom);
+    apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+}
+
+void testMulLarge(TestObjs *objs){
+    (void)objs;
+    size_t ntt = apint_tune_get(APINT_TUNE_MUL_NTT);
+    // all-ones operands give the largest possible convolution coefficients
+    uint32_t sizes[][2] = { {20000, 20000}, {20000, 7001}, {3 * (uint32_t)ntt, 2 * (uint32_t)ntt + 5} };
+
+    for (int t = 0; t < 3; t++) {
+        ApInt *a = random_apint(sizes[t][0]);
+        ApInt *b = random_apint(sizes[t][1]);
+        if (t == 0) {
+            memset(a->data, 0xff, a->len * sizeof(uint64_t));
+            memset(b->data, 0xff, b->len * sizeof(uint64_t));
+        }
+        ApInt *fast = apint_mul(a, b);
+        apint_tune_set(APINT_TUNE_MUL_NTT, SIZE_MAX);
+        ApInt *toom = apint_mul(a, b);
+        apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+        int ok = fast->len == toom->len && fast->flags == toom->flags
+            && memcmp(fast->data, toom->data, fast->len * sizeof(uint64_t)) == 0;
+        apint_destroy(fast);
+        apint_destroy(toom);
+        apint_destroy(a);
+        apint_destroy(b);
+        ASSERT(ok);
+    }
+}
+
+void testDivmod(TestObjs *objs){
+    ApInt *a, *b, *q, *r;
+    char *s;
+
+    ASSERT(APINT_ERR_DIVZERO == apint_divmod(objs->ap1, objs->ap0, &q, &r));
+    ASSERT(NULL == apint_div(objs->max1, objs->ap0));
+    ASSERT(NULL == apint_mod(objs->max1, objs->ap0));
+
+    // 7 / 2 = 3 r 1, -7 / 2 = -3 r -1, 7 / -2 = -3 r 1, -7 / -2 = 3 r -1
+    const char *cases[][4] = {
+        { "7", "2", "3", "1" },
+        { "-7", "2", "-3", "-1" },
+        { "7", "-2", "-3", "1" },
+        { "-7", "-2", "3", "-1" },
+        { "-6", "3", "-2", "0" },
+        { "1", "-ffffffffffffffff", "0", "1" },
+        { "fffffffffffffffe0000000000000001", "ffffffffffffffff", "ffffffffffffffff", "0" },
+        { "7e35207519b6b06429378631ca460905c19537644f31dc50114e9dc90bb4e4ebc43cfebe6b86d",
+          "9fa0fb165441ade7cb8b17c3ab3653465e09e8078e09631ec8f6fe3a5b301dc",
+          "ca66cd95fe4ddb", "6df1a739bc98c8e9239efb53aae4d4739455efcf3f8fb70cd62565d6fecf539" },
+    };
+    for (int i = 0; i < 8; i++) {
+        a = apint_create_from_hex(cases[i][0]);
+        b = apint_create_from_hex(cases[i][1]);
+        ASSERT(APINT_OK == apint_divmod(a, b, &q, &r));
+        ASSERT(0 == strcmp(cases[i][2], (s = apint_format_as_hex(q))));
+        apint_free_str(s);
+        ASSERT(0 == strcmp(cases[i][3], (s = apint_format_as_hex(r))));
+        apint_free_str(s);
+        apint_destroy(q);
+        apint_destroy(r);
+
+        q = apint_div(a, b);
+        ASSERT(0 == strcmp(cases[i][2], (s = apint_format_as_hex(q))));
+        apint_free_str(s);
+        apint_destroy(q);
+        r = apint_mod(a, b);
+        ASSERT(0 == strcmp(cases[i][3], (s = apint_format_as_hex(r))));
+        apint_free_str(s);
+        apint_destroy(r);
+        apint_destroy(a);
+        apint_destroy(b);
+    }
+}
+
+// |a| < |b| on normalized values
+static int less_in_magnitude(const ApInt *a, const ApInt *b) {
+    if (a->len != b->len) {
+        return a->len < b->len;
+    }
+    for (uint32_t i = a->len; i-- > 0;) {
+        if (a->data[i] != b->data[i]) {
+            return a->data[i] < b->data[i];
+        }
+    }
+    return 0;
+}
+
+// checks a = q * b + r with |r| < |b| and the truncating sign rules
+static int divmod_is_consistent(const ApInt *a, const ApInt *b) {
+    ApInt *q, *r;
+    if (apint_divmod(a, b, &q, &r) != APINT_OK) {
+        return 0;
+    }
+    ApInt *qb = apint_mul(q, b);
+    ApInt *back = apint_add(qb, r); // q * b and r never have opposite signs here
+    int ok = apint_compare(back, a) == 0 && less_in_magnitude(r, b)
+        && (apint_is_zero(r) || r->flags == a->flags)
+        && (apint_is_zero(q) || q->flags == (a->flags ^ b->flags));
+    apint_destroy(back);
+    apint_destroy(qb);
+    apint_destroy(q);
+    apint_destroy(r);
+    return ok;
+}
+
+void testDivRandom(TestObjs *objs){
+    (void)objs;
+    size_t newton = apint_tune_get(APINT_TUNE_DIV_NEWTON);
+    size_t ntt = apint_tune_get(APINT_TUNE_MUL_NTT);
+    // everything through the Newton path, the second time with its
+    // wraparound products on the NTT, then the default split
+    size_t thresholds[] = { 2, 5, newton };
+
+    for (int t = 0; t < 3; t++) {
+        apint_tune_set(APINT_TUNE_DIV_NEWTON, thresholds[t]);
+        apint_tune_set(APINT_TUNE_MUL_NTT, t == 1 ? 8 : ntt);
+        for (int iter = 0; iter < (t < 2 ? 300 : 20); iter++) {
+            uint32_t limit = t < 2 ? 60 : 2 * newton + 20;
+            uint32_t blen = 1 + test_rand() % limit;
+            uint32_t alen = blen + test_rand() % limit;
+            if (iter % 5 == 0 && alen > 3) {
+                alen -= 3; // sometimes a shorter dividend
+            }
+            ApInt *a = random_apint(alen);
+            ApInt *b = random_apint(blen);
+            if (iter % 7 == 0) { // divisors with a tiny top limb stress normalization
+                b->data[blen - 1] = 1;
+            }
+            int ok = divmod_is_consistent(a, b);
+            apint_destroy(a);
+            apint_destroy(b);
+            if (!ok) {
+                apint_tune_set(APINT_TUNE_DIV_NEWTON, newton);
+                apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+            }
+            ASSERT(ok);
+        }
+    }
+    apint_tune_set(APINT_TUNE_DIV_NEWTON, newton);
+    apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+}
+
+// dst == src comparison on value (len, sign and limbs)
+static int same_value(const ApInt *a, const ApInt *b) {
+    return a->len == b->len && a->flags == b->flags
+        && memcmp(a->data, b->data, a->len * sizeof(uint64_t)) == 0;
+}
+
+void testIntoAliasing(TestObjs *objs){
+    (void)objs;
+    for (int iter = 0; iter < 200; iter++) {
+        ApInt *a = random_apint(1 + test_rand() % 12);
+        ApInt *b = random_apint(1 + test_rand() % 12);
+        ApInt *sum = apint_add(a, b);
+        ApInt *diff = apint_sub(a, b);
+        ApInt *prod = apint_mul(a, b);
+        ApInt *dst = apint_create_from_u64(0UL);
+        int ok = 1;
+
+        // fresh destination
+        apint_add_into(dst, a, b);
+        ok &= same_value(dst, sum);
+        apint_sub_into(dst, a, b);
+        ok &= same_value(dst, diff);
+        apint_mul_into(dst, a, b);
+        ok &= same_value(dst, prod);
+
+        // destination is the first operand, then the second
+        apint_set(dst, a);
+        apint_add_into(dst, dst, b);
+        ok &= same_value(dst, sum);
+        apint_set(dst, b);
+        apint_sub_into(dst, a, dst);
+        ok &= same_value(dst, diff);
+        apint_set(dst, a);
+        apint_mul_into(dst, dst, b);
+        ok &= same_value(dst, prod);
+
+        // everything the same object: x - x = 0, x + x = 2x
+        apint_set(dst, a);
+        apint_sub_into(dst, dst, dst);
+        ok &= apint_is_zero(dst) && dst->flags == 0;
+        ApInt *twice = apint_add(a, a);
+        apint_set(dst, a);
+        apint_add_into(dst, dst, dst);
+        ok &= same_value(dst, twice);
+
+        ApInt *neg = apint_negate(a);
+        apint_negate_into(dst, a);
+        ok &= apint_compare(dst, neg) == 0;
+
+        apint_destroy(neg);
+        apint_destroy(twice);
+        apint_destroy(dst);
+        apint_destroy(prod);
+        apint_destroy(diff);
+        apint_destroy(sum);
+        apint_destroy(a);
+        apint_destroy(b);
+        ASSERT(ok);
+    }
+}
+
+void testIntoReuse(TestObjs *objs){
+    ApInt *acc = apint_create_from_u64(0UL);
+    ApInt *q = apint_create_from_u64(0UL);
+    ApInt *r = apint_create_from_u64(0UL);
+    char *s;
+
+    // once reserved, accumulating must not move the storage
+    apint_reserve(acc, 8);
+    ASSERT(acc->cap >= 8);
+    uint64_t *storage = acc->data;
+    for (int i = 0; i < 1000; i++) {
+        apint_add_into(acc, acc, objs->max1);
+    }
+    ASSERT(acc->data == storage);
+    ASSERT(0 == strcmp("3e7fffffffffffffc18", (s = apint_format_as_hex(acc))));
+    apint_free_str(s);
+    for (int i = 0; i < 1000; i++) {
+        apint_sub_into(acc, acc, objs->max1);
+    }
+    ASSERT(acc->data == storage);
+    ASSERT(apint_is_zero(acc));
+
+    // growth is amortized: repeated doubling reallocates only now and then
+    apint_set_u64(acc, 1UL);
+    int moves = 0;
+    for (int i = 0; i < 4096; i++) {
+        uint64_t *before = acc->data;
+        apint_add_into(acc, acc, acc);
+        moves += acc->data != before;
+    }
+    ASSERT(acc->len == 65);
+    ASSERT(moves < 12);
+
+    // divmod into the operands themselves
+    apint_set(q, objs->max2);
+    apint_set(r, objs->ap110660361);
+    ASSERT(APINT_OK == apint_divmod_into(q, r, q, r));
+    ASSERT(0 == strcmp("26cfe98414556e8b380a912e87", (s = apint_format_as_hex(q))));
+    apint_free_str(s);
+    ASSERT(0 == strcmp("27a103b", (s = apint_format_as_hex(r))));
+    apint_free_str(s);
+    ASSERT(APINT_ERR_DIVZERO == apint_divmod_into(q, r, q, objs->ap0));
+
+    apint_destroy(acc);
+    apint_destroy(q);
+    apint_destroy(r);
+}
+
+// allocator hooks that record each block's size in front of it and check it on release
+static size_t hook_live_bytes, hook_allocs, hook_size_mismatches;
+
+static void *counting_alloc(size_t size) {
+    size_t *p = malloc(size + 16);
+    p[0] = size;
+    hook_live_bytes += size;
+    hook_allocs++;
+    return (char*)p + 16;
+}
+
+static void *counting_realloc(void *ptr, size_t old_size, size_t new_size) {
+    size_t *p = (size_t*)((char*)ptr - 16);
+    hook_size_mismatches += p[0] != old_size;
+    p = realloc(p, new_size + 16);
+    p[0] = new_size;
+    hook_live_bytes += new_size - old_size;
+    hook_allocs++;
+    return (char*)p + 16;
+}
+
+static void counting_free(void *ptr, size_t size) {
+    size_t *p = (size_t*)((char*)ptr - 16);
+    hook_size_mismatches += p[0] != size;
+    hook_live_bytes -= size;
+    free(p);
+}
+
+void testAllocatorHooks(TestObjs *objs){
+    (void)objs;
+    hook_live_bytes = hook_allocs = hook_size_mismatches = 0;
+    apint_set_allocator(counting_alloc, counting_realloc, counting_free);
+
+    ApInt *a = apint_create_from_hex("-123456789abcdef0123456789abcdef0123456789abcdef");
+    ApInt *b = apint_create_from_u64(0xdeadbeefUL);
+    ApInt *sum = apint_add(a, b);
+    ApInt *prod = apint_mul(a, a);
+    ApInt *q = apint_div(prod, b);
+    ApInt *neg = apint_negate(q);
+    ApInt *shifted = apint_lshift_n(neg, 4);
+    ApInt *acc = apint_create_from_u64(1UL);
+    for (int i = 0; i < 200; i++) {
+        apint_mul_into(acc, acc, b); // grows through the realloc hook
+    }
+    apint_mul_into(acc, acc, acc); // Toom-3 and division scratch
+    apint_divmod_into(acc, NULL, acc, a);
+    char *s = apint_format_as_hex(sum);
+    ASSERT(0 == strcmp("-123456789abcdef0123456789abcdef01234566aafe0f00", s));
+    ASSERT(hook_allocs > 0);
+    apint_free_str(s);
+    apint_destroy(a);
+    apint_destroy(b);
+    apint_destroy(sum);
+    apint_destroy(prod);
+    apint_destroy(q);
+    apint_destroy(neg);
+    apint_destroy(shifted);
+    apint_destroy(acc);
+
+    apint_set_allocator(NULL, NULL, NULL);
+    ASSERT(hook_live_bytes == 0);
+    ASSERT(hook_size_mismatches == 0);
+}
+
+void testArena(TestObjs *objs){
+    hook_live_bytes = hook_allocs = hook_size_mismatches = 0;
+    apint_set_allocator(counting_alloc, counting_realloc, counting_free);
+
+    // small blocks so values outgrow them and take the oversize path
+    ApIntArena *arena = apint_arena_create(256);
+    size_t kept_bytes = 0;
+    for (int round = 0; round < 3; round++) {
+        ApInt *acc = apint_arena_create_from_u64(arena, 1UL);
+        ApInt *x = apint_arena_create_from_hex(arena, "-fedcba9876543210fedcba9876543210");
+        ApInt *r = apint_arena_create_from_u64(arena, 0UL);
+        ASSERT(acc->arena == arena);
+        for (int i = 0; i < 100; i++) {
+            apint_mul_into(acc, acc, x);
+        }
+        ASSERT(acc->flags == 0);
+        ASSERT(APINT_OK == apint_divmod_into(acc, r, acc, objs->max1));
+        apint_add_into(r, r, acc);
+        ApInt *check = apint_mul(acc, objs->max1); // a regular value
+        ASSERT(check->arena == NULL);
+        apint_sub_into(acc, check, r);
+        apint_destroy(check);
+        apint_destroy(x); // no-op
+        apint_arena_reset(arena);
+        if (round == 0) {
+            kept_bytes = hook_live_bytes;
+        }
+        ASSERT(hook_live_bytes == kept_bytes); // one block and the arena itself
+    }
+    apint_arena_destroy(arena);
+
+    apint_set_allocator(NULL, NULL, NULL);
+    ASSERT(hook_live_bytes == 0);
+    ASSERT(hook_size_mismatches == 0);
+}
+
+void testInlineStorage(TestObjs *objs){
+    hook_live_bytes = hook_allocs = hook_size_mismatches = 0;
+    apint_set_allocator(counting_alloc, counting_realloc, counting_free);
+    char *s;
+
+    ApInt *a = apint_create_from_hex("-fffffffffffffffffffffffffffffff"); // two limbs
+    ApInt *b = apint_create_from_u64(0xffffffffffffffffUL);
+    ApInt *dst = apint_create_from_u64(0UL);
+    ASSERT(a->data == a->small);
+    ASSERT(hook_allocs == 3); // just the structs
+
+    // small values never touch the heap
+    apint_add_into(dst, a, b);
+    apint_sub_into(dst, dst, b);
+    apint_negate_into(dst, dst);
+    apint_add_into(dst, dst, dst);
+    ASSERT(apint_compare(dst, objs->max1) > 0);
+    ASSERT(dst->data == dst->small);
+    ASSERT(hook_allocs == 3);
+    ASSERT(0 == strcmp("1ffffffffffffffffffffffffffffffe", (s = apint_format_as_hex(dst))));
+    apint_free_str(s);
+
+    // a carry out of two limbs spills, keeping the value
+    for (int i = 0; i < 4; i++) {
+        apint_add_into(dst, dst, dst);
+    }
+    ASSERT(dst->data != dst->small);
+    ASSERT(dst->len == 3);
+    ASSERT(0 == strcmp("1ffffffffffffffffffffffffffffffe0", (s = apint_format_as_hex(dst))));
+    apint_free_str(s);
+    apint_mul_into(dst, dst, dst); // aliasing swaps heap storage
+    apint_set_u64(dst, 5UL);
+
+    // the magnitude helpers reuse dst's storage as well
+    ASSERT(addition(a, b, dst) == dst);
+    ASSERT(0 == strcmp("1000000000000000fffffffffffffffe", (s = apint_format_as_hex(dst))));
+    apint_free_str(s);
+    subtraction(dst, b, dst);
+    ASSERT(0 == strcmp("fffffffffffffffffffffffffffffff", (s = apint_format_as_hex(dst))));
+    apint_free_str(s);
+    addition(dst, dst, dst); // both operands may be sum
+    addition(dst, dst, dst);
+    addition(dst, dst, dst);
+    addition(dst, dst, dst);
+    addition(dst, dst, dst); // carries into a third limb
+    ASSERT(3 == dst->len);
+    ASSERT(0 == strcmp("1ffffffffffffffffffffffffffffffe0", (s = apint_format_as_hex(dst))));
+    apint_free_str(s);
+    subtraction(dst, dst, dst);
+    ASSERT(apint_is_zero(dst) && !apint_is_negative(dst));
+    subtraction(b, objs->ap1, b);
+    ASSERT(b->data == b->small && b->cap >= APINT_INLINE_LIMBS);
+    ASSERT(0xfffffffffffffffeUL == apint_get_bits(b, 0));
+
+    apint_destroy(a);
+    apint_destroy(b);
+    apint_destroy(dst);
+    apint_set_allocator(NULL, NULL, NULL);
+    ASSERT(hook_live_bytes == 0);
+    ASSERT(hook_size_mismatches == 0);
+}
+
+// the host kernels must agree with the portable ones
+void testKernelDispatch(TestObjs *objs){
+    (void)objs;
+    ASSERT(apint_kernels() != NULL);
+    for (int i = 0; i < 40; i++) {
+        ApInt *a = random_apint(1 + test_rand() % 300);
+        ApInt *b = random_apint(1 + test_rand() % 150);
+        ApInt *results[2][5];
+        for (int generic = 0; generic < 2; generic++) {
+            apint_use_generic_kernels(generic);
+            results[generic][0] = apint_add(a, b);
+            results[generic][1] = apint_sub(a, b);
+            results[generic][2] = apint_mul(a, b);
+            results[generic][3] = apint_div(results[generic][2], a); // normalizing shifts of every count
+            results[generic][4] = apint_mod(a, b);
+        }
+        int ok = 1;
+        for (int k = 0; k < 5; k++) {
+            ok &= same_value(results[0][k], results[1][k]);
+            apint_destroy(results[0][k]);
+            apint_destroy(results[1][k]);
+        }
+        apint_destroy(a);
+        apint_destroy(b);
+        ASSERT(ok);
+    }
+    apint_use_generic_kernels(0);
+}
+
+void testHexConversion(TestObjs *objs){
+    ApInt *a = apint_create_from_u64(0UL);
+    char buf[64];
+
+    // exact buffer sizes
+    ASSERT(2 == apint_hex_size(objs->ap0));
+    ASSERT(3 == apint_hex_size(objs->minus1));
+    ASSERT(33 == apint_hex_size(objs->max2));
+    ASSERT(APINT_ERR_RANGE == apint_format_as_hex_into(buf, 32, objs->max2));
+    ASSERT(APINT_OK == apint_format_as_hex_into(buf, 33, objs->max2));
+    ASSERT(0 == strcmp("fffffffffffffffffffffffffffffffa", buf));
+    ASSERT(APINT_OK == apint_format_as_hex_into(buf, 3, objs->minus1));
+    ASSERT(0 == strcmp("-1", buf));
+
+    // case, leading zeros and negative zero
+    ASSERT(APINT_OK == apint_set_hex(a, "-00000000000000000000DeadBeef0123456789ABCDEF"));
+    ASSERT(APINT_OK == apint_format_as_hex_into(buf, sizeof(buf), a));
+    ASSERT(0 == strcmp("-deadbeef0123456789abcdef", buf));
+    ASSERT(APINT_OK == apint_set_hex(a, "-0000000000000000000"));
+    ASSERT(apint_is_zero(a) && a->flags == 0);
+
+    // malformed input is rejected, wherever the bad character is
+    const char *bad[] = { "", "-", "--1", "0x10", "12g4", " 12", "12 ",
+        "123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdeG",
+        "1@3456789abcdef0123456789abcdef0", "123456789abcdef0\x80", "123456789abcdef0123456789abcde/f" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        apint_set_u64(a, 7UL);
+        ASSERT(APINT_ERR_INVALID == apint_set_hex(a, bad[i]));
+        ASSERT(apint_is_zero(a));
+        ASSERT(NULL == apint_create_from_hex(bad[i]));
+    }
+
+    // round trips through both the host and the portable kernels
+    for (int i = 0; i < 200; i++) {
+        ApInt *v = random_apint(1 + test_rand() % 40);
+        int ok = 1;
+        for (int generic = 0; generic < 2; generic++) {
+            apint_use_generic_kernels(generic);
+            char *s = apint_format_as_hex(v);
+            ok &= strlen(s) + 1 == apint_hex_size(v);
+            ok &= apint_set_hex(a, s) == APINT_OK && same_value(a, v);
+            for (char *c = s; *c; c++) { // and in upper case
+                if (*c >= 'a') {
+                    *c -= 'a' - 'A';
+                }
+            }
+            ok &= apint_set_hex(a, s) == APINT_OK && same_value(a, v);
+            apint_free_str(s);
+        }
+        apint_destroy(v);
+        ASSERT(ok);
+    }
+    apint_use_generic_kernels(0);
+    apint_destroy(a);
+}
+
+void testDecConversion(TestObjs *objs){
+    ApInt *a = apint_create_from_u64(0UL);
+    char buf[64];
+    char *s;
+
+    ASSERT(0 == strcmp("0", (s = apint_format_as_dec(objs->ap0))));
+    apint_free_str(s);
+    ASSERT(0 == strcmp("-1", (s = apint_format_as_dec(objs->minus1))));
+    apint_free_str(s);
+    ASSERT(0 == strcmp("340282366920938463463374607431768211450", (s = apint_format_as_dec(objs->max2))));
+    apint_free_str(s);
+    ASSERT(APINT_OK == apint_set_dec(a, "-0018446744073709551616"));
+    ASSERT(0 == strcmp("-10000000000000000", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    ASSERT(APINT_ERR_RANGE == apint_format_as_dec_into(buf, 21, a));
+    ASSERT(APINT_OK == apint_format_as_dec_into(buf, 22, a));
+    ASSERT(0 == strcmp("-18446744073709551616", buf));
+    ASSERT(APINT_OK == apint_set_dec(a, "-000"));
+    ASSERT(apint_is_zero(a) && a->flags == 0);
+
+    const char *bad[] = { "", "-", "+1", "1a", "12345678x", "1234567890123456789012345678901234567890.",
+        "12345678901234567890123456789012345678901234567890123456789012345678901234567890-" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        apint_set_u64(a, 7UL);
+        ASSERT(APINT_ERR_INVALID == apint_set_dec(a, bad[i]));
+        ASSERT(apint_is_zero(a));
+        ASSERT(NULL == apint_create_from_dec(bad[i]));
+    }
+
+    // 10^3000 - 1 parsed and formatted, against repeated multiplication
+    char *nines = malloc(3001);
+    memset(nines, '9', 3000);
+    nines[3000] = '\0';
+    ApInt *ten = apint_create_from_u64(10UL);
+    ApInt *p = apint_create_from_u64(1UL);
+    for (int i = 0; i < 3000; i++) {
+        apint_mul_into(p, p, ten);
+    }
+    apint_sub_into(p, p, objs->ap1);
+    ASSERT(APINT_OK == apint_set_dec(a, nines));
+    ASSERT(same_value(a, p));
+    ASSERT(0 == strcmp(nines, (s = apint_format_as_dec(p))));
+    apint_free_str(s);
+    free(nines);
+    apint_destroy(ten);
+    apint_destroy(p);
+
+    // divide and conquer agrees with the chunk-by-chunk conversion
+    size_t dc = apint_tune_get(APINT_TUNE_DEC_DC);
+    for (int i = 0; i < 60; i++) {
+        ApInt *v = random_apint(1 + test_rand() % 400);
+        apint_tune_set(APINT_TUNE_DEC_DC, 2);
+        char *fast = apint_format_as_dec(v);
+        apint_tune_set(APINT_TUNE_DEC_DC, SIZE_MAX);
+        char *slow = apint_format_as_dec(v);
+        int ok = strcmp(fast, slow) == 0;
+        ok &= strlen(slow) < apint_dec_size(v);
+        ok &= apint_set_dec(a, slow) == APINT_OK && same_value(a, v);
+        apint_tune_set(APINT_TUNE_DEC_DC, 2);
+        ok &= apint_set_dec(a, fast) == APINT_OK && same_value(a, v);
+        apint_free_str(fast);
+        apint_free_str(slow);
+        apint_destroy(v);
+        ASSERT(ok);
+    }
+    apint_tune_set(APINT_TUNE_DEC_DC, dc);
+    apint_destroy(a);
+}
+
+void testShiftBits(TestObjs *objs){
+    ApInt *a, *b;
+    char *s;
+
+    // results too long for len are refused rather than truncated
+    ASSERT(NULL == apint_lshift_bits(objs->ap1, 64 * (size_t)UINT32_MAX));
+    ASSERT(NULL == apint_lshift_bits(objs->ap1, SIZE_MAX));
+    a = apint_create_from_u64(7UL);
+    ASSERT(APINT_ERR_RANGE == apint_lshift_bits_into(a, objs->ap1, 64 * ((size_t)UINT32_MAX - 1)));
+    ASSERT(7UL == apint_get_bits(a, 0) && 1 == a->len);
+    ASSERT(APINT_OK == apint_lshift_bits_into(a, a, 4));
+    ASSERT(0x70UL == apint_get_bits(a, 0));
+    apint_destroy(a);
+
+    a = apint_create_from_hex("-5");
+    b = apint_rshift_bits(a, 1);
+    ASSERT(0 == strcmp("-3", (s = apint_format_as_hex(b))));
+    apint_free_str(s);
+    apint_destroy(b);
+    b = apint_rshift_bits(objs->minus1, 1000);
+    ASSERT(0 == strcmp("-1", (s = apint_format_as_hex(b))));
+    apint_free_str(s);
+    apint_destroy(b);
+    b = apint_rshift_bits(objs->max1, 64);
+    ASSERT(apint_is_zero(b));
+    apint_destroy(b);
+    b = apint_lshift_bits(objs->max1, 68);
+    ASSERT(0 == strcmp("ffffffffffffffff00000000000000000", (s = apint_format_as_hex(b))));
+    apint_free_str(s);
+    apint_destroy(b);
+    apint_destroy(a);
+
+    // the fixed-width shift no longer misbehaves at 64 bits and beyond
+    a = apint_lshift_n(objs->shift, 64);
+    ASSERT(0 == strcmp("80008001800080010000000000000000", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    apint_destroy(a);
+    a = apint_lshift_n(objs->shift, 128);
+    ASSERT(apint_is_zero(a));
+    apint_destroy(a);
+    a = apint_lshift_n(objs->shift, 4000000000u); // zero without building the wide value
+    ASSERT(apint_is_zero(a) && a->flags == 0 && a->cap <= objs->shift->len + 1);
+    apint_destroy(a);
+    a = apint_lshift_n(objs->shift, 68);
+    ASSERT(0 == strcmp("80018000800100000000000000000", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    apint_destroy(a);
+
+    // against multiplication and floor division by 2^n
+    ApInt *pow2 = apint_create_from_u64(1UL);
+    ApInt *q = apint_create_from_u64(0UL), *r = apint_create_from_u64(0UL);
+    ApInt *dst = apint_create_from_u64(0UL);
+    size_t n = 0;
+    for (int i = 0; i < 100; i++) {
+        size_t bits = test_rand() % 700;
+        for (; n < bits; n++) {
+            apint_add_into(pow2, pow2, pow2);
+        }
+        for (; n > bits; n--) { // halving 2^n is exact
+            apint_rshift_bits_into(pow2, pow2, 1);
+        }
+        a = random_apint(1 + test_rand() % 12);
+        apint_mul_into(q, a, pow2);
+        b = apint_lshift_bits(a, bits);
+        int ok = same_value(b, q);
+        apint_destroy(b);
+        apint_set(dst, a);
+        apint_lshift_bits_into(dst, dst, bits);
+        ok &= same_value(dst, q);
+
+        apint_divmod_into(q, r, a, pow2);
+        if (apint_is_negative(r)) { // truncated to floored
+            apint_sub_into(q, q, objs->ap1);
+        }
+        b = apint_rshift_bits(a, bits);
+        ok &= same_value(b, q);
+        apint_destroy(b);
+        apint_set(dst, a);
+        apint_rshift_bits_into(dst, dst, bits);
+        ok &= same_value(dst, q);
+        apint_destroy(a);
+        ASSERT(ok);
+    }
+    apint_destroy(pow2);
+    apint_destroy(q);
+    apint_destroy(r);
+    apint_destroy(dst);
+}
+
+// a OP b formatted as hex equals expected
+static int bitwise_is(ApInt *(*op)(const ApInt *, const ApInt *), const char *a, const char *b, const char *expected) {
+    ApInt *x = apint_create_from_hex(a), *y = apint_create_from_hex(b);
+    ApInt *r = op(x, y);
+    char *s = apint_format_as_hex(r);
+    int ok = strcmp(s, expected) == 0;
+    apint_free_str(s);
+    apint_destroy(r);
+    apint_destroy(x);
+    apint_destroy(y);
+    return ok;
+}
+
+void testBitwise(TestObjs *objs){
+    ApInt *a, *b, *c, *d;
+    char *s;
+
+    ASSERT(bitwise_is(apint_and, "c", "a", "8"));
+    ASSERT(bitwise_is(apint_or, "c", "a", "e"));
+    ASSERT(bitwise_is(apint_xor, "c", "a", "6"));
+    ASSERT(bitwise_is(apint_and, "-6", "5", "0"));
+    ASSERT(bitwise_is(apint_or, "-6", "5", "-1"));
+    ASSERT(bitwise_is(apint_xor, "-6", "3", "-7"));
+    ASSERT(bitwise_is(apint_and, "c", "-4", "c"));
+    ASSERT(bitwise_is(apint_and, "-1", "-10000000000000000", "-10000000000000000"));
+    ASSERT(bitwise_is(apint_or, "ffffffffffffffff0000000000000000", "-1", "-1"));
+    ASSERT(bitwise_is(apint_xor, "-ffffffffffffffffffffffffffffffff", "ffffffffffffffffffffffffffffffff", "-2"));
+    ASSERT(bitwise_is(apint_and, "123456789abcdef0123456789", "0", "0"));
+
+    a = apint_not(objs->ap0);
+    ASSERT(0 == strcmp("-1", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    b = apint_not(a);
+    ASSERT(apint_is_zero(b));
+    apint_destroy(a);
+    apint_destroy(b);
+    a = apint_not(objs->max1);
+    ASSERT(0 == strcmp("-10000000000000000", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    apint_destroy(a);
+
+    ASSERT(0 == apint_popcount(objs->ap0));
+    ASSERT(64 == apint_popcount(objs->max1));
+    ASSERT(SIZE_MAX == apint_popcount(objs->minus1));
+    ASSERT(SIZE_MAX == apint_ctz(objs->ap0));
+    ASSERT(64 == apint_ctz(objs->trail0));
+    ASSERT(0 == apint_ctz(objs->minus1));
+
+    // -6 is ...11010
+    a = apint_create_from_hex("-6");
+    ASSERT(1 == apint_ctz(a));
+    ASSERT(!apint_test_bit(a, 0) && apint_test_bit(a, 1) && !apint_test_bit(a, 2));
+    ASSERT(apint_test_bit(a, 3) && apint_test_bit(a, 1000));
+    apint_set_bit(a, 2);
+    ASSERT(0 == strcmp("-2", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    apint_set_bit(a, 5);
+    ASSERT(0 == strcmp("-2", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    apint_destroy(a);
+    a = apint_create_from_u64(0UL);
+    ASSERT(APINT_OK == apint_set_bit(a, 130));
+    ASSERT(0 == strcmp("400000000000000000000000000000000", (s = apint_format_as_hex(a))));
+    apint_free_str(s);
+    ASSERT(apint_test_bit(a, 130) && !apint_test_bit(a, 129) && !apint_test_bit(a, 5000));
+    ASSERT(APINT_ERR_RANGE == apint_set_bit(a, 64 * (size_t)UINT32_MAX)); // would need 2^32 limbs
+    ASSERT(3 == a->len && apint_test_bit(a, 130));
+    apint_destroy(a);
+
+    // identities over random signed operands, host and generic kernels
+    c = apint_create_from_u64(0UL);
+    d = apint_create_from_u64(0UL);
+    for (int generic = 0; generic <= 1; generic++) {
+        apint_use_generic_kernels(generic);
+        for (int i = 0; i < 200; i++) {
+            a = random_apint(1 + test_rand() % 40);
+            b = random_apint(1 + test_rand() % 40);
+            ApInt *and = apint_and(a, b), *or = apint_or(a, b), *xor = apint_xor(a, b);
+            // a + b == (a | b) + (a & b) and a ^ b == (a | b) - (a & b)
+            apint_add_into(c, a, b);
+            apint_add_into(d, or, and);
+            int ok = same_value(c, d);
+            apint_sub_into(d, or, and);
+            ok &= same_value(d, xor);
+            // a & b == ~(~a | ~b), in place
+            apint_not_into(c, a);
+            apint_not_into(d, b);
+            apint_or_into(c, c, d);
+            apint_not_into(c, c);
+            ok &= same_value(c, and);
+            // test_bit against floor shifts, whose low bit matches for either sign
+            size_t bit = test_rand() % (64 * a->len + 64);
+            apint_rshift_bits_into(c, a, bit);
+            ok &= apint_test_bit(a, bit) == (int)(c->data[0] & 1);
+            // setting a bit is an or with that power of two
+            apint_set(c, objs->ap0);
+            apint_set_bit(c, bit);
+            apint_or_into(d, a, c);
+            apint_set_bit(a, bit);
+            ok &= same_value(a, d) && apint_test_bit(a, bit);
+            if (!apint_is_negative(b)) {
+                size_t count = 0;
+                for (size_t k = 0; k < 64 * b->len; k++) {
+                    count += apint_test_bit(b, k);
+                }
+                ok &= count == apint_popcount(b);
+            }
+            apint_destroy(and);
+            apint_destroy(or);
+            apint_destroy(xor);
+            apint_destroy(a);
+            apint_destroy(b);
+            ASSERT(ok);
+        }
+    }
+    apint_use_generic_kernels(0);
+    apint_destroy(c);
+    apint_destroy(d);
+}
+
+// base^exp mod m formatted as hex equals expected
+static int powmod_is(const char *base, const char *exp, const char *mod, const char *expected) {
+    ApInt *b = apint_create_from_hex(base), *e = apint_create_from_hex(exp), *m = apint_create_from_hex(mod);
+    ApInt *r = apint_powmod(b, e, m);
+    char *s = apint_format_as_hex(r);
+    int ok = strcmp(s, expected) == 0;
+    apint_free_str(s);
+    apint_destroy(r);
+    apint_destroy(b);
+    apint_destroy(e);
+    apint_destroy(m);
+    return ok;
+}
+
+// right-to-left square and multiply with truncating division, as a reference
+static void reference_powmod(ApInt *r, const ApInt *base, const ApInt *exp, const ApInt *mod) {
+    ApInt *b = apint_create_from_u64(0UL);
+    apint_divmod_into(NULL, b, base, mod);
+    if (apint_is_negative(b)) {
+        apint_add_into(b, b, mod);
+    }
+    apint_set_u64(r, 1UL);
+    apint_divmod_into(NULL, r, r, mod);
+    for (size_t i = 0; i < 64 * (size_t)exp->len; i++) {
+        if (apint_test_bit(exp, i)) {
+            apint_mul_into(r, r, b);
+            apint_divmod_into(NULL, r, r, mod);
+        }
+        apint_mul_into(b, b, b);
+        apint_divmod_into(NULL, b, b, mod);
+    }
+    apint_destroy(b);
+}
+
+void testPowmod(TestObjs *objs){
+    ASSERT(powmod_is("3", "c8", "f4247", "ea26a"));
+    ASSERT(powmod_is("123456789abcdef", "fedcba987654321fedcba", "7fffffffffffffffffffffffffffffff",
+                     "7569de625c08d21c282d7d5089e53346"));
+    ASSERT(powmod_is("-5", "3", "400000000000000000", "3fffffffffffffff83"));
+    ASSERT(powmod_is("7", "3e8", "c9f2c9cd04674edea40000000", "3cc0826c6dc0903e799c0dbc1"));
+    ASSERT(powmod_is("5", "0", "7", "1"));
+    ASSERT(powmod_is("5", "0", "1", "0"));
+    ASSERT(powmod_is("0", "0", "8", "1"));
+    ASSERT(powmod_is("0", "5", "7", "0"));
+
+    ApInt *r = apint_create_from_u64(0UL);
+    ASSERT(APINT_ERR_DIVZERO == apint_powmod_into(r, objs->ap1, objs->ap1, objs->ap0));
+    ASSERT(APINT_ERR_INVALID == apint_powmod_into(r, objs->ap1, objs->minus1, objs->max1));
+    ASSERT(NULL == apint_powmod(objs->ap1, objs->ap1, objs->ap0));
+    ASSERT(NULL == apint_mont_create(objs->ap0));
+    ApIntMontCtx *ctx = apint_mont_create(objs->trail0);
+    ASSERT(APINT_ERR_INVALID == apint_mont_powmod_sec_into(r, objs->ap1, objs->ap1, ctx));
+    apint_mont_destroy(ctx);
+
+    // odd and even moduli around the Karatsuba size, one context per modulus
+    ApInt *expected = apint_create_from_u64(0UL);
+    for (int i = 0; i < 60; i++) {
+        ApInt *mod = random_apint(i < 50 ? 1 + test_rand() % 12 : 56 + test_rand() % 16);
+        mod->flags = 0;
+        if (i % 3 != 0) {
+            mod->data[0] |= 1;
+        }
+        ctx = apint_mont_create(mod);
+        int ok = 1;
+        for (int j = 0; j < 3; j++) {
+            ApInt *base = random_apint(1 + test_rand() % (2 * mod->len));
+            ApInt *exp = random_apint(1 + test_rand() % 3);
+            exp->flags = 0;
+            reference_powmod(expected, base, exp, mod);
+            ok &= APINT_OK == apint_mont_powmod_into(r, base, exp, ctx) && same_value(r, expected);
+            if (mod->data[0] & 1) {
+                ok &= APINT_OK == apint_mont_powmod_sec_into(r, base, exp, ctx) && same_value(r, expected);
+            }
+            ApInt *direct = apint_powmod(base, exp, mod);
+            ok &= same_value(direct, expected);
+            apint_destroy(direct);
+            apint_destroy(base);
+            apint_destroy(exp);
+        }
+        apint_mont_destroy(ctx);
+        apint_destroy(mod);
+        ASSERT(ok);
+    }
+    apint_destroy(expected);
+    apint_destroy(r);
+}
+
+void testBatch(TestObjs *objs){
+    enum { N = 203, BATCH_TEST_MAX_LIMBS = 8 };
+    ApInt *a[N], *b[N], *dst[N];
+    int cmp[N];
+
+    // every lane length and some past them, zeros (-0 too) and aliased dst
+    for (int i = 0; i < N; i++) {
+        a[i] = i % 17 == 0 ? apint_create_from_u64(0UL) : random_apint(i % 3 == 0 ? 1 + test_rand() % 12 : 1);
+        if (i % 34 == 0) {
+            a[i]->flags = 1;
+        }
+        b[i] = i % 13 == 0 ? apint_negate(a[i]) : random_apint(i % 5 == 0 ? 1 + test_rand() % 12 : 1);
+        dst[i] = i % 7 == 0 ? a[i] : i % 11 == 0 ? b[i] : apint_create_from_u64(0UL);
+    }
+    ApInt *expected[N];
+    for (int i = 0; i < N; i++) {
+        expected[i] = apint_add(a[i], b[i]);
+    }
+    apint_compare_batch(cmp, (const ApInt *const *)a, (const ApInt *const *)b, N);
+    int ok = 1;
+    for (int i = 0; i < N; i++) {
+        ok &= cmp[i] == apint_compare(a[i], b[i]);
+    }
+    apint_add_batch(dst, (const ApInt *const *)a, (const ApInt *const *)b, N);
+    for (int i = 0; i < N; i++) {
+        ok &= same_value(dst[i], expected[i]);
+        apint_destroy(expected[i]);
+        if (dst[i] != a[i] && dst[i] != b[i]) {
+            apint_destroy(dst[i]);
+        }
+        apint_destroy(a[i]);
+        apint_destroy(b[i]);
+    }
+    ASSERT(ok);
+    apint_add_batch(dst, NULL, NULL, 0);
+
+    // no allocations once the dsts have room, and a fixed number for powmod
+    hook_live_bytes = hook_allocs = hook_size_mismatches = 0;
+    apint_set_allocator(counting_alloc, counting_realloc, counting_free);
+    for (int i = 0; i < N; i++) {
+        a[i] = random_apint(1 + i % BATCH_TEST_MAX_LIMBS);
+        b[i] = random_apint(1 + test_rand() % BATCH_TEST_MAX_LIMBS);
+        dst[i] = apint_create_from_u64(0UL);
+        apint_reserve(dst[i], BATCH_TEST_MAX_LIMBS + 1);
+    }
+    hook_allocs = 0;
+    apint_add_batch(dst, (const ApInt *const *)a, (const ApInt *const *)b, N);
+    apint_compare_batch(cmp, (const ApInt *const *)a, (const ApInt *const *)b, N);
+    ASSERT(0 == hook_allocs);
+    ApInt *pmod = random_apint(BATCH_TEST_MAX_LIMBS + 1); // longer than the bases, which need no division
+    pmod->flags = 0;
+    pmod->data[0] |= 1;
+    for (int i = 0; i < N; i++) {
+        a[i]->flags = b[i]->flags = 0;
+    }
+    hook_allocs = 0;
+    ASSERT(APINT_OK == apint_powmod_batch(dst, (const ApInt *const *)a, (const ApInt *const *)b, pmod, 1));
+    size_t one_allocs = hook_allocs;
+    hook_allocs = 0;
+    ASSERT(APINT_OK == apint_powmod_batch(dst, (const ApInt *const *)a, (const ApInt *const *)b, pmod, N));
+    ASSERT(one_allocs == hook_allocs); // the context and the scratch, shared by every element
+    apint_destroy(pmod);
+    for (int i = 0; i < N; i++) {
+        apint_destroy(a[i]);
+        apint_destroy(b[i]);
+        apint_destroy(dst[i]);
+    }
+    apint_set_allocator(NULL, NULL, NULL);
+    ASSERT(hook_live_bytes == 0 && hook_size_mismatches == 0);
+
+    // modexp with a shared modulus, against one call per element
+    ApInt *mod = random_apint(6);
+    mod->flags = 0;
+    mod->data[0] |= 1;
+    for (int i = 0; i < 20; i++) {
+        a[i] = random_apint(1 + test_rand() % 8);
+        b[i] = i % 9 == 0 ? apint_create_from_u64(i % 2) : random_apint(1 + test_rand() % 12); // every window width
+        b[i]->flags = 0;
+        dst[i] = apint_create_from_u64(0UL);
+    }
+    ASSERT(APINT_OK == apint_powmod_batch(dst, (const ApInt *const *)a, (const ApInt *const *)b, mod, 20));
+    ApInt *r = apint_create_from_u64(0UL);
+    ok = 1;
+    for (int i = 0; i < 20; i++) {
+        apint_powmod_into(r, a[i], b[i], mod);
+        ok &= same_value(r, dst[i]);
+    }
+    ASSERT(ok);
+    b[3]->flags = 1;
+    ASSERT(APINT_ERR_INVALID == apint_powmod_batch(dst, (const ApInt *const *)a, (const ApInt *const *)b, mod, 20));
+    ASSERT(APINT_ERR_DIVZERO == apint_powmod_batch(dst, (const ApInt *const *)a, (const ApInt *const *)b, objs->ap0, 20));
+    for (int i = 0; i < 20; i++) {
+        apint_destroy(a[i]);
+        apint_destroy(b[i]);
+        apint_destroy(dst[i]);
+    }
+    apint_destroy(r);
+    apint_destroy(mod);
+}
+
+void testThreads(TestObjs *objs){
+    size_t kara = apint_tune_get(APINT_TUNE_MUL_KARATSUBA);
+    size_t toom = apint_tune_get(APINT_TUNE_MUL_TOOM3);
+    size_t ntt = apint_tune_get(APINT_TUNE_MUL_NTT);
+    size_t par = apint_tune_get(APINT_TUNE_PARALLEL);
+    size_t par_add = apint_tune_get(APINT_TUNE_PARALLEL_ADD);
+    ApInt *serial = apint_create_from_u64(0UL), *threaded = apint_create_from_u64(0UL);
+
+    ASSERT(1 == apint_get_threads());
+    ASSERT(4 == apint_set_threads(4));
+    ASSERT(4 == apint_get_threads());
+    // small thresholds so every parallel path runs, results checked against one thread
+    apint_tune_set(APINT_TUNE_PARALLEL, 24);
+    apint_tune_set(APINT_TUNE_PARALLEL_ADD, 40);
+    static const size_t thresholds[3][3] = { { 8, SIZE_MAX, SIZE_MAX }, { 8, 32, SIZE_MAX }, { 8, 32, 200 } };
+    for (int t = 0; t < 3; t++) {
+        apint_tune_set(APINT_TUNE_MUL_KARATSUBA, thresholds[t][0]);
+        apint_tune_set(APINT_TUNE_MUL_TOOM3, thresholds[t][1]);
+        apint_tune_set(APINT_TUNE_MUL_NTT, thresholds[t][2]);
+        for (int i = 0; i < 10; i++) {
+            ApInt *a = random_apint(30 + test_rand() % 400);
+            ApInt *b = random_apint(30 + test_rand() % 400);
+            apint_mul_into(threaded, a, b);
+            apint_set_threads(1);
+            apint_mul_into(serial, a, b);
+            apint_set_threads(4);
+            int ok = same_value(serial, threaded);
+            // all-ones operands carry across every chunk boundary
+            for (uint32_t k = 0; k < a->len; k++) {
+                a->data[k] = ~0UL;
+            }
+            a->flags = 0;
+            apint_add_into(threaded, a, objs->ap1);
+            ok &= threaded->len == a->len + 1 && apint_popcount(threaded) == 1;
+            apint_sub_into(threaded, threaded, objs->ap1);
+            ok &= apint_compare(threaded, a) == 0;
+            apint_add_into(threaded, a, a); // 2^(64 len + 1) - 2
+            ok &= apint_popcount(threaded) == 64 * (size_t)a->len && apint_ctz(threaded) == 1;
+            apint_set_u64(serial, 1UL);
+            apint_set_bit(serial, 64 * (a->len - 1)); // the carry runs through every chunk of ones
+            apint_add_into(threaded, a, serial);
+            ok &= threaded->len == a->len + 1 && apint_popcount(threaded) == 2;
+            apint_sub_into(threaded, threaded, serial);
+            ok &= apint_compare(threaded, a) == 0;
+            apint_add_into(threaded, a, b);
+            apint_sub_into(threaded, threaded, b);
+            ok &= apint_compare(threaded, a) == 0;
+            ASSERT(ok);
+            apint_destroy(a);
+            apint_destroy(b);
+        }
+    }
+
+    // divide-and-conquer decimal conversion both ways
+    ApInt *a = random_apint(600);
+    char *s = apint_format_as_dec(a);
+    ApInt *back = apint_create_from_dec(s);
+    apint_set_threads(1);
+    char *s1 = apint_format_as_dec(a);
+    ASSERT(0 == strcmp(s, s1));
+    ASSERT(same_value(a, back));
+    apint_free_str(s);
+    apint_free_str(s1);
+    apint_destroy(back);
+    apint_destroy(a);
+
+    ASSERT(1 == apint_get_threads());
+    apint_tune_set(APINT_TUNE_MUL_KARATSUBA, kara);
+    apint_tune_set(APINT_TUNE_MUL_TOOM3, toom);
+    apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+    apint_tune_set(APINT_TUNE_PARALLEL, par);
+    apint_tune_set(APINT_TUNE_PARALLEL_ADD, par_add);
+    apint_destroy(serial);
+    apint_destroy(threaded);
+}
+
+/*
+ * Many threads using every part of the API at once, on shared read-only
+ * operands and their own results, while the pool takes on the large
+ * operations of all of them.  Run under -fsanitize=thread as well.
+ */
+#define STRESS_THREADS 12
+
+typedef struct {
+    const ApInt *big_a, *big_b, *big_prod; // shared, read by every thread
+    const ApInt *mod, *base, *exp, *powm;
+    const ApIntMontCtx *ctx;
+    uint64_t seed;
+    int failures;
+} StressArgs;
+
+static uint64_t stress_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static void stress_fill(ApInt *ap, uint32_t len, uint64_t *state) {
+    apint_reserve(ap, len);
+    for (uint32_t i = 0; i < len; i++) {
+        ap->data[i] = stress_rand(state);
+    }
+    ap->data[len - 1] |= 1;
+    ap->len = len;
+    ap->flags = stress_rand(state) & 1;
+}
+
+static void *stress_thread(void *arg) {
+    StressArgs *args = (StressArgs*)arg;
+    uint64_t state = args->seed;
+    ApInt *a = apint_create_from_u64(0UL), *b = apint_create_from_u64(0UL);
+    ApInt *r = apint_create_from_u64(0UL), *q = apint_create_from_u64(0UL), *m = apint_create_from_u64(0UL);
+    ApIntArena *arena = apint_arena_create(0);
+    int fail = 0;
+    for (int iter = 0; iter < 40; iter++) {
+        stress_fill(a, 1 + stress_rand(&state) % 30, &state);
+        stress_fill(b, 1 + stress_rand(&state) % 30, &state);
+
+        apint_add_into(r, a, b); // (a + b) - b
+        apint_sub_into(r, r, b);
+        fail += apint_compare(r, a) != 0;
+        apint_mul_into(r, a, b); // a * b / b
+        fail += apint_divmod_into(q, m, r, b) != APINT_OK || apint_compare(q, a) != 0 || !apint_is_zero(m);
+        apint_xor_into(r, a, b); // a ^ b == (a | b) - (a & b)
+        apint_or_into(q, a, b);
+        apint_and_into(m, a, b);
+        apint_sub_into(q, q, m);
+        fail += apint_compare(r, q) != 0;
+        apint_lshift_bits_into(r, a, 100);
+        apint_rshift_bits_into(r, r, 100);
+        fail += apint_compare(r, a) != 0;
+
+        char *hex = apint_format_as_hex(a), *dec = apint_format_as_dec(a);
+        fail += apint_set_hex(r, hex) != APINT_OK || apint_compare(r, a) != 0;
+        fail += apint_set_dec(q, dec) != APINT_OK || apint_compare(q, a) != 0;
+        apint_free_str(hex);
+        apint_free_str(dec);
+
+        const ApInt *pa[2] = { a, b }, *pb[2] = { b, a };
+        ApInt *pd[2] = { r, q };
+        int cmp[2];
+        apint_add_batch(pd, pa, pb, 2);
+        apint_compare_batch(cmp, pa, pb, 2);
+        fail += apint_compare(r, q) != 0 || cmp[0] != -cmp[1];
+
+        ApInt *x = apint_arena_create_from_u64(arena, stress_rand(&state));
+        apint_mul_into(x, x, a);
+        fail += apint_divmod_into(m, NULL, x, a) != APINT_OK;
+        apint_arena_reset(arena);
+
+        // shared operands, large enough for the pool
+        if (iter % 8 == 0) {
+            apint_mul_into(r, args->big_a, args->big_b);
+            fail += apint_compare(r, args->big_prod) != 0;
+            fail += apint_mont_powmod_into(q, args->base, args->exp, args->ctx) != APINT_OK
+                || apint_compare(q, args->powm) != 0;
+            fail += apint_powmod_into(q, args->base, args->exp, args->mod) != APINT_OK
+                || apint_compare(q, args->powm) != 0;
+        }
+    }
+    apint_arena_destroy(arena);
+    apint_destroy(a);
+    apint_destroy(b);
+    apint_destroy(r);
+    apint_destroy(q);
+    apint_destroy(m);
+    args->failures = fail;
+    return NULL;
+}
+
+void testThreadStress(TestObjs *objs){
+    (void)objs;
+    size_t par = apint_tune_get(APINT_TUNE_PARALLEL);
+    size_t par_add = apint_tune_get(APINT_TUNE_PARALLEL_ADD);
+    ApInt *big_a = random_apint(700), *big_b = random_apint(650), *big_prod = apint_mul(big_a, big_b);
+    ApInt *mod = random_apint(8), *base = random_apint(10), *exp = random_apint(4);
+    mod->data[0] |= 1;
+    exp->flags = 0;
+    ApInt *powm = apint_powmod(base, exp, mod);
+    ApIntMontCtx *ctx = apint_mont_create(mod);
+
+    apint_set_threads(4);
+    apint_tune_set(APINT_TUNE_PARALLEL, 200);
+    apint_tune_set(APINT_TUNE_PARALLEL_ADD, 200);
+    pthread_t threads[STRESS_THREADS];
+    StressArgs args[STRESS_THREADS];
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        args[i] = (StressArgs){ big_a, big_b, big_prod, mod, base, exp, powm, ctx, test_rand(), 0 };
+        ASSERT(pthread_create(&threads[i], NULL, stress_thread, &args[i]) == 0);
+    }
+    int failures = 0;
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        failures += args[i].failures;
+    }
+    apint_set_threads(1);
+    apint_tune_set(APINT_TUNE_PARALLEL, par);
+    apint_tune_set(APINT_TUNE_PARALLEL_ADD, par_add);
+    ASSERT(failures == 0);
+
+    apint_mont_destroy(ctx);
+    apint_destroy(big_a);
+    apint_destroy(big_b);
+    apint_destroy(big_prod);
+    apint_destroy(mod);
+    apint_destroy(base);
+    apint_destroy(exp);
+    apint_destroy(powm);
+}
+
+static void *stats_thread(void *arg) {
+    ApInt *a = apint_create_from_u64(5UL);
+    apint_add_into(a, a, (const ApInt*)arg);
+    apint_destroy(a);
+    return NULL;
+}
+
+void testStats(TestObjs *objs) {
+    ApIntStats s;
+    if (apint_stats_get(&s) != APINT_OK) { // built without APINT_STATS
+        ASSERT(s.calls[APINT_STAT_ADD] == 0 && s.allocs == 0);
+        return;
+    }
+    size_t kara = apint_tune_get(APINT_TUNE_MUL_KARATSUBA);
+    size_t sqr = apint_tune_get(APINT_TUNE_SQR_KARATSUBA);
+    size_t toom = apint_tune_get(APINT_TUNE_MUL_TOOM3);
+    apint_tune_set(APINT_TUNE_MUL_KARATSUBA, 8);
+    apint_tune_set(APINT_TUNE_SQR_KARATSUBA, 8);
+    apint_tune_set(APINT_TUNE_MUL_TOOM3, SIZE_MAX);
+    apint_stats_reset();
+    ApInt *a = random_apint(20), *b = random_apint(3);
+    ApInt *sum = apint_add(a, b);  // create, add of 20 limbs
+    apint_add_into(sum, sum, objs->ap1);
+    ApInt *prod = apint_mul(a, a); // Karatsuba, basecase below
+    ApInt *quot = apint_div(prod, b);
+    pthread_t thread;
+    ASSERT(pthread_create(&thread, NULL, stats_thread, objs->ap1) == 0);
+    pthread_join(thread, NULL); // an exited thread still counts
+    apint_stats_get(&s);
+    apint_tune_set(APINT_TUNE_MUL_KARATSUBA, kara);
+    apint_tune_set(APINT_TUNE_SQR_KARATSUBA, sqr);
+    apint_tune_set(APINT_TUNE_MUL_TOOM3, toom);
+
+    ASSERT(s.calls[APINT_STAT_ADD] == 3);
+    ASSERT(s.sizes[APINT_STAT_ADD][5] == 2); // 17 to 32 limbs
+    ASSERT(s.sizes[APINT_STAT_ADD][0] == 1);
+    ASSERT(s.calls[APINT_STAT_MUL] == 1 && s.sizes[APINT_STAT_MUL][5] == 1);
+    ASSERT(s.calls[APINT_STAT_DIVMOD] == 1);
+    ASSERT(s.calls[APINT_STAT_DESTROY] == 1);
+    ASSERT(s.algo[APINT_ALGO_MUL_KARATSUBA] >= 1 && s.algo[APINT_ALGO_MUL_BASECASE] >= 3);
+    ASSERT(s.algo[APINT_ALGO_DIV_KNUTH] == 1);
+    ASSERT(s.allocs > 0 && s.alloc_bytes > 0 && s.frees >= 1);
+
+    apint_stats_reset();
+    apint_stats_get(&s);
+    ASSERT(s.calls[APINT_STAT_ADD] == 0 && s.algo[APINT_ALGO_MUL_KARATSUBA] == 0 && s.allocs == 0);
+    apint_destroy(a);
+    apint_destroy(b);
+    apint_destroy(sum);
+    apint_destroy(prod);
+    apint_destroy(quot);
+}
+
+void testSerialize(TestObjs *objs) {
+    uint64_t words[64]; // aligned storage for the records
+    unsigned char *buf = (unsigned char*)words;
+    size_t used;
+
+    // 0x1234: header 2 (one limb, positive) padded to 8 bytes, then the limb
+    ApInt *a = apint_create_from_hex("1234");
+    ASSERT(apint_serialized_size(a) == 16);
+    ASSERT(apint_serialize_into(buf, 15, a) == APINT_ERR_RANGE);
+    ASSERT(apint_serialize_into(buf, sizeof(words), a) == APINT_OK);
+    static const unsigned char expected[16] = { 0x82, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x34, 0x12 };
+    ASSERT(memcmp(buf, expected, 16) == 0);
+    apint_destroy(a);
+
+    // unpadded header: -0x5, then trailing bytes that are not part of it
+    static const unsigned char minimal[12] = { 0x03, 0x05, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0xff };
+    a = apint_deserialize(minimal, sizeof(minimal), &used);
+    ASSERT(used == 9);
+    ASSERT(apint_is_negative(a) && apint_get_bits(a, 0) == 5 && a->len == 1);
+    apint_destroy(a);
+
+    // malformed: truncated limbs, a leading zero limb, a negative zero, an endless varint
+    static const unsigned char truncated[9] = { 0x04, 1, 0, 0, 0, 0, 0, 0, 0 };
+    static const unsigned char leading_zero[17] = { 0x04, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    static const unsigned char negative_zero[1] = { 0x01 };
+    static const unsigned char endless[9] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+    ASSERT(apint_deserialize(truncated, sizeof(truncated), NULL) == NULL);
+    ASSERT(apint_deserialize(leading_zero, sizeof(leading_zero), NULL) == NULL);
+    ASSERT(apint_deserialize(negative_zero, sizeof(negative_zero), NULL) == NULL);
+    ASSERT(apint_deserialize(endless, sizeof(endless), NULL) == NULL);
+    ASSERT(apint_deserialize(minimal, 0, NULL) == NULL);
+
+    // records back to back, read back by copy and by view
+    ApInt *vals[5] = { objs->ap0, objs->ap1, objs->max1, objs->minus1, random_apint(20) };
+    size_t off = 0;
+    for (int i = 0; i < 5; i++) {
+        ASSERT(apint_serialize_into(buf + off, sizeof(words) - off, vals[i]) == APINT_OK);
+        off += apint_serialized_size(vals[i]);
+    }
+    ASSERT(off == 8 + 16 + 16 + 16 + 8 + 160);
+    off = 0;
+    for (int i = 0; i < 5; i++) {
+        ApIntView view;
+        ApInt *copy = apint_deserialize(buf + off, sizeof(words) - off, &used);
+        ASSERT(copy != NULL && apint_compare(copy, vals[i]) == 0);
+        ASSERT(apint_view_init(&view, buf + off, sizeof(words) - off, NULL) == APINT_OK);
+        ASSERT(view.value.len == 1 || view.value.data == (uint64_t*)(buf + off + 8)); // no copy
+        ASSERT(apint_compare(&view.value, vals[i]) == 0);
+        ApInt *sum = apint_add(&view.value, objs->ap1);
+        ApInt *expect = apint_add(vals[i], objs->ap1);
+        ASSERT(apint_compare(sum, expect) == 0);
+        char *hex = apint_format_as_hex(&view.value), *want = apint_format_as_hex(vals[i]);
+        ASSERT(strcmp(hex, want) == 0);
+        ASSERT(apint_get_bits(&view.value, 0) == apint_get_bits(vals[i], 0));
+        apint_free_str(hex);
+        apint_free_str(want);
+        apint_destroy(sum);
+        apint_destroy(expect);
+        apint_destroy(copy);
+        off += used;
+    }
+
+    // views need aligned limbs
+    ApIntView view;
+    memmove(buf + 1, buf + 8, 16); // the record of 1
+    ASSERT(apint_view_init(&view, buf + 1, 16, NULL) == APINT_ERR_INVALID);
+    ASSERT(apint_deserialize_into(vals[4], buf + 1, 16, NULL) == APINT_OK); // copying is fine
+    ASSERT(apint_compare(vals[4], objs->ap1) == 0);
+    apint_destroy(vals[4]);
+}
+
+void testStore(TestObjs *objs) {
+    char path[] = "/tmp/apintStoreXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    ApInt *vals[6] = { objs->ap0, objs->minus1, random_apint(7), objs->max1, random_apint(1), random_apint(40) };
+    ApIntStoreWriter *w = apint_store_writer_open(path);
+    ASSERT(w != NULL);
+    for (int i = 0; i < 6; i++) {
+        ASSERT(apint_store_writer_add(w, vals[i]) == APINT_OK);
+    }
+    ASSERT(apint_store_writer_close(w) == APINT_OK);
+
+    ApIntStore *store = apint_store_open(path);
+    ASSERT(store != NULL);
+    ASSERT(apint_store_count(store) == 6);
+    ApIntView view;
+    for (int i = 5; i >= 0; i--) { // any order
+        ASSERT(apint_store_get(store, i, &view) == APINT_OK);
+        ASSERT(apint_compare(&view.value, vals[i]) == 0);
+        ASSERT(view.value.len == 1 || (uintptr_t)view.value.data % 32 == 0);
+    }
+    ASSERT(apint_store_get(store, 6, &view) == APINT_ERR_RANGE);
+    apint_store_close(store);
+
+    // anything else is refused
+    FILE *f = fopen(path, "r+b");
+    ASSERT(f != NULL);
+    fputc('X', f);
+    fclose(f);
+    ASSERT(apint_store_open(path) == NULL);
+    f = fopen(path, "wb");
+    fclose(f);
+    ASSERT(apint_store_open(path) == NULL);
+    remove(path);
+    ASSERT(apint_store_open(path) == NULL);
+    ASSERT(apint_store_writer_open("/nonexistent/dir/store") == NULL);
+
+    apint_destroy(vals[2]);
+    apint_destroy(vals[4]);
+    apint_destroy(vals[5]);
+}
+
+void testAddmul(TestObjs *objs) {
+    (void)objs;
+    for (int i = 0; i < 50; i++) {
+        ApInt *d = random_apint(1 + i % 7), *a = random_apint(1 + i % 5), *b = random_apint(1 + i % 11);
+        ApInt *prod = apint_mul(a, b);
+        ApInt *sum = apint_add(d, prod), *diff = apint_sub(d, prod);
+        ApInt *r = apint_create_from_u64(0UL);
+        apint_set(r, d);
+        apint_addmul_into(r, a, b);
+        ASSERT(apint_compare(r, sum) == 0);
+        apint_submul_into(r, a, b);
+        apint_submul_into(r, a, b);
+        ASSERT(apint_compare(r, diff) == 0);
+        apint_set(r, a); // r += r * b
+        apint_addmul_into(r, r, b);
+        apint_mul_into(prod, a, b);
+        apint_add_into(prod, prod, a);
+        ASSERT(apint_compare(r, prod) == 0);
+        apint_destroy(d);
+        apint_destroy(a);
+        apint_destroy(b);
+        apint_destroy(prod);
+        apint_destroy(sum);
+        apint_destroy(diff);
+        apint_destroy(r);
+    }
+}
+
+// a hex result of apint_gcd, and apint_gcdext's s and t, as strings
+static int gcdext_is(const char *a_hex, const char *b_hex, const char *g_hex, const char *s_hex, const char *t_hex) {
+    ApInt *a = apint_create_from_hex(a_hex), *b = apint_create_from_hex(b_hex);
+    ApInt *g = apint_gcd(a, b), *s, *t;
+    ApInt *g2 = apint_gcdext(a, b, &s, &t);
+    char *gs = apint_format_as_hex(g), *g2s = apint_format_as_hex(g2);
+    char *ss = apint_format_as_hex(s), *ts = apint_format_as_hex(t);
+    int ok = strcmp(gs, g_hex) == 0 && strcmp(g2s, g_hex) == 0 && strcmp(ss, s_hex) == 0 && strcmp(ts, t_hex) == 0;
+    apint_free_str(gs);
+    apint_free_str(g2s);
+    apint_free_str(ss);
+    apint_free_str(ts);
+    apint_destroy(a);
+    apint_destroy(b);
+    apint_destroy(g);
+    apint_destroy(g2);
+    apint_destroy(s);
+    apint_destroy(t);
+    return ok;
+}
+
+/*
+ * g divides a and b and a s + b t = g, so g is the gcd; s is in range,
+ * apint_gcd agrees, and where g is 1 the inverse checks out
+ */
+static int gcd_is_consistent(const ApInt *a, const ApInt *b) {
+    ApInt *s, *t;
+    ApInt *g = apint_gcdext(a, b, &s, &t);
+    ApInt *g2 = apint_gcd(a, b);
+    ApInt *r = apint_create_from_u64(0UL);
+    int ok = same_value(g, g2) && !apint_is_negative(g);
+    if (!apint_is_zero(g)) {
+        ok &= apint_divmod_into(NULL, r, a, g) == APINT_OK && apint_is_zero(r);
+        ok &= apint_divmod_into(NULL, r, b, g) == APINT_OK && apint_is_zero(r);
+    }
+    apint_mul_into(r, a, s);
+    apint_addmul_into(r, b, t);
+    ok &= apint_compare(r, g) == 0;
+    if (!apint_is_zero(b)) { // -|b| < 2 g s <= |b|
+        ApInt *bound = apint_create_from_u64(0UL);
+        apint_mul_into(r, g, s);
+        apint_lshift_bits_into(r, r, 1);
+        apint_set(bound, b);
+        bound->flags = 0;
+        ok &= apint_compare(r, bound) <= 0;
+        apint_negate_into(bound, bound);
+        ok &= apint_compare(r, bound) > 0;
+        apint_destroy(bound);
+    }
+    ApInt *inv = apint_invert(a, b), *one = apint_create_from_u64(1UL);
+    ok &= (inv != NULL) == (apint_compare(g, one) == 0 && !apint_is_zero(b));
+    if (inv != NULL) { // a inv = 1 mod |b|, inv in [0, |b|)
+        apint_mul_into(r, a, inv);
+        apint_sub_into(r, r, one);
+        ok &= apint_divmod_into(NULL, r, r, b) == APINT_OK && apint_is_zero(r);
+        ok &= !apint_is_negative(inv) && (apint_compare(inv, b) < 0 || b->flags == 1);
+        apint_destroy(inv);
+    }
+    apint_destroy(one);
+    apint_destroy(g);
+    apint_destroy(g2);
+    apint_destroy(s);
+    apint_destroy(t);
+    apint_destroy(r);
+    return ok;
+}
+
+void testGcd(TestObjs *objs) {
+    ASSERT(gcdext_is("c", "12", "6", "-1", "1"));
+    ASSERT(gcdext_is("-c", "12", "6", "1", "1"));
+    ASSERT(gcdext_is("0", "0", "0", "0", "0"));
+    ASSERT(gcdext_is("0", "-5", "5", "0", "-1"));
+    ASSERT(gcdext_is("-7", "0", "7", "-1", "0"));
+    ASSERT(gcdext_is("f0000000000000000000000000000000f", "f0000000000000000f", "f", "78877887788778879",
+                     "-78877887788778878877887788778878"));
+
+    ApInt *r = apint_create_from_u64(0UL);
+    ApInt *a = apint_create_from_u64(3UL), *m = apint_create_from_u64(7UL);
+    ASSERT(APINT_OK == apint_invert_into(r, a, m) && r->data[0] == 5);
+    apint_negate_into(a, a);
+    ASSERT(APINT_OK == apint_invert_into(r, a, m) && r->data[0] == 2);
+    apint_negate_into(m, m);
+    ASSERT(APINT_OK == apint_invert_into(r, a, m) && r->data[0] == 2 && r->flags == 0);
+    ASSERT(APINT_OK == apint_invert_into(r, a, objs->ap1) && apint_is_zero(r));
+    ASSERT(APINT_ERR_DIVZERO == apint_invert_into(r, a, objs->ap0));
+    apint_set_u64(m, 12UL);
+    ASSERT(APINT_ERR_INVALID == apint_invert_into(r, a, m));
+    ASSERT(NULL == apint_invert(objs->ap0, m));
+    apint_set_u64(a, 5UL);
+    ASSERT(APINT_OK == apint_invert_into(a, a, m) && a->data[0] == 5); // dst is the operand
+    apint_destroy(a);
+    apint_destroy(m);
+    apint_destroy(r);
+
+    // random pairs with a common factor, through Lehmer alone and the half-gcd everywhere
+    size_t hgcd = apint_tune_get(APINT_TUNE_GCD_HGCD);
+    size_t thresholds[] = { 2, 9, hgcd };
+    for (int k = 0; k < 3; k++) {
+        apint_tune_set(APINT_TUNE_GCD_HGCD, thresholds[k]);
+        for (int iter = 0; iter < (k < 2 ? 200 : 12); iter++) {
+            uint32_t limit = k < 2 ? 50 : 2 * hgcd + 40;
+            ApInt *f = random_apint(1 + test_rand() % 3);
+            ApInt *x = random_apint(1 + test_rand() % limit);
+            ApInt *y = random_apint(iter % 4 == 0 ? x->len : 1 + test_rand() % limit);
+            if (iter % 3 != 0) {
+                apint_mul_into(x, x, f);
+                apint_mul_into(y, y, f);
+            }
+            if (iter % 17 == 0) {
+                apint_set_u64(y, 0UL);
+            }
+            int ok = gcd_is_consistent(x, y) && gcd_is_consistent(y, x);
+            apint_destroy(f);
+            apint_destroy(x);
+            apint_destroy(y);
+            if (!ok) {
+                apint_tune_set(APINT_TUNE_GCD_HGCD, hgcd);
+            }
+            ASSERT(ok);
+        }
+    }
+    apint_tune_set(APINT_TUNE_GCD_HGCD, hgcd);
+}
+
+void testSqr(TestObjs *objs) {
+    size_t kara = apint_tune_get(APINT_TUNE_SQR_KARATSUBA);
+    size_t toom = apint_tune_get(APINT_TUNE_MUL_TOOM3);
+    size_t ntt = apint_tune_get(APINT_TUNE_MUL_NTT);
+    // as in testMulRandom: every squaring kernel on small operands, then the defaults
+    size_t thresholds[][3] = { {4, 16, SIZE_MAX}, {8, 24, 40}, {kara, toom, ntt} };
+
+    for (int t = 0; t < 3; t++) {
+        apint_tune_set(APINT_TUNE_SQR_KARATSUBA, thresholds[t][0]);
+        apint_tune_set(APINT_TUNE_MUL_TOOM3, thresholds[t][1]);
+        apint_tune_set(APINT_TUNE_MUL_NTT, thresholds[t][2]);
+        for (int iter = 0; iter < 200; iter++) {
+            uint32_t limit = t < 2 ? 80 : 2 * toom + 40;
+            ApInt *a = random_apint(1 + test_rand() % limit);
+            ApInt *sq = apint_sqr(a);
+            ApInt *acc = apint_create_from_u64(0UL);
+            apint_set(acc, a);
+            apint_mul_into(acc, acc, acc); // the same operand three times over
+            int ok = mul_matches_reference(a, a, sq) && sq->flags == 0 && apint_compare(acc, sq) == 0;
+            apint_destroy(sq);
+            apint_destroy(acc);
+            apint_destroy(a);
+            if (!ok) {
+                apint_tune_set(APINT_TUNE_SQR_KARATSUBA, kara);
+                apint_tune_set(APINT_TUNE_MUL_TOOM3, toom);
+                apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+            }
+            ASSERT(ok);
+        }
+    }
+    apint_tune_set(APINT_TUNE_SQR_KARATSUBA, kara);
+    apint_tune_set(APINT_TUNE_MUL_TOOM3, toom);
+    apint_tune_set(APINT_TUNE_MUL_NTT, ntt);
+
+    // all ones gives the largest NTT coefficients; the product of two copies is the reference
+    ApInt *a = random_apint(20000);
+    memset(a->data, 0xff, a->len * sizeof(uint64_t));
+    ApInt *b = apint_add(a, objs->ap0);
+    ApInt *sq = apint_create_from_u64(0UL);
+    apint_sqr_into(sq, a);
+    ApInt *prod = apint_mul(a, b);
+    ASSERT(apint_compare(sq, prod) == 0);
+    apint_destroy(a);
+    apint_destroy(b);
+    apint_destroy(sq);
+    apint_destroy(prod);
+}
+
+// b^n by repeated multiplication, independent of the library's roots
+static ApInt *pow_by_mul(const ApInt *b, unsigned long n) {
+    ApInt *p = apint_create_from_u64(1UL);
+    for (unsigned long i = 0; i < n; i++) {
+        apint_mul_into(p, p, b);
+    }
+    return p;
+}
+
+// r is |a|^(1/n) rounded down, with a's sign: |r|^n <= |a| < (|r| + 1)^n
+static int root_is_floor(const ApInt *a, unsigned long n, const ApInt *r) {
+    ApInt *abs_a = apint_create_from_u64(0UL), *abs_r = apint_create_from_u64(0UL);
+    apint_set(abs_a, a);
+    apint_set(abs_r, r);
+    abs_a->flags = abs_r->flags = 0;
+    ApInt *lo = pow_by_mul(abs_r, n);
+    ApInt *one = apint_create_from_u64(1UL);
+    apint_add_into(abs_r, abs_r, one);
+    ApInt *hi = pow_by_mul(abs_r, n);
+    int ok = apint_compare(lo, abs_a) <= 0 && apint_compare(abs_a, hi) < 0
+        && (apint_is_zero(r) || r->flags == a->flags);
+    apint_destroy(abs_a);
+    apint_destroy(abs_r);
+    apint_destroy(lo);
+    apint_destroy(hi);
+    apint_destroy(one);
+    return ok;
+}
+
+void testRoots(TestObjs *objs) {
+    ApInt *r = apint_create_from_u64(0UL), *rem = apint_create_from_u64(0UL);
+    ASSERT(APINT_OK == apint_sqrtrem_into(r, rem, objs->ap0) && apint_is_zero(r) && apint_is_zero(rem));
+    ASSERT(APINT_OK == apint_sqrtrem_into(r, rem, objs->max1));
+    ASSERT(r->len == 1 && r->data[0] == 0xffffffffUL && rem->data[0] == 0x1fffffffeUL);
+    ASSERT(APINT_ERR_INVALID == apint_sqrtrem_into(r, rem, objs->minus1));
+    ASSERT(NULL == apint_sqrt(objs->minus1));
+    ASSERT(APINT_ERR_INVALID == apint_root_into(r, objs->ap1, 0));
+    ASSERT(APINT_ERR_INVALID == apint_root_into(r, objs->minus1, 4));
+    ASSERT(APINT_OK == apint_root_into(r, objs->minus1, 3) && r->data[0] == 1 && r->flags == 1);
+    ApInt *a = apint_create_from_hex("-1c"); // -28
+    ASSERT(APINT_OK == apint_root_into(r, a, 3) && r->data[0] == 3 && r->flags == 1);
+    ASSERT(APINT_OK == apint_root_into(r, objs->max1, 100) && r->data[0] == 1);
+    ASSERT(APINT_OK == apint_root_into(r, a, 1) && apint_compare(r, a) == 0);
+    apint_set_u64(a, 1000UL);
+    ASSERT(APINT_OK == apint_root_into(a, a, 3) && a->data[0] == 10); // dst is the operand
+    ApInt *big = apint_create_from_hex("fffffffffffffffffffffffffffffffe00000000000000000000000000000001");
+    ApInt *s = apint_sqrtrem(big, NULL); // (2^128 - 1)^2
+    char *hex = apint_format_as_hex(s);
+    ASSERT(0 == strcmp("ffffffffffffffffffffffffffffffff", hex));
+    apint_free_str(hex);
+    ASSERT(apint_is_perfect_square(big) && apint_is_perfect_square(objs->ap0) && apint_is_perfect_square(objs->ap1));
+    ASSERT(!apint_is_perfect_square(objs->minus1) && !apint_is_perfect_square(objs->max1));
+    apint_destroy(s);
+    apint_destroy(big);
+
+    // random values for several n, and squares and their neighbours; the last few are large
+    const unsigned long ns[] = { 2, 3, 5, 7, 64 };
+    for (int iter = 0; iter < 310; iter++) {
+        unsigned long n = ns[iter % 5];
+        ApInt *x = random_apint(1 + test_rand() % (iter < 300 ? 40 : 1500));
+        if (n % 2 == 0) {
+            x->flags = 0;
+        }
+        ASSERT(APINT_OK == apint_root_into(r, x, n));
+        int ok = root_is_floor(x, n, r);
+        if (n == 2) {
+            ASSERT(APINT_OK == apint_sqrtrem_into(a, rem, x));
+            ApInt *sq = apint_mul(a, a);
+            apint_add_into(sq, sq, rem);
+            ok = ok && apint_compare(a, r) == 0 && apint_compare(sq, x) == 0 && rem->flags == 0
+                && apint_is_perfect_square(x) == apint_is_zero(rem);
+            apint_destroy(sq);
+
+            ApInt *y = apint_mul(x, x);
+            ok = ok && apint_is_perfect_square(y);
+            ApInt *root = apint_sqrt(y);
+            ok = ok && apint_compare(root, x) == 0;
+            apint_add_into(y, y, objs->ap1); // x^2 + 1
+            ok = ok && !apint_is_perfect_square(y);
+            apint_sub_into(y, y, objs->ap1);
+            apint_sub_into(y, y, objs->ap1); // x^2 - 1, a square only for x = 1
+            ok = ok && apint_is_perfect_square(y) == (apint_compare(x, objs->ap1) == 0);
+            apint_destroy(root);
+            apint_destroy(y);
+        }
+        apint_destroy(x);
+        ASSERT(ok);
+    }
+    apint_destroy(a);
+    apint_destroy(r);
+    apint_destroy(rem);
+}